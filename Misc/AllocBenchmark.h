@@ -0,0 +1,790 @@
+// Defines benchmark workloads for comparing the pool-based allocators with each other and with malloc
+#pragma once
+#include "DbgAssert.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if __linux__
+#include <unistd.h>
+#endif
+
+// A workload is a fixed sequence of allocate and free operations on numbered slots, generated up front
+// (from a free order, a churn or burst pattern, or a recorded trace) so every allocator replays exactly the same thing
+// and generating it costs nothing during the run. RunBenchWorkload replays it twice:
+//  -untimed, for throughput and RSS (sampled once, at the point of peak live bytes)
+//  -timing every operation, for latency percentiles, with the clock's own overhead subtracted
+// Producer/consumer is the exception, since it's about two threads: RunProducerConsumerBench allocates on the calling
+// thread and frees every block through FreeRemote on a second thread.
+// RunThreadedBenchWorkload measures how a thread safe allocator scales, replaying a workload on several threads at once.
+//
+// Allocators are used through small adapters with Allocate(size), Free(ptr, size), and FreeRemote(ptr, size), where size
+// is what was passed to Allocate: MallocBenchAllocator, PoolBenchAllocator (for PoolAllocator, GrowablePoolAllocator,
+// and so on), SharedPoolBenchAllocator (for thread safe pools like ConcurrentPoolAllocator, whose Free already works
+// from any thread), and SizedBenchAllocator (for allocators whose Free takes the size, like SmallObjectAllocator).
+// Benchmarks/AllocBenchmarkMain.cpp runs every workload below over each allocator against a checked in baseline.
+//
+// Fragmentation is the share of the memory a run made resident that wasn't holding live data at the peak,
+// 1 - peakLiveBytes / rssGrowth. It's only meaningful for an allocator measured from a fresh state (i.e. a new pool),
+// since memory that was already resident doesn't show up as growth. RSS is read from /proc, so it's 0 off Linux.
+//
+// To check for regressions locally, save a baseline once and compare later runs against it:
+//  PoolAllocator<64, 1 << 16> pool;
+//  PoolBenchAllocator<PoolAllocator<64, 1 << 16>> adapter(pool);
+//  std::vector<BenchResult> results;
+//  results.push_back(RunBenchWorkload(adapter, MakeFreeOrderWorkload("pool_lifo", 64, 64, 1 << 15, 20, BenchFreeOrder::Lifo)));
+//  results.push_back(RunProducerConsumerBench(adapter, "pool_producer_consumer", 64, 1 << 20, 1024));
+//  if (!CheckBenchRegressions(results, "pool_baseline.txt", BenchThresholds(), stdout))
+//   SaveBenchBaseline(results, "pool_baseline.txt"); // Only after deciding the change is acceptable
+// Build benchmarks with optimizations and without POOL_ALLOC_DEBUG, POOL_ALLOC_CHECKED, or POOL_ALLOC_TELEMETRY
+// unless those are what's being measured.
+
+// One operation of a workload
+struct BenchOp
+{
+	std::uint32_t mSlot;
+	// Bytes to allocate into mSlot, or 0 to free mSlot
+	std::uint32_t mSize;
+};
+
+struct BenchWorkload
+{
+	// Used as the result's name; must not contain whitespace, so baselines can be read back
+	std::string mName;
+	std::vector<BenchOp> mOps;
+	std::uint32_t mNumSlots;
+};
+
+// What one run measured
+struct BenchResult
+{
+	std::string mName;
+	// Allocate and Free calls made
+	std::uint64_t mOperations;
+	// Allocate calls that returned nullptr
+	std::uint64_t mFailedAllocations;
+	double mSeconds;
+	double mOpsPerSecond;
+	// Latency percentiles of a single Allocate or Free, in nanoseconds
+	double mP50Ns;
+	double mP99Ns;
+	double mP999Ns;
+	double mMaxNs;
+	// Most bytes allocated at once, by requested size
+	std::uint64_t mPeakLiveBytes;
+	// Growth in resident memory from the start of the run to the peak
+	std::uint64_t mRssGrowthBytes;
+	// 1 - mPeakLiveBytes / mRssGrowthBytes, or 0 if RSS didn't grow
+	double mFragmentation;
+
+	// Return the result as a single line JSON object
+	std::string ToJson() const;
+};
+
+// How much worse than the baseline a result may be, as fractions of the baseline's values
+struct BenchThresholds
+{
+	double mMaxThroughputDrop;
+	double mMaxP99Increase;
+	double mMaxRssIncrease;
+
+	BenchThresholds()
+		: mMaxThroughputDrop(0.1)
+		, mMaxP99Increase(0.25)
+		, mMaxRssIncrease(0.1)
+	{}
+};
+
+enum class BenchFreeOrder
+{
+	// Free the newest block first
+	Lifo,
+	// Free the oldest block first
+	Fifo,
+	// Free in a shuffled order
+	Random
+};
+
+// Adapters
+struct MallocBenchAllocator
+{
+	void* Allocate(size_t size) { return malloc(size); }
+	void Free(void* ptr, size_t) { free(ptr); }
+	void FreeRemote(void* ptr, size_t) { free(ptr); }
+};
+
+// For pools owned by one thread, which take blocks back from other threads through FreeRemote
+template <typename Pool>
+struct PoolBenchAllocator
+{
+	explicit PoolBenchAllocator(Pool& pool)
+		: mPool(pool)
+	{}
+	void* Allocate(size_t size) { return mPool.Allocate(size); }
+	void Free(void* ptr, size_t) { mPool.Free(ptr); }
+	void FreeRemote(void* ptr, size_t) { mPool.FreeRemote(ptr); }
+
+	Pool& mPool;
+};
+
+// For thread safe pools, whose Free is safe from any thread
+template <typename Pool>
+struct SharedPoolBenchAllocator
+{
+	explicit SharedPoolBenchAllocator(Pool& pool)
+		: mPool(pool)
+	{}
+	void* Allocate(size_t size) { return mPool.Allocate(size); }
+	void Free(void* ptr, size_t) { mPool.Free(ptr); }
+	void FreeRemote(void* ptr, size_t) { mPool.Free(ptr); }
+
+	Pool& mPool;
+};
+
+// For single threaded allocators whose Free takes the size that was allocated, like C++14 sized delete
+// They have no FreeRemote, so they can't run the producer/consumer benchmark
+template <typename Alloc>
+struct SizedBenchAllocator
+{
+	explicit SizedBenchAllocator(Alloc& allocator)
+		: mAllocator(allocator)
+	{}
+	void* Allocate(size_t size) { return mAllocator.Allocate(size); }
+	void Free(void* ptr, size_t size) { mAllocator.Free(ptr, size); }
+
+	Alloc& mAllocator;
+};
+
+// Wraps another adapter, writing every call to file in the format LoadBenchTrace reads, to capture a real program's
+// allocation pattern for replay. Pointers are used as the trace's ids.
+template <typename Alloc>
+class TraceRecordingAllocator
+{
+public:
+	TraceRecordingAllocator(Alloc& allocator, FILE* file)
+		: mAllocator(allocator)
+		, mFile(file)
+	{}
+
+	void* Allocate(size_t size)
+	{
+		void* ptr = mAllocator.Allocate(size);
+		if (ptr != nullptr)
+			fprintf(mFile, "a %llu %llu\n", static_cast<unsigned long long>(reinterpret_cast<std::uintptr_t>(ptr)), static_cast<unsigned long long>(size));
+		return ptr;
+	}
+	void Free(void* ptr, size_t size)
+	{
+		fprintf(mFile, "f %llu\n", static_cast<unsigned long long>(reinterpret_cast<std::uintptr_t>(ptr)));
+		mAllocator.Free(ptr, size);
+	}
+	// Lines from two threads would interleave, so traces are single threaded
+	void FreeRemote(void* ptr, size_t size) { Free(ptr, size); }
+
+private:
+	Alloc& mAllocator;
+	FILE* mFile;
+};
+
+// Workload generators
+// Sizes are drawn uniformly from [minSize, maxSize]; pass the same value for fixed-size pools.
+
+// rounds of allocating count blocks and then freeing them all in order
+BenchWorkload MakeFreeOrderWorkload(const char* name, std::uint32_t minSize, std::uint32_t maxSize, std::uint32_t count,
+	std::uint32_t rounds, BenchFreeOrder order, std::uint32_t seed = 1);
+
+// Steady state churn: allocate liveCount blocks, then steps times free a random live block and allocate a replacement
+BenchWorkload MakeChurnWorkload(const char* name, std::uint32_t minSize, std::uint32_t maxSize, std::uint32_t liveCount,
+	std::uint32_t steps, std::uint32_t seed = 1);
+
+// Spawn and despawn waves on top of a long-lived population: allocate baseCount blocks, then bursts times allocate
+// burstSize blocks at once and free them again in a random order (i.e. particles or projectiles)
+BenchWorkload MakeBurstWorkload(const char* name, std::uint32_t minSize, std::uint32_t maxSize, std::uint32_t baseCount,
+	std::uint32_t burstSize, std::uint32_t bursts, std::uint32_t seed = 1);
+
+// Read a trace of lines "a <id> <size>" (allocate) and "f <id>" (free), as TraceRecordingAllocator writes.
+// Blocks still allocated at the end are freed, so the workload always ends empty.
+//
+// Returns false if the file can't be opened or has a malformed line, or frees an id that isn't allocated.
+bool LoadBenchTrace(const char* path, const char* name, BenchWorkload& workload);
+
+// Runners
+
+// Replay workload through allocator as described at the top of this file
+template <typename Alloc>
+BenchResult RunBenchWorkload(Alloc& allocator, const BenchWorkload& workload);
+
+// Replay workload on numThreads threads at once through one thread safe allocator, each thread with its own slots,
+// so the allocator needs room for numThreads times the workload's live blocks.
+// Throughput counts every thread's operations over the time from a common start until the last thread finishes,
+// and the latency percentiles are over every thread's operations. RSS isn't sampled, since threads peak at different times.
+template <typename Alloc>
+BenchResult RunThreadedBenchWorkload(Alloc& allocator, const BenchWorkload& workload, unsigned int numThreads);
+
+// Allocate count blocks of size on the calling thread and free each through FreeRemote on a second thread,
+// with at most maxInFlight blocks handed over and not yet freed; a pool needs room for about twice that many.
+// It stops early at the first failed allocation.
+template <typename Alloc>
+BenchResult RunProducerConsumerBench(Alloc& allocator, const char* name, size_t size, std::uint32_t count, std::uint32_t maxInFlight);
+
+// Baselines
+
+// Write one line per result ("name opsPerSecond p99Ns rssGrowthBytes") to path, replacing it
+bool SaveBenchBaseline(const std::vector<BenchResult>& results, const char* path);
+
+// Compare results against the baseline at path, printing one line per result to report (if not nullptr), and return
+// whether every result is within thresholds. Results missing from the baseline pass; a missing baseline file fails.
+bool CheckBenchRegressions(const std::vector<BenchResult>& results, const char* path, const BenchThresholds& thresholds, FILE* report);
+
+namespace interior
+{
+	// Resident set size of the process, or 0 if it can't be read
+	std::uint64_t ReadResidentBytes();
+
+	// Time of the clock reads around each timed operation, to subtract from its latency
+	double MeasureClockOverheadNs();
+
+	// Fill in the latency percentiles from per-operation times, which are reordered
+	void SetLatencyPercentiles(BenchResult& result, std::vector<std::uint32_t>& latenciesNs);
+
+	// Fill in throughput and fragmentation from the other fields
+	void FinishBenchResult(BenchResult& result);
+
+	// Replay workload once through allocator timing every operation, appending the times to latenciesNs
+	// slots and liveSizes hold each slot's block and its size, and are left as the workload leaves them
+	template <typename Alloc>
+	void TimeBenchWorkload(Alloc& allocator, const BenchWorkload& workload, std::vector<void*>& slots, std::vector<std::uint32_t>& liveSizes,
+		double overheadNs, std::vector<std::uint32_t>& latenciesNs);
+
+	// Draw a size in [minSize, maxSize]
+	inline std::uint32_t DrawBenchSize(std::mt19937& random, std::uint32_t minSize, std::uint32_t maxSize)
+	{
+		return minSize == maxSize ? minSize : std::uniform_int_distribution<std::uint32_t>(minSize, maxSize)(random);
+	}
+}
+
+// IMPLEMENTATIONS for the workload generators
+
+inline BenchWorkload MakeFreeOrderWorkload(const char* name, std::uint32_t minSize, std::uint32_t maxSize, std::uint32_t count,
+	std::uint32_t rounds, BenchFreeOrder order, std::uint32_t seed)
+{
+	BenchWorkload workload;
+	workload.mName = name;
+	workload.mNumSlots = count;
+	workload.mOps.reserve(size_t(2) * count * rounds);
+	std::mt19937 random(seed);
+	std::vector<std::uint32_t> freeOrder(count);
+	for (std::uint32_t round = 0; round < rounds; ++round)
+	{
+		for (std::uint32_t slot = 0; slot < count; ++slot)
+			workload.mOps.push_back({ slot, interior::DrawBenchSize(random, minSize, maxSize) });
+
+		for (std::uint32_t i = 0; i < count; ++i)
+			freeOrder[i] = order == BenchFreeOrder::Lifo ? count - 1 - i : i;
+		if (order == BenchFreeOrder::Random)
+			std::shuffle(freeOrder.begin(), freeOrder.end(), random);
+		for (std::uint32_t slot : freeOrder)
+			workload.mOps.push_back({ slot, 0 });
+	}
+	return workload;
+}
+
+inline BenchWorkload MakeChurnWorkload(const char* name, std::uint32_t minSize, std::uint32_t maxSize, std::uint32_t liveCount,
+	std::uint32_t steps, std::uint32_t seed)
+{
+	BenchWorkload workload;
+	workload.mName = name;
+	workload.mNumSlots = liveCount;
+	workload.mOps.reserve(size_t(2) * (liveCount + steps));
+	std::mt19937 random(seed);
+	for (std::uint32_t slot = 0; slot < liveCount; ++slot)
+		workload.mOps.push_back({ slot, interior::DrawBenchSize(random, minSize, maxSize) });
+	for (std::uint32_t step = 0; step < steps; ++step)
+	{
+		std::uint32_t slot = std::uniform_int_distribution<std::uint32_t>(0, liveCount - 1)(random);
+		workload.mOps.push_back({ slot, 0 });
+		workload.mOps.push_back({ slot, interior::DrawBenchSize(random, minSize, maxSize) });
+	}
+	for (std::uint32_t slot = 0; slot < liveCount; ++slot)
+		workload.mOps.push_back({ slot, 0 });
+	return workload;
+}
+
+inline BenchWorkload MakeBurstWorkload(const char* name, std::uint32_t minSize, std::uint32_t maxSize, std::uint32_t baseCount,
+	std::uint32_t burstSize, std::uint32_t bursts, std::uint32_t seed)
+{
+	BenchWorkload workload;
+	workload.mName = name;
+	workload.mNumSlots = baseCount + burstSize;
+	workload.mOps.reserve(size_t(2) * (baseCount + size_t(burstSize) * bursts));
+	std::mt19937 random(seed);
+	for (std::uint32_t slot = 0; slot < baseCount; ++slot)
+		workload.mOps.push_back({ slot, interior::DrawBenchSize(random, minSize, maxSize) });
+
+	std::vector<std::uint32_t> despawnOrder(burstSize);
+	for (std::uint32_t burst = 0; burst < bursts; ++burst)
+	{
+		for (std::uint32_t i = 0; i < burstSize; ++i)
+		{
+			workload.mOps.push_back({ baseCount + i, interior::DrawBenchSize(random, minSize, maxSize) });
+			despawnOrder[i] = baseCount + i;
+		}
+		std::shuffle(despawnOrder.begin(), despawnOrder.end(), random);
+		for (std::uint32_t slot : despawnOrder)
+			workload.mOps.push_back({ slot, 0 });
+	}
+
+	for (std::uint32_t slot = 0; slot < baseCount; ++slot)
+		workload.mOps.push_back({ slot, 0 });
+	return workload;
+}
+
+inline bool LoadBenchTrace(const char* path, const char* name, BenchWorkload& workload)
+{
+	FILE* file = fopen(path, "r");
+	if (file == nullptr)
+		return false;
+
+	workload.mName = name;
+	workload.mOps.clear();
+	workload.mNumSlots = 0;
+	// Live trace ids and the slots they're in; freed slots are reused so mNumSlots stays the peak live count
+	std::unordered_map<unsigned long long, std::uint32_t> liveSlots;
+	std::vector<std::uint32_t> freeSlots;
+	bool valid = true;
+	char op;
+	unsigned long long id;
+	while (valid && fscanf(file, " %c %llu", &op, &id) == 2)
+	{
+		if (op == 'a')
+		{
+			unsigned long long size;
+			valid = fscanf(file, "%llu", &size) == 1 && size > 0 && size <= 0xFFFFFFFFull && liveSlots.count(id) == 0;
+			if (!valid)
+				break;
+			std::uint32_t slot = workload.mNumSlots;
+			if (freeSlots.empty())
+				++workload.mNumSlots;
+			else
+			{
+				slot = freeSlots.back();
+				freeSlots.pop_back();
+			}
+			liveSlots[id] = slot;
+			workload.mOps.push_back({ slot, static_cast<std::uint32_t>(size) });
+		}
+		else
+		{
+			auto live = liveSlots.find(id);
+			valid = op == 'f' && live != liveSlots.end();
+			if (!valid)
+				break;
+			workload.mOps.push_back({ live->second, 0 });
+			freeSlots.push_back(live->second);
+			liveSlots.erase(live);
+		}
+	}
+	valid = valid && feof(file);
+	fclose(file);
+
+	for (const auto& live : liveSlots)
+		workload.mOps.push_back({ live.second, 0 });
+	return valid;
+}
+
+// IMPLEMENTATIONS for the runners
+
+template <typename Alloc>
+BenchResult RunBenchWorkload(Alloc& allocator, const BenchWorkload& workload)
+{
+	BenchResult result = BenchResult();
+	result.mName = workload.mName;
+	result.mOperations = workload.mOps.size();
+	std::vector<void*> slots(workload.mNumSlots, nullptr);
+
+	// Find where live bytes peak, to sample RSS there
+	size_t peakOp = 0;
+	std::uint64_t liveBytes = 0;
+	std::vector<std::uint32_t> slotSizes(workload.mNumSlots, 0);
+	for (size_t i = 0; i < workload.mOps.size(); ++i)
+	{
+		const BenchOp& op = workload.mOps[i];
+		liveBytes = liveBytes - slotSizes[op.mSlot] + op.mSize;
+		slotSizes[op.mSlot] = op.mSize;
+		if (liveBytes > result.mPeakLiveBytes)
+		{
+			result.mPeakLiveBytes = liveBytes;
+			peakOp = i;
+		}
+	}
+
+	// Size each slot's block was allocated with, for sized frees
+	std::vector<std::uint32_t> liveSizes(workload.mNumSlots, 0);
+
+	// Throughput pass
+	std::uint64_t startRss = interior::ReadResidentBytes();
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < workload.mOps.size(); ++i)
+	{
+		const BenchOp& op = workload.mOps[i];
+		if (op.mSize == 0)
+		{
+			if (slots[op.mSlot] != nullptr)
+				allocator.Free(slots[op.mSlot], liveSizes[op.mSlot]);
+			slots[op.mSlot] = nullptr;
+		}
+		else
+		{
+			slots[op.mSlot] = allocator.Allocate(op.mSize);
+			liveSizes[op.mSlot] = op.mSize;
+			// Touch the block like a real caller would, which also keeps the call from being optimized away
+			if (slots[op.mSlot] != nullptr)
+				*static_cast<volatile char*>(slots[op.mSlot]) = 1;
+			else
+				++result.mFailedAllocations;
+		}
+		if (i == peakOp)
+		{
+			// Reading /proc takes microseconds, so leave it out of the time
+			auto pauseStart = std::chrono::steady_clock::now();
+			std::uint64_t peakRss = interior::ReadResidentBytes();
+			result.mRssGrowthBytes = peakRss > startRss ? peakRss - startRss : 0;
+			start += std::chrono::steady_clock::now() - pauseStart;
+		}
+	}
+	result.mSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// Latency pass
+	std::vector<std::uint32_t> latenciesNs;
+	latenciesNs.reserve(workload.mOps.size());
+	interior::TimeBenchWorkload(allocator, workload, slots, liveSizes, interior::MeasureClockOverheadNs(), latenciesNs);
+	interior::SetLatencyPercentiles(result, latenciesNs);
+	interior::FinishBenchResult(result);
+	return result;
+}
+
+template <typename Alloc>
+BenchResult RunThreadedBenchWorkload(Alloc& allocator, const BenchWorkload& workload, unsigned int numThreads)
+{
+	BenchResult result = BenchResult();
+	result.mName = workload.mName;
+	result.mOperations = std::uint64_t(numThreads) * workload.mOps.size();
+
+	// Throughput pass, with every thread spinning until all of them have started
+	std::atomic<unsigned int> ready(0);
+	std::atomic<bool> go(false);
+	std::atomic<std::uint64_t> failedAllocations(0);
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < numThreads; ++t)
+	{
+		threads.emplace_back([&]()
+		{
+			std::vector<void*> slots(workload.mNumSlots, nullptr);
+			std::vector<std::uint32_t> liveSizes(workload.mNumSlots, 0);
+			std::uint64_t failed = 0;
+			ready.fetch_add(1, std::memory_order_release);
+			while (!go.load(std::memory_order_acquire))
+				std::this_thread::yield();
+			for (const BenchOp& op : workload.mOps)
+			{
+				if (op.mSize == 0)
+				{
+					if (slots[op.mSlot] != nullptr)
+						allocator.Free(slots[op.mSlot], liveSizes[op.mSlot]);
+					slots[op.mSlot] = nullptr;
+				}
+				else
+				{
+					slots[op.mSlot] = allocator.Allocate(op.mSize);
+					liveSizes[op.mSlot] = op.mSize;
+					if (slots[op.mSlot] != nullptr)
+						*static_cast<volatile char*>(slots[op.mSlot]) = 1;
+					else
+						++failed;
+				}
+			}
+			failedAllocations.fetch_add(failed, std::memory_order_relaxed);
+		});
+	}
+	while (ready.load(std::memory_order_acquire) < numThreads)
+		std::this_thread::yield();
+	auto start = std::chrono::steady_clock::now();
+	go.store(true, std::memory_order_release);
+	for (std::thread& thread : threads)
+		thread.join();
+	result.mSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.mFailedAllocations = failedAllocations.load(std::memory_order_relaxed);
+	threads.clear();
+
+	// Latency pass, each thread collecting its own times
+	double overheadNs = interior::MeasureClockOverheadNs();
+	std::vector<std::vector<std::uint32_t>> threadLatenciesNs(numThreads);
+	for (unsigned int t = 0; t < numThreads; ++t)
+	{
+		threads.emplace_back([&, t]()
+		{
+			std::vector<void*> slots(workload.mNumSlots, nullptr);
+			std::vector<std::uint32_t> liveSizes(workload.mNumSlots, 0);
+			threadLatenciesNs[t].reserve(workload.mOps.size());
+			interior::TimeBenchWorkload(allocator, workload, slots, liveSizes, overheadNs, threadLatenciesNs[t]);
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	std::vector<std::uint32_t> latenciesNs;
+	latenciesNs.reserve(result.mOperations);
+	for (const std::vector<std::uint32_t>& times : threadLatenciesNs)
+		latenciesNs.insert(latenciesNs.end(), times.begin(), times.end());
+	interior::SetLatencyPercentiles(result, latenciesNs);
+	interior::FinishBenchResult(result);
+	return result;
+}
+
+template <typename Alloc>
+BenchResult RunProducerConsumerBench(Alloc& allocator, const char* name, size_t size, std::uint32_t count, std::uint32_t maxInFlight)
+{
+	BenchResult result = BenchResult();
+	result.mName = name;
+	result.mOperations = std::uint64_t(2) * count;
+	result.mPeakLiveBytes = std::uint64_t(maxInFlight) * size;
+
+	// Single producer, single consumer ring of handed over blocks
+	std::uint32_t capacity = 1;
+	while (capacity < maxInFlight)
+		capacity <<= 1;
+	std::vector<void*> ring(capacity);
+	std::atomic<std::uint32_t> head(0);
+	std::atomic<std::uint32_t> tail(0);
+	std::atomic<bool> producing(true);
+
+	std::thread consumer([&]()
+	{
+		std::uint32_t next = 0;
+		for (;;)
+		{
+			std::uint32_t available = tail.load(std::memory_order_acquire);
+			if (next == available)
+			{
+				if (!producing.load(std::memory_order_acquire) && next == tail.load(std::memory_order_acquire))
+					break;
+				std::this_thread::yield();
+				continue;
+			}
+			for (; next != available; ++next)
+				allocator.FreeRemote(ring[next & (capacity - 1)], size);
+			head.store(next, std::memory_order_release);
+		}
+	});
+
+	double overheadNs = interior::MeasureClockOverheadNs();
+	std::vector<std::uint32_t> latenciesNs;
+	latenciesNs.reserve(count);
+	std::uint64_t startRss = interior::ReadResidentBytes();
+	auto start = std::chrono::steady_clock::now();
+	for (std::uint32_t i = 0; i < count; ++i)
+	{
+		while (i - head.load(std::memory_order_acquire) >= maxInFlight)
+			std::this_thread::yield();
+
+		auto opStart = std::chrono::steady_clock::now();
+		void* ptr = allocator.Allocate(size);
+		auto opEnd = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(opEnd - opStart).count() - overheadNs;
+		latenciesNs.push_back(ns > 0 ? static_cast<std::uint32_t>(ns) : 0);
+		if (ptr == nullptr)
+		{
+			// The allocator is too small for maxInFlight; stop rather than measure spinning on it
+			++result.mFailedAllocations;
+			result.mOperations = std::uint64_t(2) * i;
+			break;
+		}
+		*static_cast<volatile char*>(ptr) = 1;
+		ring[i & (capacity - 1)] = ptr;
+		tail.store(i + 1, std::memory_order_release);
+	}
+	producing.store(false, std::memory_order_release);
+	consumer.join();
+	result.mSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::uint64_t endRss = interior::ReadResidentBytes();
+	result.mRssGrowthBytes = endRss > startRss ? endRss - startRss : 0;
+
+	// Time includes the timed allocations; per-allocation clock reads are the same for every allocator, so the
+	// comparison still holds
+	interior::SetLatencyPercentiles(result, latenciesNs);
+	interior::FinishBenchResult(result);
+	return result;
+}
+
+// IMPLEMENTATIONS for baselines
+
+inline bool SaveBenchBaseline(const std::vector<BenchResult>& results, const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (file == nullptr)
+		return false;
+	bool written = true;
+	for (const BenchResult& result : results)
+	{
+		written = written && fprintf(file, "%s %.1f %.1f %llu\n", result.mName.c_str(), result.mOpsPerSecond, result.mP99Ns,
+			static_cast<unsigned long long>(result.mRssGrowthBytes)) > 0;
+	}
+	return fclose(file) == 0 && written;
+}
+
+inline bool CheckBenchRegressions(const std::vector<BenchResult>& results, const char* path, const BenchThresholds& thresholds, FILE* report)
+{
+	FILE* file = fopen(path, "r");
+	if (file == nullptr)
+	{
+		if (report != nullptr)
+			fprintf(report, "No baseline at %s\n", path);
+		return false;
+	}
+
+	struct Baseline
+	{
+		double mOpsPerSecond;
+		double mP99Ns;
+		unsigned long long mRssGrowthBytes;
+	};
+	std::unordered_map<std::string, Baseline> baselines;
+	char name[256];
+	Baseline baseline;
+	while (fscanf(file, "%255s %lf %lf %llu", name, &baseline.mOpsPerSecond, &baseline.mP99Ns, &baseline.mRssGrowthBytes) == 4)
+		baselines[name] = baseline;
+	fclose(file);
+
+	bool passed = true;
+	for (const BenchResult& result : results)
+	{
+		auto found = baselines.find(result.mName);
+		if (found == baselines.end())
+		{
+			if (report != nullptr)
+				fprintf(report, "NEW  %s: %.0f ops/s, p99 %.0f ns\n", result.mName.c_str(), result.mOpsPerSecond, result.mP99Ns);
+			continue;
+		}
+		const Baseline& base = found->second;
+		bool throughputOk = result.mOpsPerSecond >= base.mOpsPerSecond * (1.0 - thresholds.mMaxThroughputDrop);
+		bool latencyOk = result.mP99Ns <= base.mP99Ns * (1.0 + thresholds.mMaxP99Increase);
+		// A page of slack, so runs that barely grow RSS don't fail on a single page
+		bool rssOk = result.mRssGrowthBytes <= base.mRssGrowthBytes * (1.0 + thresholds.mMaxRssIncrease) + 4096;
+		bool ok = throughputOk && latencyOk && rssOk;
+		passed = passed && ok;
+		if (report != nullptr)
+		{
+			fprintf(report, "%s %s: %.0f ops/s (baseline %.0f)%s, p99 %.0f ns (baseline %.0f)%s, rss +%llu (baseline +%llu)%s\n",
+				ok ? "OK  " : "FAIL", result.mName.c_str(),
+				result.mOpsPerSecond, base.mOpsPerSecond, throughputOk ? "" : " REGRESSED",
+				result.mP99Ns, base.mP99Ns, latencyOk ? "" : " REGRESSED",
+				static_cast<unsigned long long>(result.mRssGrowthBytes), base.mRssGrowthBytes, rssOk ? "" : " REGRESSED");
+		}
+	}
+	return passed;
+}
+
+// IMPLEMENTATIONS for BenchResult
+
+inline std::string BenchResult::ToJson() const
+{
+	char buffer[512];
+	snprintf(buffer, sizeof(buffer),
+		"{\"name\":\"%s\",\"operations\":%llu,\"failedAllocations\":%llu,\"seconds\":%.6f,\"opsPerSecond\":%.1f,"
+		"\"p50Ns\":%.1f,\"p99Ns\":%.1f,\"p999Ns\":%.1f,\"maxNs\":%.1f,\"peakLiveBytes\":%llu,\"rssGrowthBytes\":%llu,\"fragmentation\":%.4f}",
+		mName.c_str(), static_cast<unsigned long long>(mOperations), static_cast<unsigned long long>(mFailedAllocations),
+		mSeconds, mOpsPerSecond, mP50Ns, mP99Ns, mP999Ns, mMaxNs,
+		static_cast<unsigned long long>(mPeakLiveBytes), static_cast<unsigned long long>(mRssGrowthBytes), mFragmentation);
+	return buffer;
+}
+
+// IMPLEMENTATIONS for interior
+
+inline std::uint64_t interior::ReadResidentBytes()
+{
+#if __linux__
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (file == nullptr)
+		return 0;
+	unsigned long long pages = 0;
+	unsigned long long residentPages = 0;
+	int read = fscanf(file, "%llu %llu", &pages, &residentPages);
+	fclose(file);
+	return read == 2 ? residentPages * static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE)) : 0;
+#else
+	return 0;
+#endif
+}
+
+inline double interior::MeasureClockOverheadNs()
+{
+	// The smallest back to back reading is the clock's own cost with the least noise
+	double overheadNs = 1e9;
+	for (int i = 0; i < 1000; ++i)
+	{
+		auto first = std::chrono::steady_clock::now();
+		auto second = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(second - first).count();
+		overheadNs = ns < overheadNs ? ns : overheadNs;
+	}
+	return overheadNs;
+}
+
+inline void interior::SetLatencyPercentiles(BenchResult& result, std::vector<std::uint32_t>& latenciesNs)
+{
+	if (latenciesNs.empty())
+		return;
+	auto percentile = [&latenciesNs](double fraction)
+	{
+		size_t index = static_cast<size_t>(fraction * (latenciesNs.size() - 1));
+		std::nth_element(latenciesNs.begin(), latenciesNs.begin() + index, latenciesNs.end());
+		return static_cast<double>(latenciesNs[index]);
+	};
+	result.mP50Ns = percentile(0.5);
+	result.mP99Ns = percentile(0.99);
+	result.mP999Ns = percentile(0.999);
+	result.mMaxNs = static_cast<double>(*std::max_element(latenciesNs.begin(), latenciesNs.end()));
+}
+
+inline void interior::FinishBenchResult(BenchResult& result)
+{
+	result.mOpsPerSecond = result.mSeconds > 0 ? result.mOperations / result.mSeconds : 0;
+	result.mFragmentation = 0;
+	if (result.mRssGrowthBytes > result.mPeakLiveBytes)
+		result.mFragmentation = 1.0 - static_cast<double>(result.mPeakLiveBytes) / static_cast<double>(result.mRssGrowthBytes);
+}
+
+template <typename Alloc>
+void interior::TimeBenchWorkload(Alloc& allocator, const BenchWorkload& workload, std::vector<void*>& slots, std::vector<std::uint32_t>& liveSizes,
+	double overheadNs, std::vector<std::uint32_t>& latenciesNs)
+{
+	for (const BenchOp& op : workload.mOps)
+	{
+		void* ptr = nullptr;
+		auto opStart = std::chrono::steady_clock::now();
+		if (op.mSize == 0)
+		{
+			if (slots[op.mSlot] != nullptr)
+				allocator.Free(slots[op.mSlot], liveSizes[op.mSlot]);
+		}
+		else
+		{
+			ptr = allocator.Allocate(op.mSize);
+		}
+		auto opEnd = std::chrono::steady_clock::now();
+		slots[op.mSlot] = ptr;
+		liveSizes[op.mSlot] = op.mSize;
+		if (ptr != nullptr)
+			*static_cast<volatile char*>(ptr) = 1;
+		double ns = std::chrono::duration<double, std::nano>(opEnd - opStart).count() - overheadNs;
+		latenciesNs.push_back(ns > 0 ? static_cast<std::uint32_t>(ns) : 0);
+	}
+}
@@ -0,0 +1,573 @@
+// Defines archetype-based component storage (ECS-style), laid out in chunks from the pool-based allocator
+#pragma once
+#include "ObjectPool.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Handle to an entity in an ArchetypeStorage; same generational scheme as ObjectPool's handles
+struct EntityTag;
+typedef ObjectHandle<EntityTag> Entity;
+
+namespace interior
+{
+	// Most component types a program can use, so an archetype's component set fits in a 64-bit mask
+	const unsigned int kMaxComponentTypes = 64;
+
+	// How storage moves and destroys a component type it only knows by id
+	struct ComponentInfo
+	{
+		size_t mSize;
+		size_t mAlignment;
+		// Move construct dst from src, then destroy src
+		void (*mMove)(void* dst, void* src);
+		void (*mDestroy)(void* ptr);
+	};
+
+	inline ComponentInfo* ComponentInfoTable()
+	{
+		static ComponentInfo sTable[kMaxComponentTypes];
+		return sTable;
+	}
+
+	// Give a component type the next free id, throwing std::length_error once all kMaxComponentTypes are taken
+	// (ids are bit positions in archetype masks, so handing out a bigger one isn't an option in any build)
+	inline unsigned int RegisterComponentType(const ComponentInfo& info)
+	{
+		static std::atomic<unsigned int> sNumTypes(0);
+		unsigned int id = sNumTypes.fetch_add(1, std::memory_order_relaxed);
+		if (id >= kMaxComponentTypes)
+			throw std::length_error("Too many component types for ArchetypeStorage");
+		ComponentInfoTable()[id] = info;
+		return id;
+	}
+
+	template <typename T>
+	void MoveComponent(void* dst, void* src)
+	{
+		T* source = static_cast<T*>(src);
+		new (dst) T(std::move(*source));
+		source->~T();
+	}
+
+	template <typename T>
+	void DestroyComponent(void* ptr)
+	{
+		static_cast<T*>(ptr)->~T();
+	}
+
+	// Ids are handed out the first time each type is used, so they're only stable within one run of the program
+	template <typename T>
+	unsigned int ComponentTypeId()
+	{
+		static const unsigned int sId = RegisterComponentType({ sizeof(T), alignof(T), &MoveComponent<T>, &DestroyComponent<T> });
+		return sId;
+	}
+}
+
+// Defines an Archetype Storage
+// Templated based on the size of each chunk, the most chunks it can use, and the most entities alive at once.
+//
+// An entity's archetype is the set of component types it has. Every archetype stores its entities in fixed-size chunks
+// allocated from a PoolAllocator, and within a chunk each component type gets its own array (structure of arrays),
+// cache line aligned. A system that wants positions and rotations calls ForEachChunk<Vector<float, 3>, Quaternion<float>>
+// and gets, chunk by chunk, a count and plain arrays it can run straight through, i.e. RotationBatch4x4 on the rotations:
+//  storage.ForEachChunk<Quaternion<float>>([&](unsigned int count, Quaternion<float>* rotations) { ... });
+//
+// Rows are kept packed: every chunk of an archetype is full except the last, and removing a row moves the archetype's
+// last row into the hole (so order within an archetype isn't stable). Adding or removing a component moves the entity's
+// row to the neighbouring archetype, which is found through a per-archetype edge cache after the first such move;
+// with the swap-remove that makes moves O(1) amortized, plus the cost of moving the entity's components.
+//
+// Components may be any type up to 64-byte alignment; they are moved with their move constructor when rows move.
+// A program can use at most 64 component types across all storages; first using a 65th throws std::length_error.
+// Pointers to components are invalidated by any Create, Destroy, Add, or Remove; hold Entity handles across those instead.
+// No entities may be created, destroyed, or change components while a ForEachChunk is running.
+//
+// To define your own storage to be used, it's recommended to typedef as such:
+// typedef ArchetypeStorage<16 * 1024, 1024, 65536> World;
+// Like PoolAllocator, this is not thread safe.
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+class ArchetypeStorage
+{
+public:
+	static_assert(maxEntities > 0 && maxEntities < (1u << 24), "maxEntities must leave at least 8 handle bits for the generation.");
+
+	// Alignment of every component array within a chunk
+	static const size_t kColumnAlignment = 64;
+
+	ArchetypeStorage();
+
+	// The destructor destroys every entity's components.
+	~ArchetypeStorage();
+
+	ArchetypeStorage(const ArchetypeStorage&) = delete;
+	ArchetypeStorage& operator=(const ArchetypeStorage&) = delete;
+
+	// Create an entity with the given components (possibly none), constructed straight into their archetype's chunk.
+	//
+	// If there's no room for another entity or chunk, it should trigger a DbgAssert and return a null handle.
+	template <typename... Components>
+	Entity Create(Components&&... components);
+
+	// Destroy entity and its components.
+	//
+	// It will DbgAssert the handle is valid; stale and null handles are otherwise ignored.
+	void Destroy(Entity entity);
+
+	bool IsValid(Entity entity) const { return GetRecord(entity) != nullptr; }
+
+	// Return entity's T, or nullptr if it doesn't have one or the handle is stale
+	template <typename T>
+	T* Get(Entity entity);
+
+	template <typename T>
+	bool Has(Entity entity) { return Get<T>(entity) != nullptr; }
+
+	// Give entity a T constructed from args, moving it to the archetype with T added, and return the new component.
+	//
+	// It will DbgAssert the entity doesn't already have a T; if it does, the existing component is returned unchanged.
+	// If the handle is stale or there's no room for another chunk, it should trigger a DbgAssert and return nullptr.
+	template <typename T, typename... Args>
+	T* Add(Entity entity, Args&&... args);
+
+	// Destroy entity's T, moving it to the archetype without T.
+	//
+	// It will DbgAssert the handle is valid and has a T.
+	template <typename T>
+	void Remove(Entity entity);
+
+	// Call func(unsigned int count, Components*... arrays) for every chunk of every archetype that has all of Components;
+	// arrays[i] are the components of the chunk's i'th entity
+	template <typename... Components, typename Func>
+	void ForEachChunk(Func&& func);
+
+	// Number of live entities
+	unsigned int GetCount() const { return mCount; }
+
+protected:
+	static constexpr unsigned int IndexBits(unsigned int count, unsigned int bits = 1) { return (1u << bits) >= count ? bits : IndexBits(count, bits + 1); }
+
+	static const unsigned int kIndexBits = IndexBits(maxEntities);
+	static const std::uint32_t kIndexMask = (1u << kIndexBits) - 1;
+	// Generations are kept pre-shifted into the handle's high bits
+	static const std::uint32_t kGenerationStep = 1u << kIndexBits;
+	// Marks a missing archetype edge, or the end of the free entity list
+	static const std::uint32_t kNone = 0xFFFFFFFFu;
+
+	// Where each entity lives
+	struct EntityRecord
+	{
+		// Generation in the handle's high bits; odd while the entity is live
+		std::uint32_t mGeneration;
+		std::uint32_t mArchetype;
+		// Row within the archetype while live; next free entity index while not
+		std::uint32_t mRow;
+	};
+
+	struct Archetype
+	{
+		// Bit i is set if the archetype has component type i
+		std::uint64_t mMask;
+		// Rows that fit in one chunk
+		std::uint32_t mChunkCapacity;
+		// Rows in use, packed from the first chunk on
+		std::uint32_t mCount;
+		std::vector<void*> mChunks;
+		// Byte offset within a chunk of the entity index array and of each component type's array (only for types in mMask)
+		std::uint32_t mEntityOffset;
+		std::uint32_t mColumnOffsets[interior::kMaxComponentTypes];
+		// Archetype with component type i added or removed, kNone until first looked up
+		std::uint32_t mAddEdges[interior::kMaxComponentTypes];
+		std::uint32_t mRemoveEdges[interior::kMaxComponentTypes];
+	};
+
+	typedef PoolAllocator<chunkBytes, maxChunks, kColumnAlignment> ChunkPool;
+
+	// Return entity's record, or nullptr if the handle is stale or null
+	EntityRecord* GetRecord(Entity entity);
+	const EntityRecord* GetRecord(Entity entity) const;
+
+	// Return the index of the archetype with exactly mask's components, creating it if needed
+	std::uint32_t FindArchetype(std::uint64_t mask);
+
+	// Return the archetype one component type away from archetype, through its edge cache
+	std::uint32_t GetAddTarget(std::uint32_t archetype, unsigned int componentId);
+	std::uint32_t GetRemoveTarget(std::uint32_t archetype, unsigned int componentId);
+
+	// Address of row's component of type componentId
+	void* GetComponent(const Archetype& archetype, std::uint32_t row, unsigned int componentId) const;
+	std::uint32_t& GetRowEntity(const Archetype& archetype, std::uint32_t row) const;
+
+	// Add an uninitialized row for entityIndex to the end of archetype, returning kNone if no chunk could be allocated
+	std::uint32_t AllocateRow(std::uint32_t archetype, std::uint32_t entityIndex);
+
+	// Remove row from archetype, whose components must already be destroyed or moved out, filling the hole with the last row
+	void RemoveRow(std::uint32_t archetype, std::uint32_t row);
+
+	// Move entityIndex's components to a new row in target, destroying the ones target doesn't have, and return the new row
+	// or kNone if no chunk could be allocated (leaving the entity where it was)
+	std::uint32_t MoveEntity(std::uint32_t entityIndex, std::uint32_t target);
+
+	ChunkPool mChunkPool;
+	// Index 0 is always the empty archetype
+	std::vector<Archetype> mArchetypes;
+
+	std::unique_ptr<EntityRecord[]> mEntities;
+	// Destroyed entity indices, linked through mRow
+	std::uint32_t mFreeEntities;
+	// Entity indices from here on have never been used
+	std::uint32_t mNextUnusedEntity;
+	unsigned int mCount;
+};
+
+// IMPLEMENTATIONS for ArchetypeStorage
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::ArchetypeStorage()
+	: mEntities(new EntityRecord[maxEntities])
+	, mFreeEntities(kNone)
+	, mNextUnusedEntity(0)
+	, mCount(0)
+{
+	FindArchetype(0);
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::~ArchetypeStorage()
+{
+	for (Archetype& archetype : mArchetypes)
+	{
+		for (std::uint32_t row = 0; row < archetype.mCount; ++row)
+		{
+			for (unsigned int id = 0; id < interior::kMaxComponentTypes; ++id)
+			{
+				if (archetype.mMask >> id & 1)
+					interior::ComponentInfoTable()[id].mDestroy(GetComponent(archetype, row, id));
+			}
+		}
+		for (void* chunk : archetype.mChunks)
+			mChunkPool.Free(chunk);
+	}
+	mCount = 0;
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+template <typename... Components>
+Entity ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::Create(Components&&... components)
+{
+	std::uint64_t mask = 0;
+	unsigned int ids[] = { interior::ComponentTypeId<typename std::decay<Components>::type>()..., 0 };
+	for (unsigned int i = 0; i < sizeof...(Components); ++i)
+	{
+		DbgAssert((mask >> ids[i] & 1) == 0, "An entity can't have two components of the same type.");
+		if (mask >> ids[i] & 1)
+			return Entity();
+		mask |= std::uint64_t(1) << ids[i];
+	}
+
+	std::uint32_t index = mFreeEntities;
+	if (index == kNone)
+	{
+		DbgAssert(mNextUnusedEntity < maxEntities, "No entities available.");
+		if (mNextUnusedEntity == maxEntities)
+			return Entity();
+		index = mNextUnusedEntity;
+		mEntities[index].mGeneration = 0;
+	}
+
+	std::uint32_t archetype = FindArchetype(mask);
+	std::uint32_t row = AllocateRow(archetype, index);
+	if (row == kNone)
+		return Entity();
+	// Only take the index once the row is certain
+	if (index == mFreeEntities)
+		mFreeEntities = mEntities[index].mRow;
+	else
+		++mNextUnusedEntity;
+
+	// Construct each component into its column
+	int expand[] = { (new (GetComponent(mArchetypes[archetype], row, interior::ComponentTypeId<typename std::decay<Components>::type>()))
+		typename std::decay<Components>::type(std::forward<Components>(components)), 0)..., 0 };
+	(void)expand;
+
+	EntityRecord& record = mEntities[index];
+	record.mGeneration += kGenerationStep;
+	record.mArchetype = archetype;
+	record.mRow = row;
+	++mCount;
+	return Entity(record.mGeneration | index);
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+void ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::Destroy(Entity entity)
+{
+	EntityRecord* record = GetRecord(entity);
+	DbgAssert(record != nullptr, "Destroying a stale or null entity.");
+	if (record == nullptr)
+		return;
+
+	Archetype& archetype = mArchetypes[record->mArchetype];
+	for (unsigned int id = 0; id < interior::kMaxComponentTypes; ++id)
+	{
+		if (archetype.mMask >> id & 1)
+			interior::ComponentInfoTable()[id].mDestroy(GetComponent(archetype, record->mRow, id));
+	}
+	RemoveRow(record->mArchetype, record->mRow);
+
+	// Back to even, staling every handle to this entity
+	record->mGeneration += kGenerationStep;
+	record->mRow = mFreeEntities;
+	mFreeEntities = entity.mValue & kIndexMask;
+	--mCount;
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+template <typename T>
+T* ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::Get(Entity entity)
+{
+	EntityRecord* record = GetRecord(entity);
+	unsigned int id = interior::ComponentTypeId<T>();
+	if (record == nullptr || (mArchetypes[record->mArchetype].mMask >> id & 1) == 0)
+		return nullptr;
+	return static_cast<T*>(GetComponent(mArchetypes[record->mArchetype], record->mRow, id));
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+template <typename T, typename... Args>
+T* ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::Add(Entity entity, Args&&... args)
+{
+	EntityRecord* record = GetRecord(entity);
+	DbgAssert(record != nullptr, "Adding a component to a stale or null entity.");
+	if (record == nullptr)
+		return nullptr;
+	unsigned int id = interior::ComponentTypeId<T>();
+	if (mArchetypes[record->mArchetype].mMask >> id & 1)
+	{
+		DbgAssert(false, "Entity already has this component.");
+		return static_cast<T*>(GetComponent(mArchetypes[record->mArchetype], record->mRow, id));
+	}
+
+	std::uint32_t target = GetAddTarget(record->mArchetype, id);
+	std::uint32_t row = MoveEntity(entity.mValue & kIndexMask, target);
+	if (row == kNone)
+		return nullptr;
+	return new (GetComponent(mArchetypes[target], row, id)) T(std::forward<Args>(args)...);
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+template <typename T>
+void ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::Remove(Entity entity)
+{
+	EntityRecord* record = GetRecord(entity);
+	unsigned int id = interior::ComponentTypeId<T>();
+	DbgAssert(record != nullptr && (mArchetypes[record->mArchetype].mMask >> id & 1) != 0, "Entity doesn't have this component.");
+	if (record == nullptr || (mArchetypes[record->mArchetype].mMask >> id & 1) == 0)
+		return;
+
+	// MoveEntity destroys the components the target archetype doesn't have, which is just this one
+	MoveEntity(entity.mValue & kIndexMask, GetRemoveTarget(record->mArchetype, id));
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+template <typename... Components, typename Func>
+void ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::ForEachChunk(Func&& func)
+{
+	std::uint64_t mask = 0;
+	unsigned int ids[] = { interior::ComponentTypeId<Components>()..., 0 };
+	for (unsigned int i = 0; i < sizeof...(Components); ++i)
+		mask |= std::uint64_t(1) << ids[i];
+
+	for (Archetype& archetype : mArchetypes)
+	{
+		if ((archetype.mMask & mask) != mask)
+			continue;
+		for (std::uint32_t chunk = 0; chunk < archetype.mChunks.size(); ++chunk)
+		{
+			std::uint32_t firstRow = chunk * archetype.mChunkCapacity;
+			unsigned int count = archetype.mCount - firstRow < archetype.mChunkCapacity ? archetype.mCount - firstRow : archetype.mChunkCapacity;
+			char* memory = static_cast<char*>(archetype.mChunks[chunk]);
+			func(count, reinterpret_cast<Components*>(memory + archetype.mColumnOffsets[interior::ComponentTypeId<Components>()])...);
+		}
+	}
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+typename ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::EntityRecord* ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::GetRecord(Entity entity)
+{
+	return const_cast<EntityRecord*>(static_cast<const ArchetypeStorage*>(this)->GetRecord(entity));
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+const typename ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::EntityRecord* ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::GetRecord(Entity entity) const
+{
+	std::uint32_t index = entity.mValue & kIndexMask;
+	// Dead entities have even generations, which never match a handle's
+	if (index >= mNextUnusedEntity || (entity.mValue & ~kIndexMask) != mEntities[index].mGeneration)
+		return nullptr;
+	return &mEntities[index];
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+std::uint32_t ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::FindArchetype(std::uint64_t mask)
+{
+	// Only reached when an edge hasn't been cached yet, and programs have few archetypes, so a linear search is fine
+	for (std::uint32_t i = 0; i < mArchetypes.size(); ++i)
+	{
+		if (mArchetypes[i].mMask == mask)
+			return i;
+	}
+
+	Archetype archetype;
+	archetype.mMask = mask;
+	archetype.mCount = 0;
+	for (unsigned int id = 0; id < interior::kMaxComponentTypes; ++id)
+	{
+		archetype.mColumnOffsets[id] = 0;
+		archetype.mAddEdges[id] = kNone;
+		archetype.mRemoveEdges[id] = kNone;
+	}
+
+	// Each array starts on a cache line, so a chunk loses at most kColumnAlignment - 1 bytes per array to padding
+	size_t rowBytes = sizeof(std::uint32_t);
+	size_t paddingBytes = 0;
+	for (unsigned int id = 0; id < interior::kMaxComponentTypes; ++id)
+	{
+		if (mask >> id & 1)
+		{
+			DbgAssert(interior::ComponentInfoTable()[id].mAlignment <= kColumnAlignment, "Component alignment is too large.");
+			rowBytes += interior::ComponentInfoTable()[id].mSize;
+			paddingBytes += kColumnAlignment - 1;
+		}
+	}
+	DbgAssert(chunkBytes > paddingBytes + rowBytes, "Chunks are too small to hold one entity of this archetype.");
+	archetype.mChunkCapacity = static_cast<std::uint32_t>((chunkBytes - paddingBytes) / rowBytes);
+
+	size_t offset = 0;
+	archetype.mEntityOffset = 0;
+	offset += sizeof(std::uint32_t) * archetype.mChunkCapacity;
+	for (unsigned int id = 0; id < interior::kMaxComponentTypes; ++id)
+	{
+		if (mask >> id & 1)
+		{
+			offset = (offset + kColumnAlignment - 1) / kColumnAlignment * kColumnAlignment;
+			archetype.mColumnOffsets[id] = static_cast<std::uint32_t>(offset);
+			offset += interior::ComponentInfoTable()[id].mSize * archetype.mChunkCapacity;
+		}
+	}
+
+	mArchetypes.push_back(archetype);
+	return static_cast<std::uint32_t>(mArchetypes.size() - 1);
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+std::uint32_t ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::GetAddTarget(std::uint32_t archetype, unsigned int componentId)
+{
+	if (mArchetypes[archetype].mAddEdges[componentId] == kNone)
+	{
+		// FindArchetype may grow mArchetypes, so index again afterwards
+		std::uint32_t target = FindArchetype(mArchetypes[archetype].mMask | std::uint64_t(1) << componentId);
+		mArchetypes[archetype].mAddEdges[componentId] = target;
+		mArchetypes[target].mRemoveEdges[componentId] = archetype;
+	}
+	return mArchetypes[archetype].mAddEdges[componentId];
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+std::uint32_t ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::GetRemoveTarget(std::uint32_t archetype, unsigned int componentId)
+{
+	if (mArchetypes[archetype].mRemoveEdges[componentId] == kNone)
+	{
+		std::uint32_t target = FindArchetype(mArchetypes[archetype].mMask & ~(std::uint64_t(1) << componentId));
+		mArchetypes[archetype].mRemoveEdges[componentId] = target;
+		mArchetypes[target].mAddEdges[componentId] = archetype;
+	}
+	return mArchetypes[archetype].mRemoveEdges[componentId];
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+void* ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::GetComponent(const Archetype& archetype, std::uint32_t row, unsigned int componentId) const
+{
+	char* chunk = static_cast<char*>(archetype.mChunks[row / archetype.mChunkCapacity]);
+	return chunk + archetype.mColumnOffsets[componentId] + (row % archetype.mChunkCapacity) * interior::ComponentInfoTable()[componentId].mSize;
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+std::uint32_t& ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::GetRowEntity(const Archetype& archetype, std::uint32_t row) const
+{
+	char* chunk = static_cast<char*>(archetype.mChunks[row / archetype.mChunkCapacity]);
+	return reinterpret_cast<std::uint32_t*>(chunk + archetype.mEntityOffset)[row % archetype.mChunkCapacity];
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+std::uint32_t ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::AllocateRow(std::uint32_t archetype, std::uint32_t entityIndex)
+{
+	Archetype& target = mArchetypes[archetype];
+	if (target.mCount == target.mChunks.size() * target.mChunkCapacity)
+	{
+		void* chunk = mChunkPool.Allocate(chunkBytes);
+		if (chunk == nullptr)
+			return kNone;
+		target.mChunks.push_back(chunk);
+	}
+	std::uint32_t row = target.mCount++;
+	GetRowEntity(target, row) = entityIndex;
+	return row;
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+void ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::RemoveRow(std::uint32_t archetype, std::uint32_t row)
+{
+	Archetype& source = mArchetypes[archetype];
+	std::uint32_t lastRow = --source.mCount;
+	if (row != lastRow)
+	{
+		for (unsigned int id = 0; id < interior::kMaxComponentTypes; ++id)
+		{
+			if (source.mMask >> id & 1)
+				interior::ComponentInfoTable()[id].mMove(GetComponent(source, row, id), GetComponent(source, lastRow, id));
+		}
+		std::uint32_t movedEntity = GetRowEntity(source, lastRow);
+		GetRowEntity(source, row) = movedEntity;
+		mEntities[movedEntity].mRow = row;
+	}
+
+	// Give the last chunk back as soon as it's empty
+	if (lastRow % source.mChunkCapacity == 0)
+	{
+		mChunkPool.Free(source.mChunks.back());
+		source.mChunks.pop_back();
+	}
+}
+
+template <size_t chunkBytes, unsigned int maxChunks, unsigned int maxEntities>
+std::uint32_t ArchetypeStorage<chunkBytes, maxChunks, maxEntities>::MoveEntity(std::uint32_t entityIndex, std::uint32_t target)
+{
+	EntityRecord& record = mEntities[entityIndex];
+	std::uint32_t row = AllocateRow(target, entityIndex);
+	if (row == kNone)
+		return kNone;
+
+	Archetype& source = mArchetypes[record.mArchetype];
+	Archetype& destination = mArchetypes[target];
+	for (unsigned int id = 0; id < interior::kMaxComponentTypes; ++id)
+	{
+		if ((source.mMask >> id & 1) == 0)
+			continue;
+		void* component = GetComponent(source, record.mRow, id);
+		if (destination.mMask >> id & 1)
+			interior::ComponentInfoTable()[id].mMove(GetComponent(destination, row, id), component);
+		else
+			interior::ComponentInfoTable()[id].mDestroy(component);
+	}
+	RemoveRow(record.mArchetype, record.mRow);
+
+	record.mArchetype = target;
+	record.mRow = row;
+	return row;
+}
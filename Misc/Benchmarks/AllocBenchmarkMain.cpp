@@ -0,0 +1,134 @@
+// Runs the AllocBenchmark.h workloads over malloc and each pool allocator, and checks the results against a baseline
+//
+// Build with optimizations and without POOL_ALLOC_DEBUG, POOL_ALLOC_CHECKED, or POOL_ALLOC_TELEMETRY (../Standalone stands in for the engine's DbgAssert.h):
+//  g++ -std=c++17 -O2 -I.. -I../Standalone AllocBenchmarkMain.cpp -o AllocBenchmark -pthread
+// and run from this directory:
+//  AllocBenchmark [baseline] [--save]
+// The baseline defaults to AllocBaseline.txt. The checked in one was recorded on a single machine, so run once with
+// --save on yours before using it to catch regressions; --save overwrites it with this run's results.
+#include "AllocBenchmark.h"
+#include "ConcurrentPoolAlloc.h"
+#include "PoolAlloc.h"
+#include "SmallObjectAlloc.h"
+#include "ThreadCachedPoolAlloc.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+// Fixed-size pools hold 64 byte blocks, with room for the largest workload's live blocks
+static const std::uint32_t kBlockBytes = 64;
+static const unsigned int kPoolBlocks = 1 << 16;
+
+// Each result is the best of this many runs, since a single run on a busy machine easily varies by more than the thresholds
+static const int kRepeats = 3;
+
+typedef PoolAllocator<kBlockBytes, kPoolBlocks> BenchPool;
+typedef ConcurrentPoolAllocator<kBlockBytes, kPoolBlocks> BenchConcurrentPool;
+typedef ThreadCachedPoolAllocator<kBlockBytes, kPoolBlocks> BenchThreadCachedPool;
+
+// The single threaded workloads, at one size range
+static std::vector<BenchWorkload> MakeWorkloads(std::uint32_t minSize, std::uint32_t maxSize)
+{
+	std::vector<BenchWorkload> workloads;
+	workloads.push_back(MakeFreeOrderWorkload("lifo", minSize, maxSize, 1 << 15, 20, BenchFreeOrder::Lifo));
+	workloads.push_back(MakeFreeOrderWorkload("fifo", minSize, maxSize, 1 << 15, 20, BenchFreeOrder::Fifo));
+	workloads.push_back(MakeFreeOrderWorkload("random", minSize, maxSize, 1 << 15, 20, BenchFreeOrder::Random));
+	workloads.push_back(MakeChurnWorkload("churn", minSize, maxSize, 1 << 14, 1 << 20, 1));
+	workloads.push_back(MakeBurstWorkload("burst", minSize, maxSize, 1 << 13, 1 << 12, 200, 1));
+	return workloads;
+}
+
+// Run benchmark kRepeats times on a fresh Allocator each time (so RSS growth and fragmentation mean something),
+// keeping the fastest run with the lowest p99 seen in any run, and add it to results as name
+// MakeAdapter builds an adapter for the allocator in place, since the adapters hold references
+template <typename Allocator, typename MakeAdapter, typename Benchmark>
+static void RunBest(const std::string& name, MakeAdapter makeAdapter, Benchmark benchmark, std::vector<BenchResult>& results)
+{
+	BenchResult best = BenchResult();
+	for (int i = 0; i < kRepeats; ++i)
+	{
+		std::unique_ptr<Allocator> allocator(new Allocator());
+		auto adapter = makeAdapter(*allocator);
+		BenchResult result = benchmark(adapter);
+		double p99Ns = i == 0 ? result.mP99Ns : std::min(result.mP99Ns, best.mP99Ns);
+		if (i == 0 || result.mOpsPerSecond > best.mOpsPerSecond)
+			best = result;
+		best.mP99Ns = p99Ns;
+	}
+	best.mName = name;
+	results.push_back(best);
+	printf("%s\n", best.ToJson().c_str());
+}
+
+// Run each workload, naming the results prefix_workload
+template <typename Allocator, typename MakeAdapter>
+static void RunWorkloads(const char* prefix, const std::vector<BenchWorkload>& workloads, MakeAdapter makeAdapter, std::vector<BenchResult>& results)
+{
+	for (const BenchWorkload& workload : workloads)
+	{
+		RunBest<Allocator>(std::string(prefix) + "_" + workload.mName, makeAdapter,
+			[&workload](auto& adapter) { return RunBenchWorkload(adapter, workload); }, results);
+	}
+}
+
+// Same for the producer/consumer benchmark, which needs an allocator that takes frees from another thread
+template <typename Allocator, typename MakeAdapter>
+static void RunProducerConsumer(const char* prefix, MakeAdapter makeAdapter, std::vector<BenchResult>& results)
+{
+	std::string name = std::string(prefix) + "_producer_consumer";
+	RunBest<Allocator>(name, makeAdapter,
+		[&name](auto& adapter) { return RunProducerConsumerBench(adapter, name.c_str(), kBlockBytes, 1 << 20, 1024); }, results);
+}
+
+int main(int argc, char** argv)
+{
+	const char* baselinePath = "AllocBaseline.txt";
+	bool save = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--save") == 0)
+			save = true;
+		else
+			baselinePath = argv[i];
+	}
+
+	std::vector<BenchWorkload> fixedWorkloads = MakeWorkloads(kBlockBytes, kBlockBytes);
+	// Mixed sizes for the general purpose allocators, mostly small like a typical game object heap
+	std::vector<BenchWorkload> mixedWorkloads = MakeWorkloads(16, 512);
+	for (BenchWorkload& workload : mixedWorkloads)
+		workload.mName = "mixed_" + workload.mName;
+
+	std::vector<BenchResult> results;
+	auto makeMalloc = [](MallocBenchAllocator& allocator) { return allocator; };
+	RunWorkloads<MallocBenchAllocator>("malloc", fixedWorkloads, makeMalloc, results);
+	RunWorkloads<MallocBenchAllocator>("malloc", mixedWorkloads, makeMalloc, results);
+	RunProducerConsumer<MallocBenchAllocator>("malloc", makeMalloc, results);
+
+	auto makePool = [](BenchPool& pool) { return PoolBenchAllocator<BenchPool>(pool); };
+	RunWorkloads<BenchPool>("pool", fixedWorkloads, makePool, results);
+	RunProducerConsumer<BenchPool>("pool", makePool, results);
+
+	auto makeConcurrent = [](BenchConcurrentPool& pool) { return SharedPoolBenchAllocator<BenchConcurrentPool>(pool); };
+	RunWorkloads<BenchConcurrentPool>("concurrent", fixedWorkloads, makeConcurrent, results);
+	RunProducerConsumer<BenchConcurrentPool>("concurrent", makeConcurrent, results);
+
+	auto makeThreadCached = [](BenchThreadCachedPool& pool) { return SharedPoolBenchAllocator<BenchThreadCachedPool>(pool); };
+	RunWorkloads<BenchThreadCachedPool>("thread_cached", fixedWorkloads, makeThreadCached, results);
+	RunProducerConsumer<BenchThreadCachedPool>("thread_cached", makeThreadCached, results);
+
+	auto makeSmallObject = [](SmallObjectAllocator& allocator) { return SizedBenchAllocator<SmallObjectAllocator>(allocator); };
+	RunWorkloads<SmallObjectAllocator>("small_object", fixedWorkloads, makeSmallObject, results);
+	RunWorkloads<SmallObjectAllocator>("small_object", mixedWorkloads, makeSmallObject, results);
+
+	if (save)
+	{
+		if (!SaveBenchBaseline(results, baselinePath))
+		{
+			fprintf(stderr, "Could not write %s\n", baselinePath);
+			return 1;
+		}
+		printf("Saved %s\n", baselinePath);
+		return 0;
+	}
+	return CheckBenchRegressions(results, baselinePath, BenchThresholds(), stdout) ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+// Integrates 100k rigid body orientations with IntegrateAngularVelocityBatch (see QuaternionBatch.h)
+// and compares it against integrating array-of-structures Quaternion<float>s one at a time with std::sin/std::cos
+// Build and run from this directory:
+//  g++ -std=c++17 -O2 -msse4.1 -I.. QuaternionIntegrationBenchmark.cpp -o QuaternionIntegrationBenchmark && ./QuaternionIntegrationBenchmark
+// Reports ns per body per step for each method and how far the batched results drift from the scalar exponential map
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "QuaternionBatch.h"
+
+namespace
+{
+	const std::size_t kBodies = 100000;
+	const int kSteps = 240;
+	const float kDt = 1.0f / 60.0f;
+
+	struct Bodies
+	{
+		std::vector<float> x, y, z, w;
+		std::vector<float> velX, velY, velZ;
+
+		QuaternionSoA Orientations() { return QuaternionSoA{ x.data(), y.data(), z.data(), w.data() }; }
+		Vector3SoA AngularVelocities() const { return Vector3SoA{ velX.data(), velY.data(), velZ.data() }; }
+	};
+
+	// Random unit orientations spinning at up to 4 revolutions per second about random axes
+	Bodies MakeBodies()
+	{
+		std::mt19937 rng(42);
+		std::normal_distribution<float> normal;
+		std::uniform_real_distribution<float> speed(0.0f, 8.0f * 3.14159265f);
+		Bodies bodies;
+		for (std::size_t i = 0; i < kBodies; ++i)
+		{
+			Quaternion<float> quat(normal(rng), normal(rng), normal(rng), normal(rng));
+			quat.Normalize();
+			bodies.x.push_back(quat.x);
+			bodies.y.push_back(quat.y);
+			bodies.z.push_back(quat.z);
+			bodies.w.push_back(quat.w);
+			Vector<float, 3> axis(normal(rng), normal(rng), normal(rng));
+			axis.Normalize();
+			float radiansPerSecond = speed(rng);
+			bodies.velX.push_back(axis[0] * radiansPerSecond);
+			bodies.velY.push_back(axis[1] * radiansPerSecond);
+			bodies.velZ.push_back(axis[2] * radiansPerSecond);
+		}
+		return bodies;
+	}
+
+	// The straightforward scalar version: build the step's rotation with sin/cos and concatenate it per body
+	void IntegrateScalar(std::vector<Quaternion<float>>& orientations, const std::vector<Vector<float, 3>>& angularVelocities, float dt)
+	{
+		for (std::size_t i = 0; i < orientations.size(); ++i)
+		{
+			const Vector<float, 3>& vel = angularVelocities[i];
+			float speed = std::sqrt(vel[0] * vel[0] + vel[1] * vel[1] + vel[2] * vel[2]);
+			float halfAngle = 0.5f * speed * dt;
+			float scale = speed > 0.0f ? std::sin(halfAngle) / speed : 0.0f;
+			Quaternion<float> delta(vel[0] * scale, vel[1] * scale, vel[2] * scale, std::cos(halfAngle));
+			orientations[i] = delta * orientations[i];
+			orientations[i].Normalize();
+		}
+	}
+
+	template<typename F>
+	double NsPerBodyStep(F step)
+	{
+		// Best of 3 runs, to keep other processes' noise out of the comparison
+		double best = 1e300;
+		for (int run = 0; run < 3; ++run)
+		{
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < kSteps; ++i)
+			{
+				step();
+			}
+			double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+			best = std::min(best, ns / (static_cast<double>(kBodies) * kSteps));
+		}
+		return best;
+	}
+
+	// Largest angle in radians between corresponding orientations, treating q and -q as equal
+	float MaxAngleBetween(const Bodies& bodies, const std::vector<Quaternion<float>>& reference)
+	{
+		float maxAngle = 0.0f;
+		for (std::size_t i = 0; i < kBodies; ++i)
+		{
+			float dot = std::fabs(bodies.x[i] * reference[i].x + bodies.y[i] * reference[i].y + bodies.z[i] * reference[i].z + bodies.w[i] * reference[i].w);
+			maxAngle = std::max(maxAngle, 2.0f * std::acos(std::min(dot, 1.0f)));
+		}
+		return maxAngle;
+	}
+}
+
+int main()
+{
+	const Bodies initial = MakeBodies();
+
+	std::vector<Quaternion<float>> scalarOrientations;
+	std::vector<Vector<float, 3>> scalarVelocities;
+	for (std::size_t i = 0; i < kBodies; ++i)
+	{
+		scalarOrientations.push_back(Quaternion<float>(initial.x[i], initial.y[i], initial.z[i], initial.w[i]));
+		scalarVelocities.push_back(Vector<float, 3>(initial.velX[i], initial.velY[i], initial.velZ[i]));
+	}
+
+	double scalarNs = NsPerBodyStep([&] { IntegrateScalar(scalarOrientations, scalarVelocities, kDt); });
+
+	Bodies firstOrder = initial;
+	double firstOrderNs = NsPerBodyStep([&] {
+		IntegrateAngularVelocityBatch(firstOrder.Orientations(), firstOrder.AngularVelocities(), kDt, kBodies, AngularIntegration::FirstOrder); });
+
+	Bodies exponentialMap = initial;
+	double exponentialMapNs = NsPerBodyStep([&] {
+		IntegrateAngularVelocityBatch(exponentialMap.Orientations(), exponentialMap.AngularVelocities(), kDt, kBodies, AngularIntegration::ExponentialMap); });
+
+	printf("%zu bodies, %d steps of %.4f s (best of 3)\n", kBodies, kSteps, kDt);
+	printf("  scalar AoS sin/cos:       %6.2f ns/body/step\n", scalarNs);
+	printf("  batch FirstOrder:         %6.2f ns/body/step (%.1fx)\n", firstOrderNs, scalarNs / firstOrderNs);
+	printf("  batch ExponentialMap:     %6.2f ns/body/step (%.1fx)\n", exponentialMapNs, scalarNs / exponentialMapNs);
+
+	// Every method ran the same number of steps from the same start, so the results are directly comparable
+	printf("  max drift from scalar after %d steps: FirstOrder %.3g rad, ExponentialMap %.3g rad\n",
+		3 * kSteps, MaxAngleBetween(firstOrder, scalarOrientations), MaxAngleBetween(exponentialMap, scalarOrientations));
+	return 0;
+}
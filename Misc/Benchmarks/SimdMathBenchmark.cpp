@@ -0,0 +1,191 @@
+// Times SimdMatrix4::Mul and Transform (see SimdMath.h) against the transpose + _mm_dp_ps code they replaced,
+// and the array Transform overload against transforming the same vectors one at a time
+// SimdMath.h includes the engine's legacy Math.h, which ../Standalone stands in for
+// Build and run from this directory:
+//  g++ -std=c++17 -O2 -msse4.1 -I.. -I../Standalone SimdMathBenchmark.cpp -o SimdMathBenchmark && ./SimdMathBenchmark
+// Add -mfma to measure the fused multiply-add kernels. Reports ns per call and how far the results are from the old code's.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "SimdMath.h"
+
+namespace
+{
+	const std::size_t kCount = 4096;
+	const int kRepeats = 2000;
+
+	// The previous SimdMatrix4::Mul: transpose other, then dot each row of lhs with each of its columns
+	void OldMul(__m128* lhs, const __m128* other)
+	{
+		__m128 columns[4] = { other[0], other[1], other[2], other[3] };
+		_MM_TRANSPOSE4_PS(columns[0], columns[1], columns[2], columns[3]);
+		for (int i = 0; i < 4; ++i)
+		{
+			__m128 x = _mm_dp_ps(lhs[i], columns[0], 0xF1);
+			__m128 y = _mm_dp_ps(lhs[i], columns[1], 0xF2);
+			__m128 z = _mm_dp_ps(lhs[i], columns[2], 0xF4);
+			__m128 w = _mm_dp_ps(lhs[i], columns[3], 0xF8);
+			lhs[i] = _mm_add_ps(_mm_add_ps(_mm_add_ps(x, y), z), w);
+		}
+	}
+
+	// The previous Transform: set w, transpose mat, then dot the vector with each of its columns
+	__m128 OldTransform(__m128 vec, const __m128* mat, float w)
+	{
+		__m128 temp = _mm_insert_ps(vec, _mm_set_ps1(w), 0xF0);
+		__m128 columns[4] = { mat[0], mat[1], mat[2], mat[3] };
+		_MM_TRANSPOSE4_PS(columns[0], columns[1], columns[2], columns[3]);
+		__m128 x = _mm_dp_ps(temp, columns[0], 0xF1);
+		__m128 y = _mm_dp_ps(temp, columns[1], 0xF2);
+		__m128 z = _mm_dp_ps(temp, columns[2], 0xF4);
+		__m128 w4 = _mm_dp_ps(temp, columns[3], 0xF8);
+		return _mm_add_ps(_mm_add_ps(_mm_add_ps(x, y), z), w4);
+	}
+
+	// Wrappers to keep __m128's alignment attribute when storing the old code's registers in std::vectors
+	struct RawMatrix
+	{
+		__m128 rows[4];
+	};
+	struct RawVector
+	{
+		__m128 vec;
+	};
+
+	struct Inputs
+	{
+		// The same matrices and vectors as raw registers for the old code and as SimdMath types for the new
+		std::vector<RawMatrix> rawMatrices;
+		std::vector<SimdMatrix4> matrices;
+		std::vector<RawVector> rawVectors;
+		std::vector<SimdVector3> vectors;
+	};
+
+	// Random matrices with elements in [-0.5, 0.5], so chains of products stay finite, and vectors in [-1, 1]
+	Inputs MakeInputs()
+	{
+		std::mt19937 rng(42);
+		std::uniform_real_distribution<float> element(-0.5f, 0.5f);
+		std::uniform_real_distribution<float> component(-1.0f, 1.0f);
+		Inputs inputs;
+		for (std::size_t i = 0; i < kCount; ++i)
+		{
+			RawMatrix mat;
+			for (__m128& row : mat.rows)
+			{
+				row = _mm_setr_ps(element(rng), element(rng), element(rng), element(rng));
+			}
+			inputs.rawMatrices.push_back(mat);
+			inputs.matrices.push_back(SimdMatrix4(mat.rows));
+			RawVector vec = { _mm_setr_ps(component(rng), component(rng), component(rng), 0.0f) };
+			inputs.rawVectors.push_back(vec);
+			inputs.vectors.push_back(SimdVector3(vec.vec));
+		}
+		return inputs;
+	}
+
+	// Best of 5 runs of run, divided by the calls it makes, to keep other processes' noise out of the comparison
+	template<typename F>
+	double NsPerCall(double calls, F run)
+	{
+		double best = 1e300;
+		for (int i = 0; i < 5; ++i)
+		{
+			auto start = std::chrono::steady_clock::now();
+			run();
+			best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+		}
+		return best / calls;
+	}
+
+	float MaxComponentDiff(const Vector<float, 3>& a, __m128 b)
+	{
+		float bData[4];
+		_mm_storeu_ps(bData, b);
+		return std::max({ std::fabs(a[0] - bData[0]), std::fabs(a[1] - bData[1]), std::fabs(a[2] - bData[2]) });
+	}
+}
+
+int main()
+{
+	Inputs inputs = MakeInputs();
+	std::vector<SimdVector3> out(kCount);
+	std::vector<RawVector> oldOut(kCount);
+	// Read results so the compiler can't drop the loops
+	volatile float sink = 0.0f;
+
+	// Each product depends on the last, so this measures latency rather than throughput
+	double oldMulNs = NsPerCall(static_cast<double>(kRepeats / 8) * kCount, [&] {
+		RawMatrix product = inputs.rawMatrices[0];
+		for (int r = 0; r < kRepeats / 8; ++r)
+		{
+			for (std::size_t i = 0; i < kCount; ++i)
+			{
+				OldMul(product.rows, inputs.rawMatrices[i].rows);
+			}
+		}
+		sink = sink + _mm_cvtss_f32(product.rows[0]);
+	});
+	double mulNs = NsPerCall(static_cast<double>(kRepeats / 8) * kCount, [&] {
+		SimdMatrix4 product = inputs.matrices[0];
+		for (int r = 0; r < kRepeats / 8; ++r)
+		{
+			for (std::size_t i = 0; i < kCount; ++i)
+			{
+				product.Mul(inputs.matrices[i]);
+			}
+		}
+		sink = sink + Transform(inputs.vectors[0], product, 1.0f).ToVector()[0];
+	});
+
+	double transformCalls = static_cast<double>(kRepeats) * kCount;
+	double oldTransformNs = NsPerCall(transformCalls, [&] {
+		for (int r = 0; r < kRepeats; ++r)
+		{
+			const __m128* mat = inputs.rawMatrices[r % kCount].rows;
+			for (std::size_t i = 0; i < kCount; ++i)
+			{
+				oldOut[i].vec = OldTransform(inputs.rawVectors[i].vec, mat, 1.0f);
+			}
+			sink = sink + _mm_cvtss_f32(oldOut[r % kCount].vec);
+		}
+	});
+	double transformNs = NsPerCall(transformCalls, [&] {
+		for (int r = 0; r < kRepeats; ++r)
+		{
+			const SimdMatrix4& mat = inputs.matrices[r % kCount];
+			for (std::size_t i = 0; i < kCount; ++i)
+			{
+				out[i] = Transform(inputs.vectors[i], mat, 1.0f);
+			}
+			sink = sink + out[r % kCount].ToVector()[0];
+		}
+	});
+	double batchNs = NsPerCall(transformCalls, [&] {
+		for (int r = 0; r < kRepeats; ++r)
+		{
+			Transform(inputs.vectors.data(), out.data(), kCount, inputs.matrices[r % kCount], 1.0f);
+			sink = sink + out[r % kCount].ToVector()[0];
+		}
+	});
+
+	// Compare one matrix's single and batch transforms against the old code
+	float maxDiff = 0.0f;
+	Transform(inputs.vectors.data(), out.data(), kCount, inputs.matrices[7], 1.0f);
+	for (std::size_t i = 0; i < kCount; ++i)
+	{
+		__m128 expected = OldTransform(inputs.rawVectors[i].vec, inputs.rawMatrices[7].rows, 1.0f);
+		maxDiff = std::max(maxDiff, MaxComponentDiff(Transform(inputs.vectors[i], inputs.matrices[7], 1.0f).ToVector(), expected));
+		maxDiff = std::max(maxDiff, MaxComponentDiff(out[i].ToVector(), expected));
+	}
+
+	printf("%zu matrices and vectors (best of 5)\n", kCount);
+	printf("  Mul (dependent chain):  old %6.2f ns  new %6.2f ns (%.1fx)\n", oldMulNs, mulNs, oldMulNs / mulNs);
+	printf("  Transform:              old %6.2f ns  new %6.2f ns (%.1fx)\n", oldTransformNs, transformNs, oldTransformNs / transformNs);
+	printf("  Transform array:                       %6.2f ns (%.1fx)\n", batchNs, oldTransformNs / batchNs);
+	printf("  max transform diff from old: %.3g\n", maxDiff);
+	return 0;
+}
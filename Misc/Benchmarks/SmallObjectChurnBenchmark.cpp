@@ -0,0 +1,60 @@
+// Compares SmallObjectAllocator with the system malloc on object churn
+//
+// The workloads are from AllocBenchmark.h, with sizes drawn uniformly from 16 to 256 bytes unless noted:
+//  -batch: allocate 1024 objects, then free all 1024 in allocation order, repeated
+//  -batch_random: the same, but freeing in a shuffled order, so most frees miss the cache on both allocators
+//  -churn: keep 1 << 14 objects live, freeing a random one and allocating a replacement each step
+//  -churn_large: the same with sizes up to 4096, spread over the geometric size classes
+// Each is run a few times on a fresh allocator and the fastest run kept. Times are per allocate/free pair.
+//
+// Build with optimizations and without POOL_ALLOC_DEBUG (../Standalone stands in for the engine's DbgAssert.h):
+//  g++ -std=c++17 -O2 -I.. -I../Standalone SmallObjectChurnBenchmark.cpp -o SmallObjectChurnBenchmark
+#include "AllocBenchmark.h"
+#include "SmallObjectAlloc.h"
+#include <memory>
+
+static const int kRepeats = 5;
+
+// Fastest of kRepeats runs of workload, each on a fresh Allocator
+template <typename Allocator, typename Adapter>
+static BenchResult RunFastest(const BenchWorkload& workload)
+{
+	BenchResult best = BenchResult();
+	for (int i = 0; i < kRepeats; ++i)
+	{
+		std::unique_ptr<Allocator> allocator(new Allocator());
+		Adapter adapter(*allocator);
+		BenchResult result = RunBenchWorkload(adapter, workload);
+		if (i == 0 || result.mOpsPerSecond > best.mOpsPerSecond)
+			best = result;
+	}
+	return best;
+}
+
+// Malloc needs no state, but RunFastest wants something to adapt
+struct MallocState {};
+struct MallocStateBenchAllocator : MallocBenchAllocator
+{
+	explicit MallocStateBenchAllocator(MallocState&) {}
+};
+
+int main()
+{
+	std::vector<BenchWorkload> workloads;
+	workloads.push_back(MakeFreeOrderWorkload("batch", 16, 256, 1024, 500, BenchFreeOrder::Fifo));
+	workloads.push_back(MakeFreeOrderWorkload("batch_random", 16, 256, 1024, 500, BenchFreeOrder::Random));
+	workloads.push_back(MakeChurnWorkload("churn", 16, 256, 1 << 14, 1 << 19, 1));
+	workloads.push_back(MakeChurnWorkload("churn_large", 16, 4096, 1 << 14, 1 << 19, 1));
+
+	printf("%-14s %16s %16s %8s\n", "workload", "malloc ns/pair", "small ns/pair", "speedup");
+	for (const BenchWorkload& workload : workloads)
+	{
+		BenchResult mallocResult = RunFastest<MallocState, MallocStateBenchAllocator>(workload);
+		BenchResult smallResult = RunFastest<SmallObjectAllocator, SizedBenchAllocator<SmallObjectAllocator>>(workload);
+		// Every allocation in these workloads is freed, so a pair is two operations
+		double mallocNs = 2e9 / mallocResult.mOpsPerSecond;
+		double smallNs = 2e9 / smallResult.mOpsPerSecond;
+		printf("%-14s %16.1f %16.1f %7.2fx\n", workload.mName.c_str(), mallocNs, smallNs, mallocNs / smallNs);
+	}
+	return 0;
+}
@@ -0,0 +1,84 @@
+// Measures how the thread safe pools scale from 1 to 64 threads sharing one pool
+//
+// Every thread replays the same churn and free order workloads (see AllocBenchmark.h) on its own blocks at once,
+// against a PoolAllocator behind a std::mutex (the simplest way to share a pool), a ConcurrentPoolAllocator,
+// and a ThreadCachedPoolAllocator (a PoolAllocator behind per-thread magazines, which only lock to trade whole magazines).
+// Thread counts above the machine's core count measure contention under preemption rather than parallel speedup.
+//
+// Build with optimizations and without POOL_ALLOC_DEBUG (../Standalone stands in for the engine's DbgAssert.h):
+//  g++ -std=c++17 -O2 -I.. -I../Standalone ThreadScalingBenchmark.cpp -o ThreadScalingBenchmark -pthread
+#include "AllocBenchmark.h"
+#include "ConcurrentPoolAlloc.h"
+#include "PoolAlloc.h"
+#include "ThreadCachedPoolAlloc.h"
+#include <memory>
+#include <mutex>
+
+static const std::uint32_t kBlockBytes = 64;
+static const unsigned int kMaxThreads = 64;
+// Live blocks per thread
+static const std::uint32_t kLiveBlocks = 1024;
+static const unsigned int kMagazineBlocks = 32;
+// Room for every thread's live blocks plus the two magazines each thread may have cached
+static const unsigned int kPoolBlocks = kMaxThreads * (kLiveBlocks + 2 * kMagazineBlocks);
+
+typedef PoolAllocator<kBlockBytes, kPoolBlocks> BenchPool;
+typedef ConcurrentPoolAllocator<kBlockBytes, kPoolBlocks> BenchConcurrentPool;
+typedef ThreadCachedPoolAllocator<kBlockBytes, kPoolBlocks, kMagazineBlocks> BenchThreadCachedPool;
+
+// PoolAllocator made thread safe with one lock around every call
+class MutexPool
+{
+public:
+	void* Allocate(size_t size)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mPool.Allocate(size);
+	}
+	void Free(void* ptr)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPool.Free(ptr);
+	}
+
+private:
+	std::mutex mMutex;
+	BenchPool mPool;
+};
+
+// Run workload on numThreads threads over a fresh Pool
+template <typename Pool>
+static BenchResult RunScaling(const BenchWorkload& workload, unsigned int numThreads)
+{
+	std::unique_ptr<Pool> pool(new Pool());
+	SharedPoolBenchAllocator<Pool> adapter(*pool);
+	return RunThreadedBenchWorkload(adapter, workload, numThreads);
+}
+
+int main()
+{
+	std::vector<BenchWorkload> workloads;
+	// Total work grows with the thread count, so per thread it stays the same
+	workloads.push_back(MakeChurnWorkload("churn", kBlockBytes, kBlockBytes, kLiveBlocks, 1 << 16, 1));
+	workloads.push_back(MakeFreeOrderWorkload("random", kBlockBytes, kBlockBytes, kLiveBlocks, 64, BenchFreeOrder::Random));
+
+	for (const BenchWorkload& workload : workloads)
+	{
+		printf("%s: total Mops/s (p99 ns)\n", workload.mName.c_str());
+		printf("%8s %20s %20s %20s\n", "threads", "mutex", "concurrent", "thread cached");
+		for (unsigned int numThreads = 1; numThreads <= kMaxThreads; numThreads *= 2)
+		{
+			BenchResult mutexResult = RunScaling<MutexPool>(workload, numThreads);
+			BenchResult concurrentResult = RunScaling<BenchConcurrentPool>(workload, numThreads);
+			BenchResult threadCachedResult = RunScaling<BenchThreadCachedPool>(workload, numThreads);
+			printf("%8u %12.1f (%5.0f) %12.1f (%5.0f) %12.1f (%5.0f)\n", numThreads,
+				mutexResult.mOpsPerSecond / 1e6, mutexResult.mP99Ns,
+				concurrentResult.mOpsPerSecond / 1e6, concurrentResult.mP99Ns,
+				threadCachedResult.mOpsPerSecond / 1e6, threadCachedResult.mP99Ns);
+			if (mutexResult.mFailedAllocations + concurrentResult.mFailedAllocations + threadCachedResult.mFailedAllocations != 0)
+				printf("         (some allocations failed; kPoolBlocks is too small)\n");
+		}
+		printf("\n");
+	}
+	return 0;
+}
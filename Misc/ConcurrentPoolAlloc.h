@@ -0,0 +1,261 @@
+// Defines a lock-free, thread-safe variant of the pool-based memory allocator
+#pragma once
+#include "PoolAlloc.h"
+#include <atomic>
+#include <cstdint>
+
+// Defines a Concurrent Pool Allocator
+// Templated based on size of block and the number of blocks in the pool, like PoolAllocator.
+//
+// Allocate and Free may be called from any number of threads at once without external locking.
+// The free list is a Treiber stack: a singly linked list whose head is swapped with compare-and-swap.
+// To avoid the ABA problem (a thread reads head A and its next B, other threads pop A, pop B, and push A back,
+// so the first thread's CAS succeeds and installs the already allocated B as head) the head packs
+// a 32-bit block index together with a 32-bit generation that is bumped on every successful push and pop.
+// A stale head therefore never compares equal, and the packed head fits in a single lock-free 64-bit atomic.
+//
+// Links are block indices rather than pointers so they fit alongside the generation.
+// The pool array is never freed while the allocator is alive, so reading a block's link that has
+// just been popped by another thread is harmless; the CAS then fails and the pop is retried.
+//
+// To define your own pool to be used, it's recommended to typedef as such:
+// typedef ConcurrentPoolAllocator<256, 1024> JobPool;
+template <size_t blockSize, unsigned int numBlocks>
+class ConcurrentPoolAllocator
+{
+public:
+	static_assert(numBlocks > 0 && numBlocks < 0xFFFFFFFFu, "Block indices must fit in 32 bits with one value left as the empty list marker.");
+
+	// Size of each block, so adapters like PoolStlAllocator can tell which requests fit
+	static const size_t kBlockSize = blockSize;
+	// Alignment of each block
+	static const size_t kBlockAlignment = alignof(void*);
+
+	// The constructor dynamically allocates the pool on the heap and links every block into the free list in order.
+	//
+	// #ifdef POOL_ALLOC_DEBUG, each block's mMemory is filled with 0xde and its mDbgBoundary set to 0xdeadbeef.
+	ConcurrentPoolAllocator();
+
+	// The destructor deallocates the pool. No other thread may be using the allocator at this point.
+	~ConcurrentPoolAllocator();
+
+	// Allocate returns a pointer to usable memory within the pool.
+	//
+	// It will DbgAssert size <= blockSize.
+	// If the size is okay, pop the head block from the free list, retrying if another thread changed the head first.
+	//
+	// If there are no blocks available, it should trigger a DbgAssert and return nullptr.
+	void* Allocate(size_t size);
+
+	// Free pushes the block containing ptr back onto the front of the free list.
+	//
+	// #ifdef POOL_ALLOC_DEBUG, DbgAssert that boundary still == 0xdeadbeef (if not, the bounds were overwritten)
+	// Also memset the blocks' mMemory member back to 0xde before the block is visible to other threads.
+	//
+	// As with PoolAllocator, don't call this on pointers that did not come from this pool!
+	void Free(void* ptr);
+
+	// AllocateBatch fills blocks with up to count blocks and returns how many it filled.
+	//
+	// The first count blocks of the free list are detached with a single compare-and-swap (retried as a whole if
+	// another thread changed the head), so a batch costs one contended atomic instead of one per block.
+	// It will DbgAssert size <= blockSize and that count blocks were available; if fewer were, it fills as many as it can.
+	unsigned int AllocateBatch(size_t size, void** blocks, unsigned int count);
+
+	// FreeBatch links count blocks into a chain privately, then pushes the whole chain with a single compare-and-swap.
+	// Same debug checks and caveats as Free.
+	void FreeBatch(void* const* blocks, unsigned int count);
+
+	// Returns the number of blocks free in the pool
+	// While other threads are allocating this is only a snapshot, and may briefly lag the free list
+	unsigned int GetNumBlocksFree() const { return mBlocksFree.load(std::memory_order_relaxed); }
+
+protected:
+	// Index used as the free list's null link
+	static const std::uint32_t kEmptyIndex = 0xFFFFFFFFu;
+
+	// Same layout as PoolAllocator's block, except the link is an atomic index
+	// It is atomic because a thread popping a stale head may read it while its owner rewrites it
+	struct alignas(kBlockAlignment) PoolBlock
+	{
+		// This is the actual memory that the caller will be writing to.
+		char mMemory[blockSize];
+
+	#ifdef POOL_ALLOC_DEBUG
+		// This boundary value is used to help find instances where memory is being written
+		// beyond the mMemory array.
+		unsigned int mDbgBoundary;
+	#endif
+
+		// Index of the next block in the free list, or kEmptyIndex
+		std::atomic<std::uint32_t> mNext;
+
+		PoolBlock()
+			: mNext(kEmptyIndex)
+		{}
+	};
+
+	// Pack a block index and generation into a free list head
+	static std::uint64_t PackHead(std::uint32_t index, std::uint32_t generation)
+	{
+		return (static_cast<std::uint64_t>(generation) << 32) | index;
+	}
+	static std::uint32_t HeadIndex(std::uint64_t head) { return static_cast<std::uint32_t>(head); }
+	static std::uint32_t HeadGeneration(std::uint64_t head) { return static_cast<std::uint32_t>(head >> 32); }
+
+	// This pointer will point to the array of all blocks
+	PoolBlock* mPool;
+
+	// The free list head as (generation << 32 | index)
+	// The head and the counter each get their own cache line so threads hammering one don't invalidate the other
+	alignas(64) std::atomic<std::uint64_t> mFreeList;
+
+	// This keeps track of how many blocks are left in the pool
+	alignas(64) std::atomic<unsigned int> mBlocksFree;
+};
+
+// IMPLEMENTATIONS for ConcurrentPoolAllocator
+
+template <size_t blockSize, unsigned int numBlocks>
+ConcurrentPoolAllocator<blockSize, numBlocks>::ConcurrentPoolAllocator()
+	: mFreeList(PackHead(0, 0))
+	, mBlocksFree(numBlocks)
+{
+	mPool = new PoolBlock[numBlocks];
+	for (unsigned int i = 0; i < numBlocks - 1; ++i)
+		mPool[i].mNext.store(i + 1, std::memory_order_relaxed);
+	#ifdef POOL_ALLOC_DEBUG
+	DbgAssert(mFreeList.is_lock_free(), "64-bit atomics are not lock-free on this platform.");
+	for (unsigned int i = 0; i < numBlocks; ++i)
+	{
+		memset(mPool[i].mMemory, 0xde, blockSize);
+		mPool[i].mDbgBoundary = 0xdeadbeef;
+	}
+	#endif
+}
+
+template <size_t blockSize, unsigned int numBlocks>
+ConcurrentPoolAllocator<blockSize, numBlocks>::~ConcurrentPoolAllocator()
+{
+	delete[] mPool;
+	mBlocksFree.store(0, std::memory_order_relaxed);
+}
+
+template <size_t blockSize, unsigned int numBlocks>
+void* ConcurrentPoolAllocator<blockSize, numBlocks>::Allocate(size_t size)
+{
+	DbgAssert(size <= blockSize, "Allocation request is bigger than block.");
+	if (size > blockSize)
+		return nullptr;
+
+	// Acquire pairs with the release in Free so the popped block's link and contents are visible
+	std::uint64_t head = mFreeList.load(std::memory_order_acquire);
+	std::uint32_t index;
+	std::uint32_t next;
+	do
+	{
+		index = HeadIndex(head);
+		if (index == kEmptyIndex)
+		{
+			DbgAssert(false, "No memory blocks available.");
+			return nullptr;
+		}
+		next = mPool[index].mNext.load(std::memory_order_relaxed);
+		// On failure head is reloaded with the current value and the pop is retried
+	} while (!mFreeList.compare_exchange_weak(head, PackHead(next, HeadGeneration(head) + 1),
+		std::memory_order_acquire, std::memory_order_acquire));
+
+	mBlocksFree.fetch_sub(1, std::memory_order_relaxed);
+	return mPool[index].mMemory;
+}
+
+template <size_t blockSize, unsigned int numBlocks>
+void ConcurrentPoolAllocator<blockSize, numBlocks>::Free(void* ptr)
+{
+	PoolBlock* tempPoolBlock = (PoolBlock*)ptr;
+	std::uint32_t index = static_cast<std::uint32_t>(tempPoolBlock - mPool);
+	DbgAssert(index < numBlocks, "Pointer does not belong to this pool.");
+	#ifdef POOL_ALLOC_DEBUG
+	DbgAssert(tempPoolBlock->mDbgBoundary == 0xdeadbeef, "Bounds were overwritten.");
+	memset(tempPoolBlock->mMemory, 0xde, blockSize);
+	#endif
+
+	std::uint64_t head = mFreeList.load(std::memory_order_relaxed);
+	do
+	{
+		tempPoolBlock->mNext.store(HeadIndex(head), std::memory_order_relaxed);
+		// Release publishes the link and any debug fill to the thread that pops this block
+	} while (!mFreeList.compare_exchange_weak(head, PackHead(index, HeadGeneration(head) + 1),
+		std::memory_order_release, std::memory_order_relaxed));
+
+	mBlocksFree.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <size_t blockSize, unsigned int numBlocks>
+unsigned int ConcurrentPoolAllocator<blockSize, numBlocks>::AllocateBatch(size_t size, void** blocks, unsigned int count)
+{
+	DbgAssert(size <= blockSize, "Allocation request is bigger than block.");
+	if (size > blockSize || count == 0)
+		return 0;
+
+	std::uint64_t head = mFreeList.load(std::memory_order_acquire);
+	std::uint32_t next;
+	unsigned int filled;
+	do
+	{
+		// Walk up to count links from the head. Blocks may be popped and pushed while this walks, but links are
+		// always kEmptyIndex or a real index, and the CAS only succeeds if the head (and its generation) is unchanged,
+		// meaning nothing was popped or pushed in the meantime and the chain that was walked is still the list's front
+		next = HeadIndex(head);
+		filled = 0;
+		while (filled < count && next != kEmptyIndex)
+		{
+			blocks[filled++] = mPool[next].mMemory;
+			next = mPool[next].mNext.load(std::memory_order_relaxed);
+		}
+		if (filled == 0)
+			break;
+	} while (!mFreeList.compare_exchange_weak(head, PackHead(next, HeadGeneration(head) + 1),
+		std::memory_order_acquire, std::memory_order_acquire));
+
+	DbgAssert(filled == count, "Not enough memory blocks available.");
+	if (filled > 0)
+		mBlocksFree.fetch_sub(filled, std::memory_order_relaxed);
+	return filled;
+}
+
+template <size_t blockSize, unsigned int numBlocks>
+void ConcurrentPoolAllocator<blockSize, numBlocks>::FreeBatch(void* const* blocks, unsigned int count)
+{
+	if (count == 0)
+		return;
+
+	// Chain the blocks in order; only the last block's link depends on the head
+	std::uint32_t first = kEmptyIndex;
+	PoolBlock* last = nullptr;
+	for (unsigned int i = count; i-- > 0;)
+	{
+		PoolBlock* tempPoolBlock = (PoolBlock*)blocks[i];
+		std::uint32_t index = static_cast<std::uint32_t>(tempPoolBlock - mPool);
+		DbgAssert(index < numBlocks, "Pointer does not belong to this pool.");
+		#ifdef POOL_ALLOC_DEBUG
+		DbgAssert(tempPoolBlock->mDbgBoundary == 0xdeadbeef, "Bounds were overwritten.");
+		memset(tempPoolBlock->mMemory, 0xde, blockSize);
+		#endif
+		if (last == nullptr)
+			last = tempPoolBlock;
+		else
+			tempPoolBlock->mNext.store(first, std::memory_order_relaxed);
+		first = index;
+	}
+
+	std::uint64_t head = mFreeList.load(std::memory_order_relaxed);
+	do
+	{
+		last->mNext.store(HeadIndex(head), std::memory_order_relaxed);
+		// Release publishes every link in the chain to the thread that pops it
+	} while (!mFreeList.compare_exchange_weak(head, PackHead(first, HeadGeneration(head) + 1),
+		std::memory_order_release, std::memory_order_relaxed));
+
+	mBlocksFree.fetch_add(count, std::memory_order_relaxed);
+}
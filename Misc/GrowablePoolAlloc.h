@@ -0,0 +1,326 @@
+// Defines a pool-based memory allocator that grows by chaining slabs
+#pragma once
+#include "PoolAlloc.h"
+#include <cstdint>
+#include <new>
+
+// Defines a Growable Pool Allocator
+// Templated based on size of block, the number of blocks in each slab, and the alignment of each block.
+//
+// Unlike PoolAllocator, running out of blocks doesn't fail: another slab of blocksPerSlab blocks is allocated
+// and chained on, so pools can be sized for the common case instead of the worst case.
+// Allocate and Free stay O(1):
+//  -Each slab is allocated aligned to the power of two at or above its size, so Free finds a block's slab by masking the pointer
+//  -Each slab keeps its own intrusive free list (links live in the free blocks' memory, as in PoolAllocator),
+//   and slabs are kept on a partial, empty, or full list (doubly linked)
+//  -Allocate takes from a partially used slab first, so lightly used slabs get the chance to drain and become empty
+// Empty slabs are cached for reuse up to maxEmptySlabs, and any beyond that are returned to the OS.
+// A higher maxEmptySlabs smooths out allocation spikes (no repeated slab allocate/release at a slab boundary)
+// at the cost of holding on to more idle memory; 0 releases slabs as soon as they empty.
+// An optional maxSlabs cap restores PoolAllocator's behavior of asserting and returning nullptr once it is reached.
+// Slabs come from a MemoryProvider (see PoolMemory.h), the heap by default.
+//
+// To define your own pool to be used, it's recommended to typedef as such:
+// typedef GrowablePoolAllocator<256, 1024> ComponentPool;
+template <size_t blockSize, unsigned int blocksPerSlab, size_t alignment = alignof(void*), typename MemoryProvider = HeapMemoryProvider>
+class GrowablePoolAllocator
+{
+public:
+	static_assert(blocksPerSlab > 0, "Slabs must hold at least one block.");
+	static_assert(alignment >= alignof(void*) && (alignment & (alignment - 1)) == 0, "Alignment must be a power of two that can hold a free list link.");
+
+	// Size of each block, so adapters like PoolStlAllocator can tell which requests fit
+	static const size_t kBlockSize = blockSize;
+	// Alignment of each block
+	static const size_t kBlockAlignment = alignment;
+
+	// The constructor doesn't allocate anything; the first slab is created by the first Allocate.
+	//
+	// maxEmptySlabs is the number of fully free slabs kept around instead of being released.
+	// maxSlabs caps the total number of slabs, or 0 for no cap.
+	// provider supplies each slab's memory.
+	explicit GrowablePoolAllocator(unsigned int maxEmptySlabs = 1, unsigned int maxSlabs = 0, const MemoryProvider& provider = MemoryProvider());
+
+	// The destructor releases every slab, whether or not its blocks were freed.
+	~GrowablePoolAllocator();
+
+	// Allocate returns a pointer to usable memory within the pool.
+	//
+	// It will DbgAssert size <= blockSize.
+	// If every slab is full, a cached empty slab is reused or a new one is allocated.
+	//
+	// If the maxSlabs cap is reached, it should trigger a DbgAssert and return nullptr.
+	void* Allocate(size_t size);
+
+	// Free returns the block to its slab's free list, then releases the slab if it became empty
+	// and more than maxEmptySlabs slabs are empty.
+	//
+	// #ifdef POOL_ALLOC_DEBUG, DbgAssert that boundary still == 0xdeadbeef (if not, the bounds were overwritten)
+	// Also memset the blocks' mMemory member back to 0xde.
+	//
+	// Note that it's not straightforward to verify that the pointer actually belongs in the
+	// pool, so don't call this on random pointers!
+	void Free(void* ptr);
+
+	// Release every cached empty slab to the OS regardless of maxEmptySlabs
+	void ReleaseEmptySlabs();
+
+	// Returns the number of blocks free in the pool's current slabs
+	unsigned int GetNumBlocksFree() const { return mBlocksFree; }
+
+	// Returns the number of slabs currently allocated
+	unsigned int GetNumSlabs() const { return mNumSlabs; }
+
+protected:
+	// Same layout as PoolAllocator's block, except the link is a pointer since slabs are separate allocations
+	struct alignas(alignment) PoolBlock
+	{
+		union
+		{
+			// This is the actual memory that the caller will be writing to.
+			// It always has room for the free list link, even if blockSize is smaller
+			char mMemory[blockSize < sizeof(void*) ? sizeof(void*) : blockSize];
+
+			// Pointer to the next block in the slab's free list, only meaningful while the block is free
+			PoolBlock* mNext;
+		};
+
+	#ifdef POOL_ALLOC_DEBUG
+		// This boundary value is used to help find instances where memory is being written
+		// beyond the mMemory array.
+		unsigned int mDbgBoundary;
+	#endif
+	};
+
+	// Header at the start of each slab, followed by its blocks
+	struct Slab
+	{
+		// Links in whichever of the partial, empty, or full lists this slab is on
+		Slab* mPrev;
+		Slab* mNext;
+		// This slab's own free list
+		PoolBlock* mFreeList;
+		unsigned int mBlocksFree;
+
+		PoolBlock* GetBlocks() { return reinterpret_cast<PoolBlock*>(reinterpret_cast<char*>(this) + kHeaderBytes); }
+	};
+
+	// Intrusive doubly linked list of slabs
+	struct SlabList
+	{
+		Slab* mHead;
+		unsigned int mCount;
+
+		SlabList()
+		{
+			mHead = nullptr;
+			mCount = 0;
+		}
+
+		void PushFront(Slab* slab);
+		void Remove(Slab* slab);
+	};
+
+	// Round val up to a multiple of align
+	static constexpr size_t RoundUp(size_t val, size_t align) { return (val + align - 1) / align * align; }
+	// Smallest power of two >= val
+	static constexpr size_t NextPowerOfTwo(size_t val, size_t pow = 1) { return pow >= val ? pow : NextPowerOfTwo(val, pow * 2); }
+
+	static constexpr size_t kHeaderBytes = RoundUp(sizeof(Slab), alignof(PoolBlock));
+	// Only the header and blocks are requested from the provider, so no memory is spent rounding slabs up to a power of two
+	static constexpr size_t kSlabBytes = kHeaderBytes + blocksPerSlab * sizeof(PoolBlock);
+	// Slabs are aligned to a power of two at least as big as they are, so a block's slab is found by masking off the low bits of its address
+	static constexpr size_t kSlabAlignment = NextPowerOfTwo(kSlabBytes);
+
+	// Find the slab containing ptr
+	static Slab* SlabFromPointer(void* ptr) { return reinterpret_cast<Slab*>(reinterpret_cast<std::uintptr_t>(ptr) & ~(kSlabAlignment - 1)); }
+
+	// Allocate a new slab with every block on its free list
+	Slab* CreateSlab();
+	// Return a slab's memory to the provider
+	void ReleaseSlab(Slab* slab);
+
+	// Where slabs' memory comes from
+	MemoryProvider mProvider;
+
+	// Slabs with some blocks allocated and some free
+	SlabList mPartialSlabs;
+	// Slabs with every block free
+	SlabList mEmptySlabs;
+	// Slabs with no free blocks
+	SlabList mFullSlabs;
+
+	unsigned int mMaxEmptySlabs;
+	unsigned int mMaxSlabs;
+	unsigned int mNumSlabs;
+
+	// This keeps track of how many blocks are left in the pool's current slabs
+	unsigned int mBlocksFree;
+};
+
+// IMPLEMENTATIONS for GrowablePoolAllocator
+
+template <size_t blockSize, unsigned int blocksPerSlab, size_t alignment, typename MemoryProvider>
+GrowablePoolAllocator<blockSize, blocksPerSlab, alignment, MemoryProvider>::GrowablePoolAllocator(unsigned int maxEmptySlabs, unsigned int maxSlabs, const MemoryProvider& provider)
+	: mProvider(provider)
+{
+	mMaxEmptySlabs = maxEmptySlabs;
+	mMaxSlabs = maxSlabs;
+	mNumSlabs = 0;
+	mBlocksFree = 0;
+}
+
+template <size_t blockSize, unsigned int blocksPerSlab, size_t alignment, typename MemoryProvider>
+GrowablePoolAllocator<blockSize, blocksPerSlab, alignment, MemoryProvider>::~GrowablePoolAllocator()
+{
+	SlabList* lists[] = { &mPartialSlabs, &mEmptySlabs, &mFullSlabs };
+	for (SlabList* list : lists)
+	{
+		while (list->mHead != nullptr)
+		{
+			Slab* slab = list->mHead;
+			list->Remove(slab);
+			ReleaseSlab(slab);
+		}
+	}
+	mBlocksFree = 0;
+}
+
+template <size_t blockSize, unsigned int blocksPerSlab, size_t alignment, typename MemoryProvider>
+void* GrowablePoolAllocator<blockSize, blocksPerSlab, alignment, MemoryProvider>::Allocate(size_t size)
+{
+	DbgAssert(size <= blockSize, "Allocation request is bigger than block.");
+	if (size > blockSize)
+		return nullptr;
+
+	Slab* slab = mPartialSlabs.mHead;
+	if (slab == nullptr)
+	{
+		slab = mEmptySlabs.mHead;
+		if (slab != nullptr)
+		{
+			mEmptySlabs.Remove(slab);
+		}
+		else
+		{
+			DbgAssert(mMaxSlabs == 0 || mNumSlabs < mMaxSlabs, "No memory blocks available.");
+			if (mMaxSlabs != 0 && mNumSlabs >= mMaxSlabs)
+				return nullptr;
+			slab = CreateSlab();
+		}
+		mPartialSlabs.PushFront(slab);
+	}
+
+	PoolBlock* temp = slab->mFreeList;
+	slab->mFreeList = temp->mNext;
+	--slab->mBlocksFree;
+	--mBlocksFree;
+	if (slab->mBlocksFree == 0)
+	{
+		mPartialSlabs.Remove(slab);
+		mFullSlabs.PushFront(slab);
+	}
+	return temp;
+}
+
+template <size_t blockSize, unsigned int blocksPerSlab, size_t alignment, typename MemoryProvider>
+void GrowablePoolAllocator<blockSize, blocksPerSlab, alignment, MemoryProvider>::Free(void* ptr)
+{
+	PoolBlock* tempPoolBlock = (PoolBlock*)ptr;
+	#ifdef POOL_ALLOC_DEBUG
+	DbgAssert(tempPoolBlock->mDbgBoundary == 0xdeadbeef, "Bounds were overwritten.");
+	// Fill before the link is written so the link survives
+	memset(tempPoolBlock->mMemory, 0xde, sizeof(tempPoolBlock->mMemory));
+	#endif
+
+	Slab* slab = SlabFromPointer(ptr);
+	if (slab->mBlocksFree == 0)
+	{
+		mFullSlabs.Remove(slab);
+		mPartialSlabs.PushFront(slab);
+	}
+	tempPoolBlock->mNext = slab->mFreeList;
+	slab->mFreeList = tempPoolBlock;
+	++slab->mBlocksFree;
+	++mBlocksFree;
+
+	if (slab->mBlocksFree == blocksPerSlab)
+	{
+		mPartialSlabs.Remove(slab);
+		if (mEmptySlabs.mCount < mMaxEmptySlabs)
+			mEmptySlabs.PushFront(slab);
+		else
+			ReleaseSlab(slab);
+	}
+}
+
+template <size_t blockSize, unsigned int blocksPerSlab, size_t alignment, typename MemoryProvider>
+void GrowablePoolAllocator<blockSize, blocksPerSlab, alignment, MemoryProvider>::ReleaseEmptySlabs()
+{
+	while (mEmptySlabs.mHead != nullptr)
+	{
+		Slab* slab = mEmptySlabs.mHead;
+		mEmptySlabs.Remove(slab);
+		ReleaseSlab(slab);
+	}
+}
+
+template <size_t blockSize, unsigned int blocksPerSlab, size_t alignment, typename MemoryProvider>
+typename GrowablePoolAllocator<blockSize, blocksPerSlab, alignment, MemoryProvider>::Slab* GrowablePoolAllocator<blockSize, blocksPerSlab, alignment, MemoryProvider>::CreateSlab()
+{
+	Slab* slab = static_cast<Slab*>(mProvider.Allocate(kSlabBytes, kSlabAlignment));
+	slab->mPrev = nullptr;
+	slab->mNext = nullptr;
+
+	PoolBlock* blocks = slab->GetBlocks();
+	for (unsigned int i = 0; i < blocksPerSlab - 1; ++i)
+		blocks[i].mNext = &blocks[i + 1];
+	blocks[blocksPerSlab - 1].mNext = nullptr;
+	slab->mFreeList = blocks;
+	slab->mBlocksFree = blocksPerSlab;
+	#ifdef POOL_ALLOC_DEBUG
+	for (unsigned int i = 0; i < blocksPerSlab; ++i)
+	{
+		// Fill everything but the link
+		memset(blocks[i].mMemory + sizeof(void*), 0xde, sizeof(blocks[i].mMemory) - sizeof(void*));
+		blocks[i].mDbgBoundary = 0xdeadbeef;
+	}
+	#endif
+
+	++mNumSlabs;
+	mBlocksFree += blocksPerSlab;
+	return slab;
+}
+
+template <size_t blockSize, unsigned int blocksPerSlab, size_t alignment, typename MemoryProvider>
+void GrowablePoolAllocator<blockSize, blocksPerSlab, alignment, MemoryProvider>::ReleaseSlab(Slab* slab)
+{
+	--mNumSlabs;
+	mBlocksFree -= slab->mBlocksFree;
+	mProvider.Release(slab, kSlabBytes, kSlabAlignment);
+}
+
+template <size_t blockSize, unsigned int blocksPerSlab, size_t alignment, typename MemoryProvider>
+void GrowablePoolAllocator<blockSize, blocksPerSlab, alignment, MemoryProvider>::SlabList::PushFront(Slab* slab)
+{
+	slab->mPrev = nullptr;
+	slab->mNext = mHead;
+	if (mHead != nullptr)
+		mHead->mPrev = slab;
+	mHead = slab;
+	++mCount;
+}
+
+template <size_t blockSize, unsigned int blocksPerSlab, size_t alignment, typename MemoryProvider>
+void GrowablePoolAllocator<blockSize, blocksPerSlab, alignment, MemoryProvider>::SlabList::Remove(Slab* slab)
+{
+	if (slab->mPrev != nullptr)
+		slab->mPrev->mNext = slab->mNext;
+	else
+		mHead = slab->mNext;
+	if (slab->mNext != nullptr)
+		slab->mNext->mPrev = slab->mPrev;
+	slab->mPrev = nullptr;
+	slab->mNext = nullptr;
+	--mCount;
+}
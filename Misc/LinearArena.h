@@ -0,0 +1,205 @@
+// Defines linear (bump pointer) arena allocators for short-lived memory, as well as helper structs
+// Any LinearArena can serve as library scratch memory through ScopedScratchArena (see ScratchArena.h)
+#pragma once
+#include "PoolAlloc.h"
+#include "ScratchArena.h"
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+// Defines a Linear Arena
+//
+// Allocate just bumps an offset, so allocations of any size and alignment are O(1) and sit back to back in memory.
+// Nothing is freed individually; instead:
+//  -GetMarker saves the current offset and FreeToMarker rolls back to it, freeing everything allocated since (stack order)
+//  -Reset frees everything at once
+// Destructors are never run, so only put trivially destructible data (or data you destroy yourself) in an arena.
+//
+// ArenaMarkerScope restores a marker when it goes out of scope, for temporaries within a function:
+//  ArenaMarkerScope scope(arena);
+//  float* temp = arena.AllocateArray<float>(count);
+//
+// Like PoolAllocator, this is not thread safe.
+class LinearArena
+{
+public:
+	// Saved position in the arena
+	typedef size_t Marker;
+
+	// Allocate capacity bytes from the heap, owned by the arena
+	explicit LinearArena(size_t capacity);
+
+	// Use the caller's buffer, which must outlive the arena (i.e. a stack buffer or memory from a PageMemoryProvider)
+	LinearArena(void* buffer, size_t capacity);
+
+	~LinearArena();
+
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+
+	// Allocate returns a pointer to size bytes aligned to alignment (a power of two).
+	//
+	// If the arena doesn't have room, it should trigger a DbgAssert and return nullptr.
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	// Like Allocate, but running out of room is expected (the caller has a fallback), so it just returns nullptr
+	void* TryAllocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	// Allocate uninitialized room for count Ts
+	template <typename T>
+	T* AllocateArray(size_t count);
+
+	// Return the current position, to later free everything allocated after it
+	Marker GetMarker() const { return mOffset; }
+
+	// Free everything allocated since marker was taken
+	//
+	// #ifdef POOL_ALLOC_DEBUG, the freed bytes are memset to 0xde.
+	void FreeToMarker(Marker marker);
+
+	// Free everything in the arena
+	void Reset() { FreeToMarker(0); }
+
+	size_t GetCapacity() const { return mCapacity; }
+	size_t GetBytesUsed() const { return mOffset; }
+	// Most bytes used at once, to size the arena from
+	size_t GetPeakBytesUsed() const { return mPeakOffset; }
+
+protected:
+	char* mBuffer;
+	size_t mCapacity;
+	size_t mOffset;
+	size_t mPeakOffset;
+	// Whether mBuffer was allocated by the arena
+	bool mOwnsBuffer;
+};
+
+// Restores an arena to the marker taken at construction when it goes out of scope
+class ArenaMarkerScope
+{
+public:
+	explicit ArenaMarkerScope(LinearArena& arena)
+		: mArena(arena)
+		, mMarker(arena.GetMarker())
+	{}
+	~ArenaMarkerScope() { mArena.FreeToMarker(mMarker); }
+
+	ArenaMarkerScope(const ArenaMarkerScope&) = delete;
+	ArenaMarkerScope& operator=(const ArenaMarkerScope&) = delete;
+
+private:
+	LinearArena& mArena;
+	LinearArena::Marker mMarker;
+};
+
+// Defines a Double Buffered Frame Arena
+//
+// Two arenas that trade places every frame: BeginFrame resets the older one and makes it current.
+// Memory allocated during a frame therefore stays valid through the whole next frame,
+// so data produced in frame N (i.e. render commands) can be consumed in frame N + 1 without copying.
+class DoubleBufferedFrameArena
+{
+public:
+	// Each frame's arena holds capacityPerFrame bytes
+	explicit DoubleBufferedFrameArena(size_t capacityPerFrame);
+
+	// Start a new frame, freeing everything allocated two frames ago
+	void BeginFrame();
+
+	// Allocate from the current frame's arena
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t)) { return GetCurrent().Allocate(size, alignment); }
+	template <typename T>
+	T* AllocateArray(size_t count) { return GetCurrent().AllocateArray<T>(count); }
+
+	// Arena for this frame's allocations
+	LinearArena& GetCurrent() { return mArenas[mCurrent]; }
+	// Last frame's arena, whose allocations are still valid
+	LinearArena& GetPrevious() { return mArenas[mCurrent ^ 1]; }
+
+protected:
+	LinearArena mArenas[2];
+	unsigned int mCurrent;
+};
+
+// IMPLEMENTATIONS for LinearArena
+
+inline LinearArena::LinearArena(size_t capacity)
+{
+	// Cache line aligned so the first allocation of any common alignment needs no padding
+	mBuffer = static_cast<char*>(::operator new(capacity, std::align_val_t(64)));
+	mCapacity = capacity;
+	mOffset = 0;
+	mPeakOffset = 0;
+	mOwnsBuffer = true;
+}
+
+inline LinearArena::LinearArena(void* buffer, size_t capacity)
+{
+	mBuffer = static_cast<char*>(buffer);
+	mCapacity = capacity;
+	mOffset = 0;
+	mPeakOffset = 0;
+	mOwnsBuffer = false;
+}
+
+inline LinearArena::~LinearArena()
+{
+	if (mOwnsBuffer)
+		::operator delete(mBuffer, std::align_val_t(64));
+	mOffset = 0;
+}
+
+inline void* LinearArena::Allocate(size_t size, size_t alignment)
+{
+	void* ptr = TryAllocate(size, alignment);
+	DbgAssert(ptr != nullptr, "Arena is out of memory.");
+	return ptr;
+}
+
+inline void* LinearArena::TryAllocate(size_t size, size_t alignment)
+{
+	DbgAssert((alignment & (alignment - 1)) == 0, "Alignment must be a power of two.");
+	// Align the address rather than the offset so caller-provided buffers of any alignment work
+	std::uintptr_t base = reinterpret_cast<std::uintptr_t>(mBuffer);
+	size_t start = static_cast<size_t>(((base + mOffset + alignment - 1) & ~(std::uintptr_t)(alignment - 1)) - base);
+	if (start > mCapacity || size > mCapacity - start)
+		return nullptr;
+
+	mOffset = start + size;
+	if (mOffset > mPeakOffset)
+		mPeakOffset = mOffset;
+	return mBuffer + start;
+}
+
+template <typename T>
+T* LinearArena::AllocateArray(size_t count)
+{
+	DbgAssert(count <= static_cast<size_t>(-1) / sizeof(T), "Array size overflows.");
+	if (count > static_cast<size_t>(-1) / sizeof(T))
+		return nullptr;
+	return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+}
+
+inline void LinearArena::FreeToMarker(Marker marker)
+{
+	DbgAssert(marker <= mOffset, "Marker is past the current position; markers must be freed in stack order.");
+	if (marker > mOffset)
+		return;
+	#ifdef POOL_ALLOC_DEBUG
+	memset(mBuffer + marker, 0xde, mOffset - marker);
+	#endif
+	mOffset = marker;
+}
+
+// IMPLEMENTATIONS for DoubleBufferedFrameArena
+
+inline DoubleBufferedFrameArena::DoubleBufferedFrameArena(size_t capacityPerFrame)
+	: mArenas{ LinearArena(capacityPerFrame), LinearArena(capacityPerFrame) }
+	, mCurrent(0)
+{}
+
+inline void DoubleBufferedFrameArena::BeginFrame()
+{
+	mCurrent ^= 1;
+	mArenas[mCurrent].Reset();
+}
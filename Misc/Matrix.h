@@ -4,13 +4,19 @@
 #include <memory>
 #include "Math.h"
 #include "Vector.h"
+#include "SimdKernels.h"
 #include "Quaternion.h"
+#include "ScratchArena.h"
 
 // This library follows the convention where possible that functions are defined twice:
 //  once as a member function that acts in-place, and once as a free function that returns a new, altered copy
-// The structs in this library only accept arithmetic template arguments
+// The structs in this library only accept arithmetic or SIMD packet template arguments (see ScalarTraits.h)
+//  -the generic NxN Inverse and Determinant pivot on comparisons, so they remain arithmetic-only
+//  -the 3x3 and 4x4 inverses leave singular lanes of a packet matrix unchanged, matching the arithmetic behavior
 // Matrices are stored in row-major order because that is the memory layout for C/C++
 // Matrices are intended to be used with column vectors (post-multiplied) regarding affine transformations
+// For float, 4x4 multiplication, transposition, vector products, and TransformVec/TransformPoint run on the SSE kernels in SimdKernels.h
+//  when SSE4.1 is enabled, unless MATH_NO_SIMD is defined
 // Matrices' internal data is accessible as a public std::array called data
 // There are using aliases for common matrix types and sizes at the end of the declarations
 // Square matrices sized 2 and 3 have static constants of commonly useful defaults
@@ -34,7 +40,7 @@ template<typename T, std::size_t r, std::size_t c>
 struct Matrix
 {
 public:
-	static_assert(std::is_arithmetic<T>::value, "Matrices only accept arithmetic template arguments");
+	static_assert(IsMathScalar<T>::value, "Matrices only accept arithmetic or SIMD packet template arguments");
 
 	std::array<T, r * c> data;
 
@@ -165,6 +171,9 @@ struct SquareMatrix<T, 3> : public Matrix<T, 3, 3>
 	// Change this matrix into a rotating matrix about the z axis by the given angle in radians
 	SquareMatrix<T, 3>& RotationZ(float angle);
 
+	// Return the quaternion this rotation matrix represents using Shepperd's method (assumes an orthonormal rotation)
+	Quaternion<T> ToQuaternion() const;
+
 	T Determinant() const;
 	T Trace() const;
 
@@ -220,6 +229,8 @@ struct SquareMatrix<T, 4> : public Matrix<T, 4, 4>
 	// Change this matrix into a rotating affine matrix about the z axis by the given angle in radians
 	SquareMatrix<T, 4>& RotationZ(float angle);
 
+	// Return the quaternion the upper 3x3 rotation of this matrix represents using Shepperd's method (assumes an orthonormal rotation)
+	Quaternion<T> ToQuaternion() const;
 
 	T Determinant() const;
 	T Trace() const;
@@ -346,6 +357,13 @@ SquareMatrix<T, 3> RotationZ(float angle);
 template<typename T>
 SquareMatrix<T, 4> RotationZ(float angle);
 
+// Return the quaternion the given 3x3 rotation matrix represents using Shepperd's method (assumes an orthonormal rotation)
+template<typename T>
+Quaternion<T> ToQuaternion(const SquareMatrix<T, 3>& mat);
+// Return the quaternion the upper 3x3 rotation of the given affine matrix represents using Shepperd's method (assumes an orthonormal rotation)
+template<typename T>
+Quaternion<T> ToQuaternion(const SquareMatrix<T, 4>& mat);
+
 // Compute the determinant using Gaussian elimination
 template<typename T, std::size_t size>
 T Determinant(const SquareMatrix<T, size>& mat);
@@ -430,6 +448,10 @@ namespace interior
 		T Determinant() const;
 		T Trace() const;
 	};
+
+	// Shepperd's method shared by the 3x3 and 4x4 ToQuaternion given a row-major rotation and the distance between its rows
+	template<typename T>
+	Quaternion<T> RotationToQuaternion(const T* const mat, std::size_t rowStride);
 }
 
 // Implementations
@@ -752,22 +774,31 @@ SquareMatrix<T, 3>& SquareMatrix<T, 3>::Inverse()
 	T cofactor00 = data[4] * data[8] - data[5] * data[7];
 	T cofactor01 = data[5] * data[6] - data[3] * data[8];
 	T cofactor02 = data[3] * data[7] - data[4] * data[6];
-	float det = static_cast<float>(data[0] * cofactor00 + data[1] * cofactor01 + data[2] * cofactor02);
-	if (!Math::IsZero(det))
+	T det = data[0] * cofactor00 + data[1] * cofactor01 + data[2] * cofactor02;
+	auto singular = IsNearZero(det);
+	if (!AllOf(singular))
 	{
 		SquareMatrix<T, 3> copy(*this);
 
 		// Move along columns because adjoint is transpose of cofactors
-		det = 1.0f / det;
+		// Singular lanes divide by one instead and are restored below
+		det = 1.0f / Select(singular, T(1), det);
 		data[0] = det * cofactor00;
 		data[3] = det * cofactor01;
 		data[6] = det * cofactor02;
 		data[1] = det * (copy.data[2] * copy.data[7] - copy.data[1] * copy.data[8]);
 		data[4] = det * (copy.data[0] * copy.data[8] - copy.data[2] * copy.data[6]);
 		data[7] = det * (copy.data[1] * copy.data[6] - copy.data[0] * copy.data[7]);
-		data[2] = det * (copy.data[0] * copy.data[4] - copy.data[1] * copy.data[3]);
+		data[2] = det * (copy.data[1] * copy.data[5] - copy.data[2] * copy.data[4]);
 		data[5] = det * (copy.data[2] * copy.data[3] - copy.data[0] * copy.data[5]);
 		data[8] = det * (copy.data[0] * copy.data[4] - copy.data[1] * copy.data[3]);
+		if (!NoneOf(singular))
+		{
+			for (std::size_t i = 0; i < 9; ++i)
+			{
+				data[i] = Select(singular, copy.data[i], data[i]);
+			}
+		}
 	}
 
 	return *this;
@@ -786,10 +817,10 @@ SquareMatrix<T, 3>& SquareMatrix<T, 3>::Scale(const Vector<T, 3>& scale)
 template<typename T>
 SquareMatrix<T, 3>& SquareMatrix<T, 3>::Rotation(const Quaternion<T>& quat)
 {
-	float s, sxx, syy, szz, sxy, sxz, syz, swx, swy, swz;
+	T s, sxx, syy, szz, sxy, sxz, syz, swx, swy, swz;
 
 	// S = 2.0f if quat is normalized
-	s = 2.0f / (quat.x * quat.x + quat.y * quat.y + quat.z * quat.z + quat.w * quat.w);
+	s = T(2.0f) / (quat.x * quat.x + quat.y * quat.y + quat.z * quat.z + quat.w * quat.w);
 
 	sxx = s * quat.x * quat.x;
 	syy = s * quat.y * quat.y;
@@ -837,15 +868,15 @@ SquareMatrix<T, 3>& SquareMatrix<T, 3>::Rotation(const Vector<T, 3>& axis, float
 	Vector<T, 3> normalizedAxis(axis);
 	normalizedAxis.Normalize();
 
-	float ax = a * normalizedAxis.data[0];
-	float ay = a * normalizedAxis.data[1];
-	float az = a * normalizedAxis.data[2];
-	float axy = ax * normalizedAxis.data[1];
-	float axz = ax * normalizedAxis.data[2];
-	float ayz = ay * normalizedAxis.data[2];
-	float sx = s * normalizedAxis.data[0];
-	float sy = s * normalizedAxis.data[1];
-	float sz = s * normalizedAxis.data[2];
+	T ax = a * normalizedAxis.data[0];
+	T ay = a * normalizedAxis.data[1];
+	T az = a * normalizedAxis.data[2];
+	T axy = ax * normalizedAxis.data[1];
+	T axz = ax * normalizedAxis.data[2];
+	T ayz = ay * normalizedAxis.data[2];
+	T sx = s * normalizedAxis.data[0];
+	T sy = s * normalizedAxis.data[1];
+	T sz = s * normalizedAxis.data[2];
 
 	data[0] = ax * normalizedAxis.data[0] + c; data[1] = axy - sz; data[2] = axz + sy;
 	data[3] = axy + sz; data[4] = ay * normalizedAxis.data[1] + c; data[5] = ayz - sx;
@@ -892,6 +923,12 @@ SquareMatrix<T, 3>& SquareMatrix<T, 3>::RotationZ(float angle)
 	return *this;
 }
 
+template<typename T>
+Quaternion<T> SquareMatrix<T, 3>::ToQuaternion() const
+{
+	return interior::RotationToQuaternion(data.data(), 3);
+}
+
 template<typename T>
 T SquareMatrix<T, 3>::Determinant() const
 {
@@ -1003,13 +1040,15 @@ SquareMatrix<T, 4>& SquareMatrix<T, 4>::AffineInverse()
 	T cofactor00 = data[5] * data[10] - data[6] * data[9];
 	T cofactor01 = data[6] * data[8] - data[4] * data[10];
 	T cofactor02 = data[4] * data[9] - data[5] * data[8];
-	float det = static_cast<float>(data[0] * cofactor00 + data[1] * cofactor01 + data[2] * cofactor02);
-	if (!Math::IsZero(det))
+	T det = data[0] * cofactor00 + data[1] * cofactor01 + data[2] * cofactor02;
+	auto singular = IsNearZero(det);
+	if (!AllOf(singular))
 	{
 		SquareMatrix<T, 4> copy(*this);
 
 		// Create adjunct matrix and multiply by 1/det to get upper 3x3
-		det = 1.0f / det;
+		// Singular lanes divide by one instead and are restored below
+		det = 1.0f / Select(singular, T(1), det);
 		data[0] = det * cofactor00;
 		data[4] = det * cofactor01;
 		data[8] = det * cofactor02;
@@ -1021,9 +1060,16 @@ SquareMatrix<T, 4>& SquareMatrix<T, 4>::AffineInverse()
 		data[10] = det * (copy.data[0] * copy.data[5] - copy.data[1] * copy.data[4]);
 
 		// Multiply negative translation by inverted upper 3x3
-		data[3] = -data[0] * data[3] - data[1] * data[7] - data[2] * data[11];
-		data[7] = -data[4] * data[3] - data[5] * data[7] - data[6] * data[11];
-		data[11] = -data[8] * data[3] - data[9] * data[7] - data[10] * data[11];
+		data[3] = -data[0] * copy.data[3] - data[1] * copy.data[7] - data[2] * copy.data[11];
+		data[7] = -data[4] * copy.data[3] - data[5] * copy.data[7] - data[6] * copy.data[11];
+		data[11] = -data[8] * copy.data[3] - data[9] * copy.data[7] - data[10] * copy.data[11];
+		if (!NoneOf(singular))
+		{
+			for (std::size_t i = 0; i < 16; ++i)
+			{
+				data[i] = Select(singular, copy.data[i], data[i]);
+			}
+		}
 	}
 
 	return *this;
@@ -1036,12 +1082,14 @@ SquareMatrix<T, 4>& SquareMatrix<T, 4>::Inverse()
 	T cofactor01 = -(data[4] * (data[10] * data[15] - data[11] * data[14]) - data[6] * (data[8] * data[15] - data[11] * data[12]) + data[7] * (data[8] * data[14] - data[10] * data[12]));
 	T cofactor02 = data[4] * (data[9] * data[15] - data[11] * data[13]) - data[5] * (data[8] * data[15] - data[11] * data[12]) + data[7] * (data[8] * data[13] - data[9] * data[12]);
 	T cofactor03 = -(data[4] * (data[9] * data[14] - data[10] * data[13]) - data[5] * (data[8] * data[14] - data[10] * data[12]) + data[6] * (data[8] * data[13] - data[9] * data[12]));
-	float det = static_cast<float>(data[0] * cofactor00 + data[1] * cofactor01 + data[2] * cofactor02 + data[3] * cofactor03);
-	if (!Math::IsZero(det))
+	T det = data[0] * cofactor00 + data[1] * cofactor01 + data[2] * cofactor02 + data[3] * cofactor03;
+	auto singular = IsNearZero(det);
+	if (!AllOf(singular))
 	{
 		SquareMatrix<T, 4> copy(*this);
 
-		det = 1.0f / det;
+		// Singular lanes divide by one instead and are restored below
+		det = 1.0f / Select(singular, T(1), det);
 		data[0] = det * cofactor00;
 		data[4] = det * cofactor01;
 		data[8] = det * cofactor02;
@@ -1058,6 +1106,13 @@ SquareMatrix<T, 4>& SquareMatrix<T, 4>::Inverse()
 		data[7] = det * (copy.data[0] * (copy.data[6] * copy.data[11] - copy.data[7] * copy.data[10]) - copy.data[2] * (copy.data[4] * copy.data[11] - copy.data[7] * copy.data[8]) + copy.data[3] * (copy.data[4] * copy.data[10] - copy.data[6] * copy.data[8]));
 		data[11] = det * -(copy.data[0] * (copy.data[5] * copy.data[11] - copy.data[7] * copy.data[9]) - copy.data[1] * (copy.data[4] * copy.data[11] - copy.data[7] * copy.data[8]) + copy.data[3] * (copy.data[4] * copy.data[9] - copy.data[5] * copy.data[8]));
 		data[15] = det * (copy.data[0] * (copy.data[5] * copy.data[10] - copy.data[6] * copy.data[9]) - copy.data[1] * (copy.data[4] * copy.data[10] - copy.data[6] * copy.data[8]) + copy.data[2] * (copy.data[4] * copy.data[9] - copy.data[5] * copy.data[8]));
+		if (!NoneOf(singular))
+		{
+			for (std::size_t i = 0; i < 16; ++i)
+			{
+				data[i] = Select(singular, copy.data[i], data[i]);
+			}
+		}
 	}
 
 	return *this;
@@ -1099,10 +1154,10 @@ SquareMatrix<T, 4>& SquareMatrix<T, 4>::Rotation(const SquareMatrix<T, 3>& mat)
 template<typename T>
 SquareMatrix<T, 4>& SquareMatrix<T, 4>::Rotation(const Quaternion<T>& quat)
 {
-	float s, sxx, syy, szz, sxy, sxz, syz, swx, swy, swz;
+	T s, sxx, syy, szz, sxy, sxz, syz, swx, swy, swz;
 
 	// S = 2.0f if quat is normalized
-	s = 2.0f / (quat.x * quat.x + quat.y * quat.y + quat.z * quat.z + quat.w * quat.w);
+	s = T(2.0f) / (quat.x * quat.x + quat.y * quat.y + quat.z * quat.z + quat.w * quat.w);
 
 	sxx = s * quat.x * quat.x;
 	syy = s * quat.y * quat.y;
@@ -1152,15 +1207,15 @@ SquareMatrix<T, 4>& SquareMatrix<T, 4>::Rotation(const Vector<T, 3>& axis, float
 	Vector<T, 3> normalizedAxis(axis);
 	normalizedAxis.Normalize();
 
-	float ax = a * normalizedAxis.data[0];
-	float ay = a * normalizedAxis.data[1];
-	float az = a * normalizedAxis.data[2];
-	float axy = ax * normalizedAxis.data[1];
-	float axz = ax * normalizedAxis.data[2];
-	float ayz = ay * normalizedAxis.data[2];
-	float sx = s * normalizedAxis.data[0];
-	float sy = s * normalizedAxis.data[1];
-	float sz = s * normalizedAxis.data[2];
+	T ax = a * normalizedAxis.data[0];
+	T ay = a * normalizedAxis.data[1];
+	T az = a * normalizedAxis.data[2];
+	T axy = ax * normalizedAxis.data[1];
+	T axz = ax * normalizedAxis.data[2];
+	T ayz = ay * normalizedAxis.data[2];
+	T sx = s * normalizedAxis.data[0];
+	T sy = s * normalizedAxis.data[1];
+	T sz = s * normalizedAxis.data[2];
 
 	data[0] = ax * normalizedAxis.data[0] + c; data[1] = axy - sz; data[2] = axz + sy; data[3] = 0;
 	data[4] = axy + sz; data[5] = ay * normalizedAxis.data[1] + c; data[6] = ayz - sx; data[7] = 0;
@@ -1212,6 +1267,12 @@ SquareMatrix<T, 4>& SquareMatrix<T, 4>::RotationZ(float angle)
 	return *this;
 }
 
+template<typename T>
+Quaternion<T> SquareMatrix<T, 4>::ToQuaternion() const
+{
+	return interior::RotationToQuaternion(data.data(), 4);
+}
+
 template<typename T>
 T SquareMatrix<T, 4>::Determinant() const
 {
@@ -1231,9 +1292,9 @@ template<typename T>
 Vector<T, 3> SquareMatrix<T, 4>::TransformVec(const Vector<T, 3>& vec) const
 {
 	Vector<T, 3> result;
-	result[0] = data[0] * vec.data[0] + data[1] * vec.data[0] + data[2] * vec.data[0];
-	result[1] = data[4] * vec.data[1] + data[5] * vec.data[1] + data[6] * vec.data[1];
-	result[2] = data[8] * vec.data[2] + data[9] * vec.data[2] + data[10] * vec.data[2];
+	result[0] = data[0] * vec.data[0] + data[1] * vec.data[1] + data[2] * vec.data[2];
+	result[1] = data[4] * vec.data[0] + data[5] * vec.data[1] + data[6] * vec.data[2];
+	result[2] = data[8] * vec.data[0] + data[9] * vec.data[1] + data[10] * vec.data[2];
 	return result;
 }
 
@@ -1241,9 +1302,9 @@ template<typename T>
 Vector<T, 3> SquareMatrix<T, 4>::TransformPoint(const Vector<T, 3>& point) const
 {
 	Vector<T, 3> result;
-	result[0] = data[0] * vec.data[0] + data[1] * vec.data[0] + data[2] * vec.data[0] + data[3];
-	result[1] = data[4] * vec.data[1] + data[5] * vec.data[1] + data[6] * vec.data[1] + data[7];
-	result[2] = data[8] * vec.data[2] + data[9] * vec.data[2] + data[10] * vec.data[2] + data[11];
+	result[0] = data[0] * point.data[0] + data[1] * point.data[1] + data[2] * point.data[2] + data[3];
+	result[1] = data[4] * point.data[0] + data[5] * point.data[1] + data[6] * point.data[2] + data[7];
+	result[2] = data[8] * point.data[0] + data[9] * point.data[1] + data[10] * point.data[2] + data[11];
 	return result;
 }
 
@@ -1535,6 +1596,18 @@ SquareMatrix<T, 4> RotationZ(float angle)
 	return retMat;
 }
 
+template<typename T>
+Quaternion<T> ToQuaternion(const SquareMatrix<T, 3>& mat)
+{
+	return mat.ToQuaternion();
+}
+
+template<typename T>
+Quaternion<T> ToQuaternion(const SquareMatrix<T, 4>& mat)
+{
+	return mat.ToQuaternion();
+}
+
 template<typename T, std::size_t size>
 T Determinant(const SquareMatrix<T, size>& mat)
 {
@@ -1654,7 +1727,8 @@ template<typename T>
 void interior::SizedMatrixOperator<T>::operator*=(const interior::SizedMatrixOperator<T>& rhs)
 {
 	// Temporarily store results of given row dotted with each column of rhs to work in place
-	T* placeholderRow = new T[rhs.cols];
+	// Comes from the thread's scratch arena if one is installed (see ScopedScratchArena)
+	interior::ScratchBuffer<T> placeholderRow(rhs.cols);
 	for (std::size_t col = 0; col < rhs.cols; ++col)
 	{
 		placeholderRow[col] = 0;
@@ -1677,8 +1751,6 @@ void interior::SizedMatrixOperator<T>::operator*=(const interior::SizedMatrixOpe
 			placeholderRow[col] = 0;
 		}
 	}
-
-	delete[] placeholderRow;
 }
 
 template<typename T>
@@ -1838,7 +1910,8 @@ template<typename T>
 bool interior::SizedSquareMatrixOperator<T>::TryInvert()
 {
 	// Remember which row was swapped with the one at the current index to undo it at the end
-	std::size_t* swappedRows = new std::size_t[rows];
+	// Comes from the thread's scratch arena if one is installed (see ScopedScratchArena)
+	interior::ScratchBuffer<std::size_t> swappedRows(rows);
 	for (std::size_t row = 0; row < rows; ++row)
 	{
 		swappedRows[row] = row;
@@ -1863,7 +1936,6 @@ bool interior::SizedSquareMatrixOperator<T>::TryInvert()
 		// A column must be all zeroes, non-invertible
 		if (Math::IsZero(maxElem))
 		{
-			delete[] swappedRows;
 			return false;
 		}
 
@@ -1923,7 +1995,6 @@ bool interior::SizedSquareMatrixOperator<T>::TryInvert()
 			}
 		}
 	}
-	delete[] swappedRows;
 	return true;
 }
 
@@ -2003,4 +2074,91 @@ T interior::SizedSquareMatrixOperator<T>::Trace() const
 		sum += pData[row * cols + row];
 	}
 	return sum;
-}
\ No newline at end of file
+}
+
+// Interior free function implementations
+template<typename T>
+Quaternion<T> interior::RotationToQuaternion(const T* const mat, std::size_t rowStride)
+{
+	T m00 = mat[0], m01 = mat[1], m02 = mat[2];
+	T m10 = mat[rowStride], m11 = mat[rowStride + 1], m12 = mat[rowStride + 2];
+	T m20 = mat[2 * rowStride], m21 = mat[2 * rowStride + 1], m22 = mat[2 * rowStride + 2];
+
+	// For a unit quaternion these are 4w^2, 4x^2, 4y^2, and 4z^2
+	// Solve for the largest component first and divide by it to find the rest, which avoids dividing by a tiny value
+	T tW = 1 + m00 + m11 + m22;
+	T tX = 1 + m00 - m11 - m22;
+	T tY = 1 - m00 + m11 - m22;
+	T tZ = 1 - m00 - m11 + m22;
+
+	if (tW >= tX && tW >= tY && tW >= tZ)
+	{
+		T k = 0.5f / sqrt(tW);
+		return Quaternion<T>((m21 - m12) * k, (m02 - m20) * k, (m10 - m01) * k, tW * k);
+	}
+	else if (tX >= tY && tX >= tZ)
+	{
+		T k = 0.5f / sqrt(tX);
+		return Quaternion<T>(tX * k, (m01 + m10) * k, (m02 + m20) * k, (m21 - m12) * k);
+	}
+	else if (tY >= tZ)
+	{
+		T k = 0.5f / sqrt(tY);
+		return Quaternion<T>((m01 + m10) * k, tY * k, (m12 + m21) * k, (m02 - m20) * k);
+	}
+	else
+	{
+		T k = 0.5f / sqrt(tZ);
+		return Quaternion<T>((m02 + m20) * k, (m12 + m21) * k, tZ * k, (m10 - m01) * k);
+	}
+}
+
+#if defined(MATH_HAS_SSE4_1) && !defined(MATH_NO_SIMD)
+// float specializations using the SSE kernels (see SimdKernels.h)
+// operator*(SquareMatrix, SquareMatrix) goes through Matrix::operator*=, so float4x4 products use the kernel too
+template<>
+inline Matrix<float, 4, 4>& Matrix<float, 4, 4>::operator*=(const Matrix<float, 4, 4>& rhs)
+{
+	interior::SimdMatrixMultiply4(data.data(), rhs.data.data(), data.data());
+	return *this;
+}
+
+template<>
+inline SquareMatrix<float, 4>& SquareMatrix<float, 4>::Transpose()
+{
+	interior::SimdTranspose4(data.data());
+	return *this;
+}
+
+template<>
+inline Vector<float, 3> SquareMatrix<float, 4>::TransformVec(const Vector<float, 3>& vec) const
+{
+	Vector<float, 3> result;
+	interior::SimdTransform3(data.data(), vec.data.data(), 0.0f, result.data.data());
+	return result;
+}
+
+template<>
+inline Vector<float, 3> SquareMatrix<float, 4>::TransformPoint(const Vector<float, 3>& point) const
+{
+	Vector<float, 3> result;
+	interior::SimdTransform3(data.data(), point.data.data(), 1.0f, result.data.data());
+	return result;
+}
+
+// Column vector product, preferred over the operator* templates for float4x4
+inline Vector<float, 4> operator*(const SquareMatrix<float, 4>& mat, const Vector<float, 4>& vec)
+{
+	Vector<float, 4> retVec;
+	interior::SimdColVecMult4(mat.data.data(), vec.data.data(), retVec.data.data());
+	return retVec;
+}
+
+// Row vector product, preferred over the operator* templates for float4x4
+inline Vector<float, 4> operator*(const Vector<float, 4>& vec, const SquareMatrix<float, 4>& mat)
+{
+	Vector<float, 4> retVec;
+	interior::SimdRowVecMult4(vec.data.data(), mat.data.data(), retVec.data.data());
+	return retVec;
+}
+#endif // MATH_HAS_SSE4_1 && !MATH_NO_SIMD
@@ -0,0 +1,224 @@
+// Defines a typed object pool that hands out generational handles, built on the pool-based allocator
+#pragma once
+#include "PoolAlloc.h"
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+// 32-bit reference to an object in an ObjectPool<T>
+// The low bits are the object's block index in the pool and the high bits the generation of that block when the object
+// was created; destroying the object bumps the block's generation, so every outstanding handle to it goes stale
+// instead of silently pointing at whatever is created there next.
+// A default constructed handle is null and never resolves.
+template <typename T>
+struct ObjectHandle
+{
+	std::uint32_t mValue;
+
+	ObjectHandle()
+		: mValue(0)
+	{}
+	explicit ObjectHandle(std::uint32_t value)
+		: mValue(value)
+	{}
+
+	bool IsNull() const { return mValue == 0; }
+
+	bool operator==(const ObjectHandle& rhs) const { return mValue == rhs.mValue; }
+	bool operator!=(const ObjectHandle& rhs) const { return mValue != rhs.mValue; }
+};
+
+// Defines an Object Pool
+// Templated based on the object type and the number of objects the pool holds.
+//
+// Create constructs a T in place in a PoolAllocator block and returns a handle to it; Destroy runs the destructor
+// and frees the block. Get resolves a handle in O(1) (an index and a generation compare), returning nullptr once the
+// object has been destroyed, so handles are safe to hold across frames where raw pointers are not.
+//
+// Live objects are also tracked in a dense array, so ForEach visits exactly the live objects
+// without scanning free blocks. Destroy swaps the last entry into the hole, so iteration order isn't stable,
+// and objects must not be created or destroyed while a ForEach is running.
+//
+// With capacity blocks, the handle's index takes just enough bits for capacity and the rest hold the generation.
+// A block's generation is bumped on both Create and Destroy, so it is odd exactly while the block is live and a handle
+// (always odd) can only match a live object. It wraps after 2^(generationBits - 1) reuses of one block,
+// so a handle held across that many reuses could resolve again.
+//
+// To define your own pool to be used, it's recommended to typedef as such:
+// typedef ObjectPool<Entity, 4096> EntityPool;
+// Like PoolAllocator, this is not thread safe.
+template <typename T, unsigned int capacity>
+class ObjectPool
+{
+public:
+	typedef ObjectHandle<T> Handle;
+
+	static_assert(capacity > 0 && capacity < (1u << 24), "Capacity must leave at least 8 handle bits for the generation.");
+
+	ObjectPool();
+
+	// The destructor destroys every live object.
+	~ObjectPool();
+
+	ObjectPool(const ObjectPool&) = delete;
+	ObjectPool& operator=(const ObjectPool&) = delete;
+
+	// Construct a T from args and return its handle.
+	//
+	// If the pool is full, it should trigger a DbgAssert and return a null handle.
+	template <typename... Args>
+	Handle Create(Args&&... args);
+
+	// Destroy the object handle refers to.
+	//
+	// It will DbgAssert the handle is valid; stale and null handles are otherwise ignored.
+	void Destroy(Handle handle);
+
+	// Return the object handle refers to, or nullptr if it has been destroyed
+	T* Get(Handle handle);
+	const T* Get(Handle handle) const;
+
+	bool IsValid(Handle handle) const { return Get(handle) != nullptr; }
+
+	// Return the handle of an object in this pool
+	Handle GetHandle(const T* object) const;
+
+	// Number of live objects
+	unsigned int GetCount() const { return mCount; }
+
+	// Call func(T&) on every live object
+	template <typename Func>
+	void ForEach(Func&& func);
+
+	// The i'th live object, i < GetCount(), in the order ForEach visits them
+	T& GetDense(unsigned int i) { return *static_cast<T*>(mPool.GetBlock(mDense[i])); }
+
+protected:
+	static constexpr unsigned int IndexBits(unsigned int count, unsigned int bits = 1) { return (1u << bits) >= count ? bits : IndexBits(count, bits + 1); }
+
+	static const unsigned int kIndexBits = IndexBits(capacity);
+	static const std::uint32_t kIndexMask = (1u << kIndexBits) - 1;
+	// Generations are kept pre-shifted into the handle's high bits
+	static const std::uint32_t kGenerationStep = 1u << kIndexBits;
+
+	// Bookkeeping for each block
+	struct Slot
+	{
+		// Generation in the handle's high bits; odd while the block is live
+		std::uint32_t mGeneration;
+		// Position in mDense while the block is live
+		std::uint32_t mDenseIndex;
+	};
+
+	PoolAllocator<sizeof(T), capacity, (alignof(T) > alignof(void*) ? alignof(T) : alignof(void*))> mPool;
+
+	std::unique_ptr<Slot[]> mSlots;
+	// Block indices of the live objects, packed at the front
+	std::unique_ptr<std::uint32_t[]> mDense;
+	unsigned int mCount;
+};
+
+// IMPLEMENTATIONS for ObjectPool
+
+template <typename T, unsigned int capacity>
+ObjectPool<T, capacity>::ObjectPool()
+	: mSlots(new Slot[capacity])
+	, mDense(new std::uint32_t[capacity])
+	, mCount(0)
+{
+	for (unsigned int i = 0; i < capacity; ++i)
+		mSlots[i].mGeneration = 0;
+}
+
+template <typename T, unsigned int capacity>
+ObjectPool<T, capacity>::~ObjectPool()
+{
+	for (unsigned int i = 0; i < mCount; ++i)
+	{
+		void* block = mPool.GetBlock(mDense[i]);
+		static_cast<T*>(block)->~T();
+		mPool.Free(block);
+	}
+	mCount = 0;
+}
+
+template <typename T, unsigned int capacity>
+template <typename... Args>
+typename ObjectPool<T, capacity>::Handle ObjectPool<T, capacity>::Create(Args&&... args)
+{
+	void* block = mPool.Allocate(sizeof(T));
+	if (block == nullptr)
+		return Handle();
+
+	try
+	{
+		new (block) T(std::forward<Args>(args)...);
+	}
+	catch (...)
+	{
+		mPool.Free(block);
+		throw;
+	}
+
+	std::uint32_t index = mPool.GetBlockIndex(block);
+	mSlots[index].mGeneration += kGenerationStep;
+	mSlots[index].mDenseIndex = mCount;
+	mDense[mCount++] = index;
+	return Handle(mSlots[index].mGeneration | index);
+}
+
+template <typename T, unsigned int capacity>
+void ObjectPool<T, capacity>::Destroy(Handle handle)
+{
+	T* object = Get(handle);
+	DbgAssert(object != nullptr, "Destroying a stale or null handle.");
+	if (object == nullptr)
+		return;
+
+	std::uint32_t index = handle.mValue & kIndexMask;
+	object->~T();
+	mPool.Free(object);
+
+	// Move the last live entry into the hole so the dense array stays packed
+	std::uint32_t denseIndex = mSlots[index].mDenseIndex;
+	std::uint32_t lastIndex = mDense[--mCount];
+	mDense[denseIndex] = lastIndex;
+	mSlots[lastIndex].mDenseIndex = denseIndex;
+
+	// Back to even, staling every handle to this object
+	mSlots[index].mGeneration += kGenerationStep;
+}
+
+template <typename T, unsigned int capacity>
+T* ObjectPool<T, capacity>::Get(Handle handle)
+{
+	return const_cast<T*>(static_cast<const ObjectPool*>(this)->Get(handle));
+}
+
+template <typename T, unsigned int capacity>
+const T* ObjectPool<T, capacity>::Get(Handle handle) const
+{
+	std::uint32_t index = handle.mValue & kIndexMask;
+	// Handles from Create always have odd generations; anything else (i.e. the null handle, whose generation is 0)
+	// could otherwise match a free block's even generation
+	if ((handle.mValue & kGenerationStep) == 0 || index >= capacity || (handle.mValue & ~kIndexMask) != mSlots[index].mGeneration)
+		return nullptr;
+	return static_cast<const T*>(mPool.GetBlock(index));
+}
+
+template <typename T, unsigned int capacity>
+typename ObjectPool<T, capacity>::Handle ObjectPool<T, capacity>::GetHandle(const T* object) const
+{
+	std::uint32_t index = mPool.GetBlockIndex(object);
+	DbgAssert(index < capacity, "Object is not from this pool.");
+	return Handle(mSlots[index].mGeneration | index);
+}
+
+template <typename T, unsigned int capacity>
+template <typename Func>
+void ObjectPool<T, capacity>::ForEach(Func&& func)
+{
+	for (unsigned int i = 0; i < mCount; ++i)
+		func(*static_cast<T*>(mPool.GetBlock(mDense[i])));
+}
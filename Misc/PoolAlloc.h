@@ -1,7 +1,22 @@
 // Defines a pool-based memory allocator, as well as helper structs
 #pragma once
 #include "DbgAssert.h"
+#include "PoolMemory.h"
 #include <memory.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #if _WIN32 && _DEBUG
 #define POOL_ALLOC_DEBUG
@@ -9,43 +24,134 @@
 #define POOL_ALLOC_DEBUG
 #endif
 
+#if defined(POOL_ALLOC_TELEMETRY) || defined(POOL_ALLOC_CHECKED)
+#define POOL_ALLOC_STRINGIZE_INNER(x) #x
+#define POOL_ALLOC_STRINGIZE(x) POOL_ALLOC_STRINGIZE_INNER(x)
+// "file:line" of the call, for Allocate's and Free's callSite argument
+#define POOL_ALLOC_SITE (__FILE__ ":" POOL_ALLOC_STRINGIZE(__LINE__))
+#else
+// Call sites are only used by telemetry and checked frees, so without them they aren't even compiled in
+#define POOL_ALLOC_SITE nullptr
+#endif
+
+#ifdef POOL_ALLOC_TELEMETRY
+#include "PoolTelemetry.h"
+#endif
+
+#ifdef POOL_ALLOC_CHECKED
+// Called when a checked Free is given a pointer it can't take back (error describes why); the free is then skipped,
+// leaving the pool as it was
+typedef void (*PoolCheckHandler)(const char* error, const void* ptr, const char* callSite);
+
+// Replace the handler for every pool; the default prints to stderr and triggers a DbgAssert
+void SetPoolCheckHandler(PoolCheckHandler handler);
+
+namespace interior
+{
+	PoolCheckHandler& CurrentPoolCheckHandler();
+	void DefaultPoolCheckHandler(const char* error, const void* ptr, const char* callSite);
+}
+#endif
+
+namespace interior
+{
+	// fseek and ftell with 64-bit offsets, since a pool image can be bigger than a long can address
+	int SeekFile(FILE* file, std::uint64_t offset, int origin);
+	std::int64_t TellFile(FILE* file);
+	// Flush file's buffered writes and wait until they reach the disk
+	bool SyncFile(FILE* file);
+	// Wait until changes to the entries of path's directory (i.e. a rename onto path) reach the disk
+	bool SyncParentDirectory(const char* path);
+}
+
+// When MaybeTrim should give idle memory back to the OS (see PoolAllocator::Trim)
+struct PoolTrimPolicy
+{
+	// Trim once at least this fraction of the pool's blocks are free
+	float mMinFreeFraction;
+	// and at least this long has passed since the last trim
+	std::chrono::milliseconds mMinInterval;
+	// Decommit with MADV_FREE instead of MADV_DONTNEED
+	bool mLazy;
+};
+
+// Start of a pool snapshot file (see PoolAllocator::SaveSnapshot)
+// It is followed by the untouched runs, then the pool's blocks as one image starting on a page boundary (mImageOffset)
+struct PoolSnapshotHeader
+{
+	// "POOLSNAP"
+	char mMagic[8];
+	std::uint32_t mVersion;
+	// POOL_ALLOC_DEBUG blocks hold a boundary value that release blocks of the same size may not
+	std::uint32_t mDebugBlocks;
+	// The pool's template arguments and the resulting size of each block, which must all match to load
+	std::uint64_t mBlockSize;
+	std::uint64_t mBlockAlignment;
+	std::uint64_t mBlockStride;
+	std::uint32_t mNumBlocks;
+	// Free list state
+	std::uint32_t mFreeList;
+	std::uint32_t mNextUnused;
+	std::uint32_t mUnusedEnd;
+	std::uint32_t mBlocksFree;
+	std::uint32_t mNumUnusedRuns;
+	std::uint64_t mImageOffset;
+};
+
 // Defines a Pool Allocator
-// Templated based on size of block and the number of blocks in the pool.
+// Templated based on size of block, the number of blocks in the pool, and the alignment of each block.
+//
+// The free list is intrusive: a free block's link to the next free block is stored in the block's own (unused) memory,
+// so blocks carry no per-block overhead outside of debug builds and every block starts on an alignment boundary.
+// Links are 32-bit block indices rather than pointers, which keeps blocks as small as 4 bytes usable
+// and keeps the free list meaningful if the pool's memory is copied elsewhere (see SaveSnapshot).
+// The pool belongs to one thread, but any thread may hand a block back with FreeRemote.
+// Use an alignment of 16, 32, or 64 for SIMD types (i.e. SimdMatrix4) or to give each block its own cache line.
+// The pool's memory comes from a MemoryProvider (see PoolMemory.h), the heap by default.
 //
 // To define your own pool to be used, it's recommended to typedef as such:
 // typedef PoolAllocator<256, 1024> ComponentPool;
-//
-// IMPORTANT! StartUp must always be called before starting to use this,
-// and ShutDown must be called once you're done with it. Or bad things happen.
-template <size_t blockSize, unsigned int numBlocks>
+// typedef PoolAllocator<sizeof(SimdMatrix4), 1024, 16> MatrixPool;
+// typedef PoolAllocator<256, 1 << 16, 64, PageMemoryProvider> ParticlePool;
+template <size_t blockSize, unsigned int numBlocks, size_t alignment = alignof(void*), typename MemoryProvider = HeapMemoryProvider>
 class PoolAllocator
 {
 public:
-	// The constructor dynamically allocates the pool on the heap.
+	static_assert(alignment >= alignof(std::uint32_t) && (alignment & (alignment - 1)) == 0, "Alignment must be a power of two that can hold a free list index.");
+	static_assert(numBlocks < 0xFFFFFFFFu, "Block indices must fit in 32 bits with one value left as the empty list marker.");
+
+	// Size of each block, so adapters like PoolStlAllocator can tell which requests fit
+	static const size_t kBlockSize = blockSize;
+	// Alignment of each block
+	static const size_t kBlockAlignment = alignment;
+
+	// The constructor dynamically allocates the pool from the provider.
 	// 
 	// mPool should be allocated to an array with numBlocks elements
-	// Next, initialize the free list and all the mNext pointers in the list.
-	// By default, you want index 0 of the mPool array to point to index 1, and so on.
+	// The free list starts empty and mNextUnused at index 0; no block is touched until it is first allocated,
+	// so construction is O(1) and a pool sized for peak load only makes the pages of blocks actually used resident.
 	// Make sure you update mBlocksFree.
-	//
-	// #ifdef POOL_ALLOC_DEBUG, you should use memset on each mMemory element for each block,
-	// writing the value 0xde over and over. Furthermore, each block should have its
-	// mBoundary variable set to 0xdeadbeef.
-	PoolAllocator();
+	explicit PoolAllocator(const MemoryProvider& provider = MemoryProvider());
 
-	// The destructor should deallocate the mPool array, and set the number of free
+	// The destructor should return the mPool array to the provider, and set the number of free
 	// blocks to 0.
 	~PoolAllocator();
 
 	// Allocate returns a pointer to usable memory within the pool.
 	// 
 	// It will DbgAssert size <= blockSize.
-	// If the size is okay, remove the head PoolBlock from the free list,
+	// If the size is okay, drain any remote frees onto the free list, then remove the head PoolBlock from the free list,
+	// or if the free list is empty take the block at mNextUnused,
 	// and return the pointer to that PoolBlock's mMemory member
 	// Make sure you update mBlocksFree.
 	//
+	// #ifdef POOL_ALLOC_DEBUG, a block handed out for the first time has its mMemory set to 0xde
+	// and its mDbgBoundary to 0xdeadbeef.
+	//
 	// If there are no blocks available, it should trigger a DbgAssert and return nullptr.
-	void* Allocate(size_t size);
+	//
+	// #ifdef POOL_ALLOC_TELEMETRY, the allocation is attributed to callSite (i.e. POOL_ALLOC_SITE) if one is given.
+	void* Allocate(size_t size, const char* callSite = nullptr);
 
 	// Free should first cast the given pointer to a PoolBlock pointer, and then add
 	// the block back to the front of the free list.
@@ -57,102 +163,289 @@ public:
 	//
 	// Note that it's not straightforward to verify that the pointer actually belongs in the
 	// pool, so don't call this on random pointers!
-	void Free(void* ptr);
+	//
+	// #ifdef POOL_ALLOC_CHECKED, it is verified: bad pointers and double frees are reported to the PoolCheckHandler
+	// along with callSite (i.e. POOL_ALLOC_SITE) and then ignored. The checks are a range compare, a modulo, and one bit
+	// per block, so unlike POOL_ALLOC_DEBUG they are cheap enough for release builds.
+	void Free(void* ptr, const char* callSite = nullptr);
+
+	// FreeRemote returns a block to the pool from a thread other than the owner; it's safe to call from any number
+	// of threads at once, concurrently with the owner's calls.
+	//
+	// The block is pushed onto a lock-free stack (many producers, with the owner as the only consumer), so producer/consumer
+	// pipelines need no lock on the pool. It only becomes allocatable (and counted by GetNumBlocksFree)
+	// once the owning thread drains that stack, which Allocate, AllocateBatch, GetNumBlocksFree, and the trims all do first.
+	// Same checks and caveats as Free.
+	void FreeRemote(void* ptr, const char* callSite = nullptr);
 
-	// Returns the number of blocks free in the pool
-	unsigned int GetNumBlocksFree() { return mBlocksFree; }
+	// AllocateBatch fills blocks with up to count pointers to usable memory within the pool, and returns how many it filled.
+	//
+	// Blocks come off the front of the free list first and then in address order from the untouched runs,
+	// and mBlocksFree is only updated once, so spawning many objects at once is cheaper than count calls to Allocate.
+	//
+	// It will DbgAssert size <= blockSize and that count blocks are available; if fewer are, it fills as many as it can.
+	unsigned int AllocateBatch(size_t size, void** blocks, unsigned int count, const char* callSite = nullptr);
+
+	// FreeBatch returns count blocks to the pool at once.
+	//
+	// The blocks are linked to each other in order and the chain is spliced onto the front of the free list,
+	// so the next AllocateBatch hands them back in the same order.
+	// Same checks and caveats as Free.
+	void FreeBatch(void* const* blocks, unsigned int count, const char* callSite = nullptr);
+
+	// Trim gives the memory of free blocks back to the OS while keeping them allocatable, and returns the bytes released.
+	//
+	// Each run of consecutive free blocks (on the free list or untouched) has the whole pages inside it decommitted
+	// through the provider (MADV_FREE if lazy, MADV_DONTNEED otherwise). The blocks on those pages become untouched runs
+	// again, handed out like the tail was before it was first used; the rest of the free blocks are relinked in address
+	// order, so the free list also comes out sorted. Pages the provider can't decommit (i.e. heap memory on platforms
+	// without madvise) are left resident and aren't counted.
+	//
+	// It walks the free list and one bit per block, so call it when the pool goes idle (i.e. after a wave ends),
+	// not every frame.
+	size_t Trim(bool lazy = false);
+
+	// MaybeTrim calls Trim if policy says it's time, and returns the bytes released.
+	// The pool isn't thread safe, so a background thread can't trim it directly; call this from the owner's
+	// idle time or periodic tick instead.
+	size_t MaybeTrim(const PoolTrimPolicy& policy);
+
+	// SaveSnapshot writes every block (allocated or not) and the free list state to path, and returns whether it succeeded.
+	//
+	// Remote frees are drained first. The file is written next to path, synced to disk, and renamed over it at the end,
+	// so a crash or power loss mid-save leaves the previous snapshot intact, and a pool that was loaded by mapping path
+	// can be saved back to it.
+	// Snapshots suit objects that are plain data whose references to each other are block indices (see GetBlockIndex)
+	// rather than pointers, since the pool's address changes between save and load.
+	bool SaveSnapshot(const char* path);
+
+	// LoadSnapshot replaces the pool's entire contents with a snapshot from SaveSnapshot, and returns whether it succeeded.
+	// Every block allocated before the call is lost; blocks allocated in the snapshot are allocated afterwards,
+	// at the same indices.
+	//
+	// The image is mapped copy-on-write if the provider can (see MemoryProvider::MapFile), otherwise read in.
+	// It returns false, leaving the pool as it was, if path is missing or was saved by a pool with different template
+	// arguments or debug setting (so callers just cold start), or if its untouched runs are out of range.
+	// If reading the image itself fails, or its free list is inconsistent (links outside the pool, loops, or a count that
+	// doesn't match), the pool is left empty.
+	//
+	// #ifdef POOL_ALLOC_CHECKED, the allocated bits are rebuilt from the free list.
+	// #ifdef POOL_ALLOC_TELEMETRY, the blocks it replaces are counted as frees and the loaded ones as unattributed allocations.
+	bool LoadSnapshot(const char* path);
+
+	// Returns the number of blocks free in the pool, including any freed remotely (which it drains first)
+	unsigned int GetNumBlocksFree()
+	{
+		DrainRemoteFrees();
+		return mBlocksFree;
+	}
+
+	// Returns the index of the block containing ptr, which must have come from this pool
+	unsigned int GetBlockIndex(const void* ptr) const { return static_cast<unsigned int>(static_cast<const PoolBlock*>(ptr) - mPool); }
+
+	// Returns the block at index, whether or not it is allocated
+	void* GetBlock(unsigned int index) { return &mPool[index]; }
+	const void* GetBlock(unsigned int index) const { return &mPool[index]; }
+
+#ifdef POOL_ALLOC_TELEMETRY
+	// Returns a copy of the pool's usage counters (usage, failures, and allocations per call site, see PoolTelemetry.h);
+	// safe to call from any thread
+	PoolTelemetrySnapshot GetTelemetry() const { return mTelemetry.Snapshot(blockSize, numBlocks); }
+
+	// Start tracking the peak usage again from the current usage
+	void ResetTelemetryPeak() { mTelemetry.ResetPeak(); }
+#endif
 
 protected:
+	// Index used as the free list's null link
+	static const std::uint32_t kEmptyIndex = 0xFFFFFFFFu;
+
 	// PoolBlock is a structure that we use as the building block for the pool-based allocator.
-	// Notice that the size of mMemory is based on the PoolAllocator's block size
-	struct PoolBlock
+	// Notice that the size of mMemory is based on the PoolAllocator's block size,
+	// and that the whole block is padded out to a multiple of the alignment
+	struct alignas(alignment) PoolBlock
 	{
-		// This is the actual memory that the caller will be writing to.
-		char mMemory[blockSize];
+		union
+		{
+			// This is the actual memory that the caller will be writing to.
+			// It always has room for the free list index, even if blockSize is smaller
+			char mMemory[blockSize < sizeof(std::uint32_t) ? sizeof(std::uint32_t) : blockSize];
+
+			// Index of the next block in the free list, only meaningful while the block is free
+			std::uint32_t mNext;
+		};
 
 	#ifdef POOL_ALLOC_DEBUG
 		// This boundary value is used to help find instances where memory is being written
 		// beyond the mMemory array.
 		unsigned int mDbgBoundary;
 	#endif
-
-		// Pointer to the next block in the free list.
-		PoolBlock* mNext;
-
-		PoolBlock()
-		{
-			mNext = nullptr;
-		}
 	};
 	
+	// Where mPool's memory came from
+	MemoryProvider mProvider;
+
 	// This pointer will point to the array of all blocks
 	PoolBlock* mPool;
 	
-	// This pointer represents the free list. Initially points to element at index 0,
-	// but later updates like a forward linked list
-	PoolBlock* mFreeList;
+	// This index represents the free list of blocks that have been freed. Initially empty,
+	// and updated like a forward linked list
+	std::uint32_t mFreeList;
+
+	// Untouched blocks (never allocated, or decommitted by Trim) are handed out in order from [mNextUnused, mUnusedEnd).
+	// Initially that is the whole pool.
+	std::uint32_t mNextUnused;
+	std::uint32_t mUnusedEnd;
+
+	// Index range of untouched blocks
+	struct UnusedRun
+	{
+		std::uint32_t mBegin;
+		std::uint32_t mEnd;
+	};
+	// More untouched runs left by Trim, used once [mNextUnused, mUnusedEnd) is exhausted; the lowest run is at the back
+	std::vector<UnusedRun> mUnusedRuns;
+
+	// Return the next untouched block, moving on to the next run if the current one is used up
+	PoolBlock* TakeUnusedBlock();
+
+	// Return one bit per block, set for every free block whether it is linked or untouched
+	std::vector<std::uint64_t> GetFreeBits() const;
+
+	// Return a snapshot header describing this pool type, with the free list state left zero
+	static PoolSnapshotHeader MakeSnapshotHeader();
+
+	// Make every block untouched, as after construction
+	void ResetToEmpty();
+
+	// Return whether the free list and untouched runs are in range, don't overlap, and add up to mBlocksFree,
+	// so state read from a file can be trusted before any block is indexed through it
+	bool IsFreeStateValid() const;
+
+	// When MaybeTrim last trimmed
+	std::chrono::steady_clock::time_point mLastTrim;
 
 	// This keeps track of how many blocks are left in the pool
 	unsigned int mBlocksFree;
+
+	// Head index of the blocks freed by other threads, pushed with compare-and-swap and taken all at once by the owner.
+	// Taking the whole stack rather than popping blocks means there is no ABA problem to guard against.
+	// Kept on its own cache line so remote frees don't slow down the owner's use of the fields above.
+	alignas(64) std::atomic<std::uint32_t> mRemoteFreeList;
+
+	// Move every remotely freed block onto the free list
+	void DrainRemoteFrees();
+
+#ifdef POOL_ALLOC_TELEMETRY
+	PoolTelemetry mTelemetry;
+#endif
+
+#ifdef POOL_ALLOC_CHECKED
+	// One bit per block, set while it is allocated
+	// Atomic since FreeRemote clears bits from other threads; the owner's updates are uncontended
+	static const unsigned int kBitmapWords = (numBlocks + 63) / 64;
+	std::atomic<std::uint64_t>* mAllocatedBits;
+
+	void MarkAllocated(PoolBlock* block)
+	{
+		std::uint32_t index = static_cast<std::uint32_t>(block - mPool);
+		mAllocatedBits[index / 64].fetch_or(std::uint64_t(1) << (index % 64), std::memory_order_relaxed);
+	}
+
+	// Return whether ptr is an allocated block of this pool and mark it free; otherwise report it and return false
+	// Safe to call from any thread
+	bool CheckFree(void* ptr, const char* callSite);
+#endif
 };
 
 // IMPLEMENTATIONS for PoolAllocator
 
-// The constructor dynamically allocates the pool on the heap.
+// The constructor dynamically allocates the pool from the provider.
 // 
 // mPool should be allocated to an array with numBlocks elements
-// Next, initialize the free list and all the mNext pointers in the list.
-// By default, you want index 0 of the mPool array to point to index 1, and so on.
+// The free list starts empty and mNextUnused at index 0; no block is touched until it is first allocated,
+// so construction is O(1) and a pool sized for peak load only makes the pages of blocks actually used resident.
 // Make sure you update mBlocksFree.
-//
-// #ifdef POOL_ALLOC_DEBUG, you should use memset on each mMemory element for each block,
-// writing the value 0xde over and over. Furthermore, each block should have its
-// mBoundary variable set to 0xdeadbeef.
-template <size_t blockSize, unsigned int numBlocks>
-PoolAllocator<blockSize, numBlocks>::PoolAllocator()
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::PoolAllocator(const MemoryProvider& provider)
+	: mProvider(provider)
 {
-	mPool = new PoolBlock[numBlocks];
-	mFreeList = mPool;
-	for (int i = 0; i < numBlocks - 1; ++i)
-		mPool[i].mNext = &mPool[i + 1];
+	// PoolBlock is trivial, so the raw memory can be used as the array directly
+	mPool = static_cast<PoolBlock*>(mProvider.Allocate(sizeof(PoolBlock) * numBlocks, alignof(PoolBlock)));
+	mFreeList = kEmptyIndex;
+	mNextUnused = 0;
+	mUnusedEnd = numBlocks;
 	mBlocksFree = numBlocks;
-	#ifdef POOL_ALLOC_DEBUG
-	for (int i = 0; i < numBlocks; ++i)
-	{
-		memset(mPool[i].mMemory, 0xde, blockSize);
-		mPool[i].mDbgBoundary = 0xdeadbeef;
-	}
+	mLastTrim = std::chrono::steady_clock::now();
+	mRemoteFreeList.store(kEmptyIndex, std::memory_order_relaxed);
+	#ifdef POOL_ALLOC_CHECKED
+	mAllocatedBits = new std::atomic<std::uint64_t>[kBitmapWords];
+	for (unsigned int i = 0; i < kBitmapWords; ++i)
+		mAllocatedBits[i].store(0, std::memory_order_relaxed);
 	#endif
 }
 
-// The destructor should deallocate the mPool array, and set the number of free
+// The destructor should return the mPool array to the provider, and set the number of free
 // blocks to 0.
-template <size_t blockSize, unsigned int numBlocks>
-PoolAllocator<blockSize, numBlocks>::~PoolAllocator()
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::~PoolAllocator()
 {
-	delete[] mPool;
+	mProvider.Release(mPool, sizeof(PoolBlock) * numBlocks, alignof(PoolBlock));
 	mBlocksFree = 0;
+	#ifdef POOL_ALLOC_CHECKED
+	delete[] mAllocatedBits;
+	#endif
 }
 
 // Allocate returns a pointer to usable memory within the pool.
 // 
 // It will DbgAssert size <= blockSize.
-// If the size is okay, remove the head PoolBlock from the free list,
+// If the size is okay, drain any remote frees onto the free list, then remove the head PoolBlock from the free list,
+// or if the free list is empty take the block at mNextUnused,
 // and return the pointer to that PoolBlock's mMemory member
 // Make sure you update mBlocksFree.
 //
+// #ifdef POOL_ALLOC_DEBUG, a block handed out for the first time has its mMemory set to 0xde
+// and its mDbgBoundary to 0xdeadbeef.
+//
 // If there are no blocks available, it should trigger a DbgAssert and return nullptr.
-template <size_t blockSize, unsigned int numBlocks>
-void* PoolAllocator<blockSize, numBlocks>::Allocate(size_t size)
+//
+// #ifdef POOL_ALLOC_TELEMETRY, the allocation is attributed to callSite (i.e. POOL_ALLOC_SITE) if one is given.
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+void* PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::Allocate(size_t size, const char* callSite)
 {
 	DbgAssert(size <= blockSize, "Allocation request is bigger than block.");
-	DbgAssert(mFreeList != nullptr, "No memory blocks available.");
-	if (size > blockSize || mFreeList == nullptr)
+	// Drain every time rather than only once the free list runs dry, so remotely freed blocks are counted and reused
+	// promptly instead of piling up behind a free list that never empties; with nothing to drain it's one relaxed load
+	DrainRemoteFrees();
+	DbgAssert(mBlocksFree > 0, "No memory blocks available.");
+	if (size > blockSize || mBlocksFree == 0)
+	{
+		#ifdef POOL_ALLOC_TELEMETRY
+		mTelemetry.OnFailedAllocate();
+		#endif
 		return nullptr;
+	}
 
-	PoolBlock* temp = mFreeList;
-	mFreeList = mFreeList->mNext;
+	PoolBlock* temp;
+	if (mFreeList != kEmptyIndex)
+	{
+		temp = &mPool[mFreeList];
+		mFreeList = temp->mNext;
+	}
+	else
+	{
+		temp = TakeUnusedBlock();
+	}
 	--mBlocksFree;
+	#ifdef POOL_ALLOC_CHECKED
+	MarkAllocated(temp);
+	#endif
+	#ifdef POOL_ALLOC_TELEMETRY
+	mTelemetry.OnAllocate(callSite);
+	#else
+	(void)callSite;
+	#endif
 	return temp;
 }
 
@@ -166,15 +459,626 @@ void* PoolAllocator<blockSize, numBlocks>::Allocate(size_t size)
 //
 // Note that it's not straightforward to verify that the pointer actually belongs in the
 // pool, so don't call this on random pointers!
-template <size_t blockSize, unsigned int numBlocks>
-void PoolAllocator<blockSize, numBlocks>::Free(void* ptr)
+//
+// #ifdef POOL_ALLOC_CHECKED, it is verified: bad pointers and double frees are reported to the PoolCheckHandler
+// along with callSite (i.e. POOL_ALLOC_SITE) and then ignored. The checks are a range compare, a modulo, and one bit
+// per block, so unlike POOL_ALLOC_DEBUG they are cheap enough for release builds.
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+void PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::Free(void* ptr, const char* callSite)
 {
+	#ifdef POOL_ALLOC_CHECKED
+	if (!CheckFree(ptr, callSite))
+		return;
+	#else
+	(void)callSite;
+	#endif
 	PoolBlock* tempPoolBlock = (PoolBlock*)ptr;
+	#ifdef POOL_ALLOC_DEBUG
+	DbgAssert(tempPoolBlock->mDbgBoundary == 0xdeadbeef, "Bounds were overwritten.");
+	// Fill before the link is written so the link survives
+	memset(tempPoolBlock->mMemory, 0xde, sizeof(tempPoolBlock->mMemory));
+	#endif
 	tempPoolBlock->mNext = mFreeList;
-	mFreeList = tempPoolBlock;
+	mFreeList = static_cast<std::uint32_t>(tempPoolBlock - mPool);
 	++mBlocksFree;
+	#ifdef POOL_ALLOC_TELEMETRY
+	mTelemetry.OnFree();
+	#endif
+}
+
+// FreeRemote returns a block to the pool from a thread other than the owner; it's safe to call from any number
+// of threads at once, concurrently with the owner's calls.
+//
+// The block is pushed onto a lock-free stack (many producers, with the owner as the only consumer), so producer/consumer
+// pipelines need no lock on the pool. It only becomes allocatable (and counted by GetNumBlocksFree)
+// once the owning thread drains that stack, which Allocate, AllocateBatch, GetNumBlocksFree, and the trims all do first.
+// Same checks and caveats as Free.
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+void PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::FreeRemote(void* ptr, const char* callSite)
+{
+	#ifdef POOL_ALLOC_CHECKED
+	if (!CheckFree(ptr, callSite))
+		return;
+	#else
+	(void)callSite;
+	#endif
+	PoolBlock* tempPoolBlock = (PoolBlock*)ptr;
 	#ifdef POOL_ALLOC_DEBUG
 	DbgAssert(tempPoolBlock->mDbgBoundary == 0xdeadbeef, "Bounds were overwritten.");
-	memset(tempPoolBlock, 0xde, blockSize);
+	memset(tempPoolBlock->mMemory, 0xde, sizeof(tempPoolBlock->mMemory));
 	#endif
+
+	std::uint32_t index = static_cast<std::uint32_t>(tempPoolBlock - mPool);
+	std::uint32_t head = mRemoteFreeList.load(std::memory_order_relaxed);
+	do
+	{
+		tempPoolBlock->mNext = head;
+		// Release publishes the link and any debug fill to the owner's drain
+	} while (!mRemoteFreeList.compare_exchange_weak(head, index, std::memory_order_release, std::memory_order_relaxed));
+}
+
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+void PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::DrainRemoteFrees()
+{
+	// Relaxed load first so the common case (nothing freed remotely) doesn't pay for an atomic exchange
+	if (mRemoteFreeList.load(std::memory_order_relaxed) == kEmptyIndex)
+		return;
+	std::uint32_t head = mRemoteFreeList.exchange(kEmptyIndex, std::memory_order_acquire);
+
+	// Walk to the tail to count the blocks, then splice the whole stack onto the front of the free list
+	unsigned int count = 1;
+	std::uint32_t tail = head;
+	while (mPool[tail].mNext != kEmptyIndex)
+	{
+		tail = mPool[tail].mNext;
+		++count;
+	}
+	mPool[tail].mNext = mFreeList;
+	mFreeList = head;
+	mBlocksFree += count;
+	#ifdef POOL_ALLOC_TELEMETRY
+	mTelemetry.OnFree(count);
+	#endif
+}
+
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+typename PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::PoolBlock* PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::TakeUnusedBlock()
+{
+	if (mNextUnused == mUnusedEnd)
+	{
+		DbgAssert(!mUnusedRuns.empty(), "No untouched blocks left.");
+		mNextUnused = mUnusedRuns.back().mBegin;
+		mUnusedEnd = mUnusedRuns.back().mEnd;
+		mUnusedRuns.pop_back();
+	}
+	PoolBlock* temp = &mPool[mNextUnused++];
+	#ifdef POOL_ALLOC_DEBUG
+	memset(temp->mMemory, 0xde, sizeof(temp->mMemory));
+	temp->mDbgBoundary = 0xdeadbeef;
+	#endif
+	return temp;
+}
+
+// AllocateBatch fills blocks with up to count pointers to usable memory within the pool, and returns how many it filled.
+//
+// Blocks come off the front of the free list first and then in address order from the untouched runs,
+// and mBlocksFree is only updated once, so spawning many objects at once is cheaper than count calls to Allocate.
+//
+// It will DbgAssert size <= blockSize and that count blocks are available; if fewer are, it fills as many as it can.
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+unsigned int PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::AllocateBatch(size_t size, void** blocks, unsigned int count, const char* callSite)
+{
+	DbgAssert(size <= blockSize, "Allocation request is bigger than block.");
+	DrainRemoteFrees();
+	DbgAssert(count <= mBlocksFree, "Not enough memory blocks available.");
+	if (size > blockSize)
+	{
+		#ifdef POOL_ALLOC_TELEMETRY
+		mTelemetry.OnFailedAllocate();
+		#endif
+		return 0;
+	}
+	if (count > mBlocksFree)
+		count = mBlocksFree;
+
+	unsigned int filled = 0;
+	std::uint32_t index = mFreeList;
+	while (filled < count && index != kEmptyIndex)
+	{
+		#ifdef POOL_ALLOC_CHECKED
+		MarkAllocated(&mPool[index]);
+		#endif
+		blocks[filled++] = &mPool[index];
+		index = mPool[index].mNext;
+	}
+	mFreeList = index;
+
+	// Whatever is left comes from the untouched runs, which mBlocksFree guarantees have room
+	while (filled < count)
+	{
+		PoolBlock* temp = TakeUnusedBlock();
+		#ifdef POOL_ALLOC_CHECKED
+		MarkAllocated(temp);
+		#endif
+		blocks[filled++] = temp;
+	}
+
+	mBlocksFree -= count;
+	#ifdef POOL_ALLOC_TELEMETRY
+	if (count > 0)
+		mTelemetry.OnAllocate(callSite, count);
+	#else
+	(void)callSite;
+	#endif
+	return count;
+}
+
+// FreeBatch returns count blocks to the pool at once.
+//
+// The blocks are linked to each other in order and the chain is spliced onto the front of the free list,
+// so the next AllocateBatch hands them back in the same order.
+// Same checks and caveats as Free.
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+void PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::FreeBatch(void* const* blocks, unsigned int count, const char* callSite)
+{
+	(void)callSite;
+	// Link back to front so each block points at the one after it and the last at the old head
+	std::uint32_t next = mFreeList;
+	for (unsigned int i = count; i-- > 0;)
+	{
+		#ifdef POOL_ALLOC_CHECKED
+		// Rejected blocks are left out of the chain
+		if (!CheckFree(blocks[i], callSite))
+		{
+			--count;
+			continue;
+		}
+		#endif
+		PoolBlock* tempPoolBlock = (PoolBlock*)blocks[i];
+		#ifdef POOL_ALLOC_DEBUG
+		DbgAssert(tempPoolBlock->mDbgBoundary == 0xdeadbeef, "Bounds were overwritten.");
+		memset(tempPoolBlock->mMemory, 0xde, sizeof(tempPoolBlock->mMemory));
+		#endif
+		tempPoolBlock->mNext = next;
+		next = static_cast<std::uint32_t>(tempPoolBlock - mPool);
+	}
+	mFreeList = next;
+	mBlocksFree += count;
+	#ifdef POOL_ALLOC_TELEMETRY
+	if (count > 0)
+		mTelemetry.OnFree(count);
+	#endif
+}
+
+#ifdef POOL_ALLOC_CHECKED
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+bool PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::CheckFree(void* ptr, const char* callSite)
+{
+	// Compare as integers; comparing pointers into different arrays is unspecified
+	std::uintptr_t offset = reinterpret_cast<std::uintptr_t>(ptr) - reinterpret_cast<std::uintptr_t>(mPool);
+	// A pointer below mPool wraps around to a huge offset, so one compare covers both ends
+	if (offset >= sizeof(PoolBlock) * numBlocks)
+	{
+		interior::CurrentPoolCheckHandler()("Freed pointer is not from this pool.", ptr, callSite);
+		return false;
+	}
+	if (offset % sizeof(PoolBlock) != 0)
+	{
+		interior::CurrentPoolCheckHandler()("Freed pointer is not the start of a block.", ptr, callSite);
+		return false;
+	}
+
+	std::uint32_t index = static_cast<std::uint32_t>(offset / sizeof(PoolBlock));
+	std::uint64_t bit = std::uint64_t(1) << (index % 64);
+	// Clearing and testing in one step means two threads freeing the same block can't both succeed
+	if ((mAllocatedBits[index / 64].fetch_and(~bit, std::memory_order_relaxed) & bit) == 0)
+	{
+		interior::CurrentPoolCheckHandler()("Freed block is not allocated (double free).", ptr, callSite);
+		return false;
+	}
+	return true;
+}
+
+// IMPLEMENTATIONS for PoolCheckHandler
+
+inline void SetPoolCheckHandler(PoolCheckHandler handler)
+{
+	interior::CurrentPoolCheckHandler() = handler != nullptr ? handler : &interior::DefaultPoolCheckHandler;
+}
+
+inline PoolCheckHandler& interior::CurrentPoolCheckHandler()
+{
+	static PoolCheckHandler sHandler = &DefaultPoolCheckHandler;
+	return sHandler;
+}
+
+inline void interior::DefaultPoolCheckHandler(const char* error, const void* ptr, const char* callSite)
+{
+	fprintf(stderr, "PoolAllocator: %s ptr=%p site=%s\n", error, ptr, callSite != nullptr ? callSite : "unknown");
+	DbgAssert(false, error);
+}
+#endif
+
+// Trim gives the memory of free blocks back to the OS while keeping them allocatable, and returns the bytes released.
+//
+// Each run of consecutive free blocks (on the free list or untouched) has the whole pages inside it decommitted
+// through the provider (MADV_FREE if lazy, MADV_DONTNEED otherwise). The blocks on those pages become untouched runs
+// again, handed out like the tail was before it was first used; the rest of the free blocks are relinked in address
+// order, so the free list also comes out sorted. Pages the provider can't decommit (i.e. heap memory on platforms
+// without madvise) are left resident and aren't counted.
+//
+// It walks the free list and one bit per block, so call it when the pool goes idle (i.e. after a wave ends),
+// not every frame.
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+size_t PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::Trim(bool lazy)
+{
+	DrainRemoteFrees();
+	std::vector<std::uint64_t> freeBits = GetFreeBits();
+
+	// Rebuild the free list and runs from scratch, linking in address order
+	mFreeList = kEmptyIndex;
+	std::uint32_t* link = &mFreeList;
+	auto linkBlock = [this, &link](std::uint32_t index)
+	{
+		#ifdef POOL_ALLOC_DEBUG
+		// Blocks that were untouched have never been filled
+		memset(mPool[index].mMemory + sizeof(std::uint32_t), 0xde, sizeof(mPool[index].mMemory) - sizeof(std::uint32_t));
+		mPool[index].mDbgBoundary = 0xdeadbeef;
+		#endif
+		*link = index;
+		link = &mPool[index].mNext;
+	};
+	mNextUnused = 0;
+	mUnusedEnd = 0;
+	mUnusedRuns.clear();
+
+	const size_t pageBytes = mProvider.GetPageBytes();
+	const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(mPool);
+	size_t releasedBytes = 0;
+	std::uint32_t begin = 0;
+	while (begin < numBlocks)
+	{
+		// Find the next run of free blocks [begin, end)
+		if ((freeBits[begin / 64] >> (begin % 64) & 1) == 0)
+		{
+			++begin;
+			continue;
+		}
+		std::uint32_t end = begin + 1;
+		while (end < numBlocks && (freeBits[end / 64] >> (end % 64) & 1) != 0)
+			++end;
+
+		// Whole pages inside the run
+		std::uintptr_t pageBegin = (base + begin * sizeof(PoolBlock) + pageBytes - 1) / pageBytes * pageBytes;
+		std::uintptr_t pageEnd = (base + end * sizeof(PoolBlock)) / pageBytes * pageBytes;
+		// Blocks overlapping those pages become an untouched run; the ones around them stay linked
+		std::uint32_t runBegin = end;
+		std::uint32_t runEnd = end;
+		// If the provider couldn't decommit them, the pages keep their memory and the blocks stay linked
+		if (pageEnd > pageBegin && mProvider.Decommit(reinterpret_cast<void*>(pageBegin), pageEnd - pageBegin, lazy))
+		{
+			releasedBytes += pageEnd - pageBegin;
+			runBegin = static_cast<std::uint32_t>((pageBegin - base) / sizeof(PoolBlock));
+			runEnd = static_cast<std::uint32_t>((pageEnd - base + sizeof(PoolBlock) - 1) / sizeof(PoolBlock));
+			mUnusedRuns.push_back({ runBegin, runEnd });
+		}
+		for (std::uint32_t index = begin; index < runBegin; ++index)
+			linkBlock(index);
+		for (std::uint32_t index = runEnd; index < end; ++index)
+			linkBlock(index);
+		begin = end;
+	}
+	*link = kEmptyIndex;
+
+	// Runs were found in address order; hand out the lowest first so live blocks stay packed toward the start
+	std::reverse(mUnusedRuns.begin(), mUnusedRuns.end());
+	mLastTrim = std::chrono::steady_clock::now();
+	return releasedBytes;
+}
+
+// Return one bit per block, set for every free block whether it is linked or untouched
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+std::vector<std::uint64_t> PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::GetFreeBits() const
+{
+	std::vector<std::uint64_t> freeBits((numBlocks + 63) / 64, 0);
+	auto markRange = [&freeBits](std::uint32_t begin, std::uint32_t end)
+	{
+		for (std::uint32_t i = begin; i < end;)
+		{
+			// Whole words at a time where possible, since untouched runs can be long
+			if (i % 64 == 0 && end - i >= 64)
+			{
+				freeBits[i / 64] = ~std::uint64_t(0);
+				i += 64;
+			}
+			else
+			{
+				freeBits[i / 64] |= std::uint64_t(1) << (i % 64);
+				++i;
+			}
+		}
+	};
+	for (std::uint32_t index = mFreeList; index != kEmptyIndex; index = mPool[index].mNext)
+		freeBits[index / 64] |= std::uint64_t(1) << (index % 64);
+	markRange(mNextUnused, mUnusedEnd);
+	for (const UnusedRun& run : mUnusedRuns)
+		markRange(run.mBegin, run.mEnd);
+	return freeBits;
+}
+
+// MaybeTrim calls Trim if policy says it's time, and returns the bytes released.
+// The pool isn't thread safe, so a background thread can't trim it directly; call this from the owner's
+// idle time or periodic tick instead.
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+size_t PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::MaybeTrim(const PoolTrimPolicy& policy)
+{
+	// Remote frees count toward the free fraction
+	DrainRemoteFrees();
+	if (mBlocksFree < policy.mMinFreeFraction * numBlocks)
+		return 0;
+	if (std::chrono::steady_clock::now() - mLastTrim < policy.mMinInterval)
+		return 0;
+	return Trim(policy.mLazy);
+}
+
+// SaveSnapshot writes every block (allocated or not) and the free list state to path, and returns whether it succeeded.
+//
+// Remote frees are drained first. The file is written next to path, synced to disk, and renamed over it at the end,
+// so a crash or power loss mid-save leaves the previous snapshot intact, and a pool that was loaded by mapping path
+// can be saved back to it.
+// Snapshots suit objects that are plain data whose references to each other are block indices (see GetBlockIndex)
+// rather than pointers, since the pool's address changes between save and load.
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+bool PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::SaveSnapshot(const char* path)
+{
+	DrainRemoteFrees();
+
+	PoolSnapshotHeader header = MakeSnapshotHeader();
+	header.mFreeList = mFreeList;
+	header.mNextUnused = mNextUnused;
+	header.mUnusedEnd = mUnusedEnd;
+	header.mBlocksFree = mBlocksFree;
+	header.mNumUnusedRuns = static_cast<std::uint32_t>(mUnusedRuns.size());
+	// The image starts on a page boundary so LoadSnapshot can map it straight from the file
+	size_t pageBytes = interior::SystemPageBytes();
+	size_t headerBytes = sizeof(header) + mUnusedRuns.size() * sizeof(UnusedRun);
+	header.mImageOffset = (headerBytes + pageBytes - 1) / pageBytes * pageBytes;
+
+	// Never write into path itself: if this pool was loaded from it, its unmodified pages are still read from that file
+	std::string tempPath = std::string(path) + ".tmp";
+	FILE* file = fopen(tempPath.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& (mUnusedRuns.empty() || fwrite(mUnusedRuns.data(), sizeof(UnusedRun), mUnusedRuns.size(), file) == mUnusedRuns.size())
+		&& interior::SeekFile(file, header.mImageOffset, SEEK_SET) == 0
+		&& fwrite(mPool, sizeof(PoolBlock), numBlocks, file) == numBlocks
+		// The data must be on disk before the rename is, or a crash could leave path naming a partly written file
+		&& interior::SyncFile(file);
+	written = fclose(file) == 0 && written;
+
+	if (!written || rename(tempPath.c_str(), path) != 0)
+	{
+		remove(tempPath.c_str());
+		return false;
+	}
+	// Make the rename itself durable
+	return interior::SyncParentDirectory(path);
+}
+
+// LoadSnapshot replaces the pool's entire contents with a snapshot from SaveSnapshot, and returns whether it succeeded.
+// Every block allocated before the call is lost; blocks allocated in the snapshot are allocated afterwards,
+// at the same indices.
+//
+// The image is mapped copy-on-write if the provider can (see MemoryProvider::MapFile), otherwise read in.
+// It returns false, leaving the pool as it was, if path is missing or was saved by a pool with different template
+// arguments or debug setting (so callers just cold start), or if its untouched runs are out of range.
+// If reading the image itself fails, or its free list is inconsistent (links outside the pool, loops, or a count that
+// doesn't match), the pool is left empty.
+//
+// #ifdef POOL_ALLOC_CHECKED, the allocated bits are rebuilt from the free list.
+// #ifdef POOL_ALLOC_TELEMETRY, the blocks it replaces are counted as frees and the loaded ones as unattributed allocations.
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+bool PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::LoadSnapshot(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == nullptr)
+		return false;
+
+	const size_t imageBytes = sizeof(PoolBlock) * numBlocks;
+	PoolSnapshotHeader header;
+	PoolSnapshotHeader expected = MakeSnapshotHeader();
+	bool valid = fread(&header, sizeof(header), 1, file) == 1
+		&& memcmp(header.mMagic, expected.mMagic, sizeof(header.mMagic)) == 0
+		&& header.mVersion == expected.mVersion
+		&& header.mDebugBlocks == expected.mDebugBlocks
+		&& header.mBlockSize == expected.mBlockSize
+		&& header.mBlockAlignment == expected.mBlockAlignment
+		&& header.mBlockStride == expected.mBlockStride
+		&& header.mNumBlocks == expected.mNumBlocks
+		&& (header.mFreeList == kEmptyIndex || header.mFreeList < numBlocks)
+		&& header.mNextUnused <= header.mUnusedEnd && header.mUnusedEnd <= numBlocks
+		&& header.mBlocksFree <= numBlocks && header.mNumUnusedRuns <= numBlocks;
+
+	std::vector<UnusedRun> unusedRuns(valid ? header.mNumUnusedRuns : 0);
+	valid = valid && (unusedRuns.empty() || fread(unusedRuns.data(), sizeof(UnusedRun), unusedRuns.size(), file) == unusedRuns.size());
+	for (const UnusedRun& run : unusedRuns)
+		valid = valid && run.mBegin <= run.mEnd && run.mEnd <= numBlocks;
+	// Check the whole image is there before anything in the pool is overwritten
+	valid = valid && interior::SeekFile(file, 0, SEEK_END) == 0
+		&& interior::TellFile(file) >= static_cast<std::int64_t>(header.mImageOffset + imageBytes);
+	if (!valid)
+	{
+		fclose(file);
+		return false;
+	}
+
+	bool loaded = mProvider.MapFile(mPool, imageBytes, path, static_cast<size_t>(header.mImageOffset));
+	if (!loaded)
+	{
+		loaded = interior::SeekFile(file, header.mImageOffset, SEEK_SET) == 0
+			&& fread(mPool, sizeof(PoolBlock), numBlocks, file) == numBlocks;
+	}
+	fclose(file);
+
+	// Blocks freed remotely before the load belong to the old contents
+	mRemoteFreeList.store(kEmptyIndex, std::memory_order_relaxed);
+	#ifdef POOL_ALLOC_TELEMETRY
+	mTelemetry.OnFree(numBlocks - mBlocksFree);
+	#endif
+	if (!loaded)
+	{
+		ResetToEmpty();
+		return false;
+	}
+
+	mFreeList = header.mFreeList;
+	mNextUnused = header.mNextUnused;
+	mUnusedEnd = header.mUnusedEnd;
+	mBlocksFree = header.mBlocksFree;
+	mUnusedRuns.swap(unusedRuns);
+	mLastTrim = std::chrono::steady_clock::now();
+	// The links live in the image, so they can only be checked once it's loaded
+	if (!IsFreeStateValid())
+	{
+		ResetToEmpty();
+		return false;
+	}
+
+	#ifdef POOL_ALLOC_CHECKED
+	std::vector<std::uint64_t> freeBits = GetFreeBits();
+	for (unsigned int i = 0; i < kBitmapWords; ++i)
+		mAllocatedBits[i].store(~freeBits[i], std::memory_order_relaxed);
+	// Bits past the last block aren't blocks
+	if (numBlocks % 64 != 0)
+		mAllocatedBits[kBitmapWords - 1].fetch_and((std::uint64_t(1) << (numBlocks % 64)) - 1, std::memory_order_relaxed);
+	#endif
+	#ifdef POOL_ALLOC_TELEMETRY
+	if (mBlocksFree != numBlocks)
+		mTelemetry.OnAllocate(nullptr, numBlocks - mBlocksFree);
+	#endif
+	return true;
+}
+
+// Return a snapshot header describing this pool type, with the free list state left zero
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+PoolSnapshotHeader PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::MakeSnapshotHeader()
+{
+	PoolSnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.mMagic, "POOLSNAP", sizeof(header.mMagic));
+	header.mVersion = 1;
+	#ifdef POOL_ALLOC_DEBUG
+	header.mDebugBlocks = 1;
+	#endif
+	header.mBlockSize = blockSize;
+	header.mBlockAlignment = alignment;
+	header.mBlockStride = sizeof(PoolBlock);
+	header.mNumBlocks = numBlocks;
+	return header;
+}
+
+// Make every block untouched, as after construction
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+void PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::ResetToEmpty()
+{
+	mFreeList = kEmptyIndex;
+	mNextUnused = 0;
+	mUnusedEnd = numBlocks;
+	mUnusedRuns.clear();
+	mBlocksFree = numBlocks;
+	#ifdef POOL_ALLOC_CHECKED
+	for (unsigned int i = 0; i < kBitmapWords; ++i)
+		mAllocatedBits[i].store(0, std::memory_order_relaxed);
+	#endif
+}
+
+// Return whether the free list and untouched runs are in range, don't overlap, and add up to mBlocksFree,
+// so state read from a file can be trusted before any block is indexed through it
+template <size_t blockSize, unsigned int numBlocks, size_t alignment, typename MemoryProvider>
+bool PoolAllocator<blockSize, numBlocks, alignment, MemoryProvider>::IsFreeStateValid() const
+{
+	std::vector<std::uint64_t> freeBits((numBlocks + 63) / 64, 0);
+	unsigned int numFree = 0;
+	// Mark index free, failing if it's out of range or already free (an overlap, or a loop in the free list)
+	auto markFree = [&freeBits, &numFree](std::uint32_t index)
+	{
+		if (index >= numBlocks || (freeBits[index / 64] >> (index % 64) & 1) != 0)
+			return false;
+		freeBits[index / 64] |= std::uint64_t(1) << (index % 64);
+		++numFree;
+		return true;
+	};
+
+	if (mNextUnused > mUnusedEnd || mUnusedEnd > numBlocks)
+		return false;
+	for (std::uint32_t index = mNextUnused; index < mUnusedEnd; ++index)
+		markFree(index);
+	for (const UnusedRun& run : mUnusedRuns)
+	{
+		if (run.mBegin > run.mEnd || run.mEnd > numBlocks)
+			return false;
+		for (std::uint32_t index = run.mBegin; index < run.mEnd; ++index)
+		{
+			if (!markFree(index))
+				return false;
+		}
+	}
+	// Every free block is marked once, so a walk longer than the pool fails on a repeat before it can run away
+	for (std::uint32_t index = mFreeList; index != kEmptyIndex; index = mPool[index].mNext)
+	{
+		if (!markFree(index))
+			return false;
+	}
+	return numFree == mBlocksFree;
+}
+
+// IMPLEMENTATIONS for snapshot file helpers
+
+inline int interior::SeekFile(FILE* file, std::uint64_t offset, int origin)
+{
+#if _WIN32
+	return _fseeki64(file, static_cast<__int64>(offset), origin);
+#else
+	return fseeko(file, static_cast<off_t>(offset), origin);
+#endif
+}
+
+inline std::int64_t interior::TellFile(FILE* file)
+{
+#if _WIN32
+	return _ftelli64(file);
+#else
+	return static_cast<std::int64_t>(ftello(file));
+#endif
+}
+
+inline bool interior::SyncFile(FILE* file)
+{
+	if (fflush(file) != 0)
+		return false;
+#if _WIN32
+	return _commit(_fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+
+inline bool interior::SyncParentDirectory(const char* path)
+{
+#if _WIN32
+	// NTFS journals renames itself, and directories can't be opened with the CRT to flush them
+	(void)path;
+	return true;
+#else
+	std::string directory(path);
+	size_t slash = directory.find_last_of('/');
+	directory = slash == std::string::npos ? "." : slash == 0 ? "/" : directory.substr(0, slash);
+	int fd = open(directory.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	bool synced = fsync(fd) == 0;
+	close(fd);
+	return synced;
+#endif
 }
@@ -0,0 +1,296 @@
+// Defines the providers pool allocators get their backing memory from
+#pragma once
+#include "DbgAssert.h"
+#include <cstddef>
+#include <new>
+
+#if __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// A memory provider hands a pool one large region up front (PoolAllocator's blocks, or one of GrowablePoolAllocator's slabs)
+// and takes it back when the pool is done with it. Providers are passed by value to the pool's constructor and kept by the pool.
+// Every provider has:
+//  void* Allocate(size_t bytes, size_t alignment) - return bytes of memory aligned to alignment (a power of two), or throw std::bad_alloc
+//  void Release(void* ptr, size_t bytes, size_t alignment) - give back a region from Allocate, with the same bytes and alignment
+//  size_t GetPageBytes() const - the granularity Decommit works in
+//  bool Decommit(void* ptr, size_t bytes, bool lazy) - let the OS reclaim whole pages inside a region while keeping them mapped,
+//   and return whether it did; they read back as zero (or, if lazy, possibly their old contents) and become resident again
+//   when next written. If it returns false the pages were left untouched, contents and all
+//  bool MapFile(void* ptr, size_t bytes, const char* path, size_t offset) - replace the start of a region from Allocate
+//   with a copy-on-write mapping of path's bytes from offset, or return false (leaving the region as it was) if it can't,
+//   in which case the caller reads the file in instead
+
+namespace interior
+{
+	// Size of a regular OS page
+	size_t SystemPageBytes();
+	// madvise the pages away, with MADV_FREE if lazy (the kernel reclaims them only under memory pressure) or
+	// MADV_DONTNEED otherwise (reclaimed immediately), and return whether either succeeded;
+	// does nothing and returns false on platforms without madvise
+	bool DecommitPages(void* ptr, size_t bytes, bool lazy);
+}
+
+// Default provider, taking pool memory from the global heap like new[] does
+struct HeapMemoryProvider
+{
+	void* Allocate(size_t bytes, size_t alignment) { return ::operator new(bytes, std::align_val_t(alignment)); }
+	void Release(void* ptr, size_t bytes, size_t alignment) { ::operator delete(ptr, bytes, std::align_val_t(alignment)); }
+	size_t GetPageBytes() const { return interior::SystemPageBytes(); }
+	bool Decommit(void* ptr, size_t bytes, bool lazy) { return interior::DecommitPages(ptr, bytes, lazy); }
+	// Heap memory can't be remapped
+	bool MapFile(void*, size_t, const char*, size_t) { return false; }
+};
+
+// Provider mapping pool memory straight from the OS, for large pools that are hot enough for TLB misses
+// and cross-node memory traffic to matter.
+//
+//  -Huge pages: Transparent advises the kernel to back the region with 2 MB pages when it can (MADV_HUGEPAGE).
+//   Explicit maps from the reserved hugetlbfs pool (MAP_HUGETLB), rounding every region up to 2 MB; if no huge pages
+//   are reserved (vm.nr_hugepages) it falls back to Transparent instead of failing.
+//  -Prefault touches every page up front, so the first pass over a fresh pool doesn't pay a page fault per page
+//   and a pool built at load time doesn't fault in the middle of a frame.
+//  -numaNode binds the region to that node's memory (MPOL_BIND). Build one pool per node and have worker threads pinned
+//   to a node use that node's pool; GetCurrentNode tells a thread which node it is running on.
+//  -MapFile maps a pool snapshot straight over the region (MAP_PRIVATE | MAP_FIXED), so loading it costs one mmap and
+//   pages are read from the page cache as they are first touched. Writes go to private copies and never reach the file.
+//   Mapped pages are regular pages placed by the default policy, and explicit huge page regions are never remapped.
+//
+// The region is advised and bound before it is prefaulted, since pages faulted earlier (MAP_POPULATE at mmap time)
+// would already be placed as 4 KB pages on whichever node the calling thread happened to run on.
+//
+// On platforms other than Linux this behaves like HeapMemoryProvider.
+//
+// For example, one pool per NUMA node:
+// typedef PoolAllocator<256, 1 << 16, 64, PageMemoryProvider> ParticlePool;
+// ParticlePool node0Pool(PageMemoryProvider(PageMemoryProvider::HugePages::Transparent, true, 0));
+class PageMemoryProvider
+{
+public:
+	enum class HugePages
+	{
+		// Regular pages only
+		None,
+		// Ask for transparent huge pages
+		Transparent,
+		// Map reserved huge pages, falling back to Transparent if none are available
+		Explicit
+	};
+
+	// numaNode value meaning "don't bind"
+	static const int kAnyNode = -1;
+	// Size of the huge pages used by HugePages::Explicit
+	static const size_t kHugePageBytes = size_t(2) * 1024 * 1024;
+
+	explicit PageMemoryProvider(HugePages hugePages = HugePages::Transparent, bool prefault = false, int numaNode = kAnyNode);
+
+	void* Allocate(size_t bytes, size_t alignment);
+	void Release(void* ptr, size_t bytes, size_t alignment);
+	size_t GetPageBytes() const { return GetMappingGranularity(); }
+	bool Decommit(void* ptr, size_t bytes, bool lazy) { return interior::DecommitPages(ptr, bytes, lazy); }
+	bool MapFile(void* ptr, size_t bytes, const char* path, size_t offset);
+
+	// Return the NUMA node the calling thread is currently running on, or 0 if that can't be determined
+	static int GetCurrentNode();
+
+protected:
+	// Granularity regions are mapped and trimmed in
+	size_t GetMappingGranularity() const;
+
+	HugePages mHugePages;
+	bool mPrefault;
+	int mNumaNode;
+};
+
+// IMPLEMENTATIONS for PageMemoryProvider
+
+inline PageMemoryProvider::PageMemoryProvider(HugePages hugePages, bool prefault, int numaNode)
+{
+	mHugePages = hugePages;
+	mPrefault = prefault;
+	mNumaNode = numaNode;
+}
+
+#if __linux__
+
+inline size_t interior::SystemPageBytes()
+{
+	return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+inline bool interior::DecommitPages(void* ptr, size_t bytes, bool lazy)
+{
+	#ifdef MADV_FREE
+	if (lazy && madvise(ptr, bytes, MADV_FREE) == 0)
+		return true;
+	#else
+	(void)lazy;
+	#endif
+	return madvise(ptr, bytes, MADV_DONTNEED) == 0;
+}
+
+inline size_t PageMemoryProvider::GetMappingGranularity() const
+{
+	return mHugePages == HugePages::Explicit ? kHugePageBytes : interior::SystemPageBytes();
+}
+
+inline void* PageMemoryProvider::Allocate(size_t bytes, size_t alignment)
+{
+	// Regions are sized in granularity units either way, so Release unmaps the same length whichever mapping succeeded
+	size_t granularity = GetMappingGranularity();
+	size_t mapBytes = (bytes + granularity - 1) / granularity * granularity;
+
+	// mmap only guarantees the alignment of the pages it maps, so bigger alignments map extra and trim it off both ends
+	void* mapping = MAP_FAILED;
+	size_t slackBytes = 0;
+	if (mHugePages == HugePages::Explicit)
+	{
+		slackBytes = alignment > kHugePageBytes ? alignment - kHugePageBytes : 0;
+		mapping = mmap(nullptr, mapBytes + slackBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+	bool hugetlb = mapping != MAP_FAILED;
+	if (!hugetlb)
+	{
+		// Regular pages, including Explicit's fallback, are only aligned to the system page size
+		size_t pageBytes = interior::SystemPageBytes();
+		slackBytes = alignment > pageBytes ? alignment - pageBytes : 0;
+		mapping = mmap(nullptr, mapBytes + slackBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+	if (mapping == MAP_FAILED)
+		throw std::bad_alloc();
+
+	char* start = static_cast<char*>(mapping);
+	char* region = reinterpret_cast<char*>((reinterpret_cast<size_t>(start) + alignment - 1) & ~(alignment - 1));
+	if (slackBytes != 0)
+	{
+		if (region != start)
+			munmap(start, region - start);
+		if (region + mapBytes != start + mapBytes + slackBytes)
+			munmap(region + mapBytes, start + slackBytes - region);
+	}
+	else
+	{
+		region = start;
+	}
+
+	if (!hugetlb && mHugePages != HugePages::None)
+		madvise(region, mapBytes, MADV_HUGEPAGE);
+
+	if (mNumaNode != kAnyNode)
+	{
+		// Raw syscall so this doesn't need libnuma; MPOL_BIND is 2 in <numaif.h>
+		const int kMpolBind = 2;
+		const size_t kMaskBits = sizeof(unsigned long) * 8;
+		unsigned long nodeMask[16] = {};
+		DbgAssert(static_cast<size_t>(mNumaNode) < kMaskBits * 16, "NUMA node index out of range.");
+		if (static_cast<size_t>(mNumaNode) < kMaskBits * 16)
+		{
+			nodeMask[mNumaNode / kMaskBits] = 1ul << (mNumaNode % kMaskBits);
+			long result = syscall(SYS_mbind, region, mapBytes, kMpolBind, nodeMask, kMaskBits * 16, 0);
+			// Fails on kernels without NUMA support or nodes that don't exist; the memory is still usable, just unbound
+			DbgAssert(result == 0, "Could not bind pool memory to the NUMA node.");
+			(void)result;
+		}
+	}
+
+	if (mPrefault)
+	{
+	#ifdef MADV_POPULATE_WRITE
+		if (madvise(region, mapBytes, MADV_POPULATE_WRITE) != 0)
+	#endif
+		{
+			// Older kernels: fault each page in by hand, writing zeroes over what are already zero pages
+			size_t pageBytes = interior::SystemPageBytes();
+			for (size_t offset = 0; offset < mapBytes; offset += pageBytes)
+				*static_cast<volatile char*>(region + offset) = 0;
+		}
+	}
+
+	return region;
+}
+
+inline void PageMemoryProvider::Release(void* ptr, size_t bytes, size_t alignment)
+{
+	(void)alignment;
+	size_t granularity = GetMappingGranularity();
+	munmap(ptr, (bytes + granularity - 1) / granularity * granularity);
+}
+
+inline bool PageMemoryProvider::MapFile(void* ptr, size_t bytes, const char* path, size_t offset)
+{
+	// A fixed file mapping can't split a hugetlb mapping, and both ends must be page aligned
+	size_t pageBytes = interior::SystemPageBytes();
+	if (mHugePages == HugePages::Explicit || reinterpret_cast<size_t>(ptr) % pageBytes != 0 || offset % pageBytes != 0)
+		return false;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	// Touching a mapped page that lies wholly past the end of the file raises SIGBUS, so the file must cover the region
+	struct stat fileStat;
+	void* mapping = MAP_FAILED;
+	if (fstat(fd, &fileStat) == 0 && static_cast<size_t>(fileStat.st_size) >= offset + bytes)
+		mapping = mmap(ptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, static_cast<off_t>(offset));
+	// The mapping keeps its own reference to the file
+	close(fd);
+	return mapping != MAP_FAILED;
+}
+
+inline int PageMemoryProvider::GetCurrentNode()
+{
+	unsigned int cpu = 0;
+	unsigned int node = 0;
+	if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+		return 0;
+	return static_cast<int>(node);
+}
+
+#else
+
+inline size_t interior::SystemPageBytes()
+{
+	return 4096;
+}
+
+inline bool interior::DecommitPages(void* ptr, size_t bytes, bool lazy)
+{
+	(void)ptr;
+	(void)bytes;
+	(void)lazy;
+	return false;
+}
+
+inline size_t PageMemoryProvider::GetMappingGranularity() const
+{
+	return 1;
+}
+
+inline void* PageMemoryProvider::Allocate(size_t bytes, size_t alignment)
+{
+	return HeapMemoryProvider().Allocate(bytes, alignment);
+}
+
+inline void PageMemoryProvider::Release(void* ptr, size_t bytes, size_t alignment)
+{
+	HeapMemoryProvider().Release(ptr, bytes, alignment);
+}
+
+inline bool PageMemoryProvider::MapFile(void* ptr, size_t bytes, const char* path, size_t offset)
+{
+	(void)ptr;
+	(void)bytes;
+	(void)path;
+	(void)offset;
+	return false;
+}
+
+inline int PageMemoryProvider::GetCurrentNode()
+{
+	return 0;
+}
+
+#endif
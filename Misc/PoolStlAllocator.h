@@ -0,0 +1,258 @@
+// Defines standard library allocator adapters over the pool-based allocators
+#pragma once
+#include "SmallObjectAlloc.h"
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+// Defines STL Allocator adapters so node-based containers can take their nodes from a pool instead of the global heap
+//
+// Both adapters satisfy the Allocator requirements through std::allocator_traits:
+//  -Containers rebind them to their internal node types (std::list to its list node, std::map to its tree node, etc.)
+//   through the converting constructor, and every rebound copy keeps pointing at the same underlying allocator
+//  -They are stateful; two adapters compare equal when they share an underlying allocator, so memory allocated
+//   through one can be freed through the other. They propagate on container copy, move, and swap
+//  -allocate(1) (how node-based containers allocate every node) goes straight to the pool; arrays such as
+//   std::unordered_map's bucket array and anything over-aligned go to the system heap instead
+//
+// Default constructed adapters share one pool per pool type, so a container can be pool-backed with a template argument alone:
+//  std::map<int, Foo, std::less<int>, PoolStlAllocator<std::pair<const int, Foo>, NodePool>> fooMap;
+// Pass an adapter constructed from a specific pool to the container's constructor to use that pool instead.
+// The adapters are only as thread safe as the pool they use.
+
+// Adapter over a fixed block size pool (PoolAllocator, ConcurrentPoolAllocator, ThreadCachedPoolAllocator, or GrowablePoolAllocator)
+// Single objects that fit in Pool::kBlockSize come from the pool; bigger ones and arrays come from the system heap
+template <typename T, typename Pool>
+class PoolStlAllocator
+{
+public:
+	using value_type = T;
+	using propagate_on_container_copy_assignment = std::true_type;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+
+	// Use the pool shared by all default constructed adapters over Pool
+	PoolStlAllocator() noexcept;
+	// Use the given pool, which must outlive every container using it
+	explicit PoolStlAllocator(Pool& pool) noexcept;
+	// Rebind from an adapter of another value type, sharing its pool
+	template <typename U>
+	PoolStlAllocator(const PoolStlAllocator<U, Pool>& other) noexcept;
+
+	T* allocate(std::size_t n);
+	void deallocate(T* ptr, std::size_t n) noexcept;
+
+	Pool* GetPool() const { return mPool; }
+
+	// Pool shared by default constructed adapters over Pool
+	static Pool& GetDefaultPool();
+
+private:
+	// Whether n Ts are served by the pool
+	static constexpr bool UsesPool(std::size_t n) { return n == 1 && sizeof(T) <= Pool::kBlockSize && alignof(T) <= Pool::kBlockAlignment; }
+
+	Pool* mPool;
+};
+
+// Adapter over SmallObjectAllocator
+// Single objects go to their size class; arrays and over-aligned types go to the system heap
+template <typename T>
+class SmallObjectStlAllocator
+{
+public:
+	using value_type = T;
+	using propagate_on_container_copy_assignment = std::true_type;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+
+	// Use the SmallObjectAllocator shared by all default constructed adapters
+	SmallObjectStlAllocator() noexcept;
+	// Use the given allocator, which must outlive every container using it
+	explicit SmallObjectStlAllocator(SmallObjectAllocator& allocator) noexcept;
+	// Rebind from an adapter of another value type, sharing its allocator
+	template <typename U>
+	SmallObjectStlAllocator(const SmallObjectStlAllocator<U>& other) noexcept;
+
+	T* allocate(std::size_t n);
+	void deallocate(T* ptr, std::size_t n) noexcept;
+
+	SmallObjectAllocator* GetAllocator() const { return mAllocator; }
+
+	// SmallObjectAllocator shared by default constructed adapters
+	static SmallObjectAllocator& GetDefaultAllocator();
+
+private:
+	// Whether n Ts are served by a size class
+	static constexpr bool UsesPool(std::size_t n) { return n == 1 && alignof(T) <= SmallObjectAllocator::kClassAlignment; }
+
+	SmallObjectAllocator* mAllocator;
+};
+
+// Adapters are equal when they share an underlying allocator
+template <typename T, typename U, typename Pool>
+bool operator==(const PoolStlAllocator<T, Pool>& lhs, const PoolStlAllocator<U, Pool>& rhs);
+template <typename T, typename U, typename Pool>
+bool operator!=(const PoolStlAllocator<T, Pool>& lhs, const PoolStlAllocator<U, Pool>& rhs);
+template <typename T, typename U>
+bool operator==(const SmallObjectStlAllocator<T>& lhs, const SmallObjectStlAllocator<U>& rhs);
+template <typename T, typename U>
+bool operator!=(const SmallObjectStlAllocator<T>& lhs, const SmallObjectStlAllocator<U>& rhs);
+
+namespace interior
+{
+	// System heap fallback shared by the adapters, honoring over-aligned types
+	template <typename T>
+	T* HeapAllocate(std::size_t n);
+	template <typename T>
+	void HeapDeallocate(T* ptr);
+
+	// Instances shared by default constructed adapters, kept outside the adapters so every value type shares them
+	template <typename Pool>
+	Pool& DefaultPool();
+	SmallObjectAllocator& DefaultSmallObjectAllocator();
+}
+
+// IMPLEMENTATIONS for PoolStlAllocator
+
+template <typename T, typename Pool>
+PoolStlAllocator<T, Pool>::PoolStlAllocator() noexcept
+	: mPool(&GetDefaultPool())
+{}
+
+template <typename T, typename Pool>
+PoolStlAllocator<T, Pool>::PoolStlAllocator(Pool& pool) noexcept
+	: mPool(&pool)
+{}
+
+template <typename T, typename Pool>
+template <typename U>
+PoolStlAllocator<T, Pool>::PoolStlAllocator(const PoolStlAllocator<U, Pool>& other) noexcept
+	: mPool(other.GetPool())
+{}
+
+template <typename T, typename Pool>
+T* PoolStlAllocator<T, Pool>::allocate(std::size_t n)
+{
+	if (!UsesPool(n))
+		return interior::HeapAllocate<T>(n);
+
+	void* ptr = mPool->Allocate(sizeof(T));
+	// Containers expect allocation failure to throw rather than return nullptr
+	if (ptr == nullptr)
+		throw std::bad_alloc();
+	return static_cast<T*>(ptr);
+}
+
+template <typename T, typename Pool>
+void PoolStlAllocator<T, Pool>::deallocate(T* ptr, std::size_t n) noexcept
+{
+	if (!UsesPool(n))
+		interior::HeapDeallocate(ptr);
+	else
+		mPool->Free(ptr);
+}
+
+template <typename T, typename Pool>
+Pool& PoolStlAllocator<T, Pool>::GetDefaultPool()
+{
+	return interior::DefaultPool<Pool>();
+}
+
+// IMPLEMENTATIONS for SmallObjectStlAllocator
+
+template <typename T>
+SmallObjectStlAllocator<T>::SmallObjectStlAllocator() noexcept
+	: mAllocator(&GetDefaultAllocator())
+{}
+
+template <typename T>
+SmallObjectStlAllocator<T>::SmallObjectStlAllocator(SmallObjectAllocator& allocator) noexcept
+	: mAllocator(&allocator)
+{}
+
+template <typename T>
+template <typename U>
+SmallObjectStlAllocator<T>::SmallObjectStlAllocator(const SmallObjectStlAllocator<U>& other) noexcept
+	: mAllocator(other.GetAllocator())
+{}
+
+template <typename T>
+T* SmallObjectStlAllocator<T>::allocate(std::size_t n)
+{
+	if (!UsesPool(n))
+		return interior::HeapAllocate<T>(n);
+	return static_cast<T*>(mAllocator->Allocate(sizeof(T)));
+}
+
+template <typename T>
+void SmallObjectStlAllocator<T>::deallocate(T* ptr, std::size_t n) noexcept
+{
+	if (!UsesPool(n))
+		interior::HeapDeallocate(ptr);
+	else
+		mAllocator->Free(ptr, sizeof(T));
+}
+
+template <typename T>
+SmallObjectAllocator& SmallObjectStlAllocator<T>::GetDefaultAllocator()
+{
+	return interior::DefaultSmallObjectAllocator();
+}
+
+// IMPLEMENTATIONS for adapter free functions
+
+template <typename T, typename U, typename Pool>
+bool operator==(const PoolStlAllocator<T, Pool>& lhs, const PoolStlAllocator<U, Pool>& rhs)
+{
+	return lhs.GetPool() == rhs.GetPool();
+}
+
+template <typename T, typename U, typename Pool>
+bool operator!=(const PoolStlAllocator<T, Pool>& lhs, const PoolStlAllocator<U, Pool>& rhs)
+{
+	return !(lhs == rhs);
+}
+
+template <typename T, typename U>
+bool operator==(const SmallObjectStlAllocator<T>& lhs, const SmallObjectStlAllocator<U>& rhs)
+{
+	return lhs.GetAllocator() == rhs.GetAllocator();
+}
+
+template <typename T, typename U>
+bool operator!=(const SmallObjectStlAllocator<T>& lhs, const SmallObjectStlAllocator<U>& rhs)
+{
+	return !(lhs == rhs);
+}
+
+template <typename T>
+T* interior::HeapAllocate(std::size_t n)
+{
+	if (n > static_cast<std::size_t>(-1) / sizeof(T))
+		throw std::bad_array_new_length();
+	if (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+	return static_cast<T*>(::operator new(n * sizeof(T)));
+}
+
+template <typename T>
+void interior::HeapDeallocate(T* ptr)
+{
+	if (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+		::operator delete(ptr, std::align_val_t(alignof(T)));
+	else
+		::operator delete(ptr);
+}
+
+template <typename Pool>
+Pool& interior::DefaultPool()
+{
+	static Pool sPool;
+	return sPool;
+}
+
+inline SmallObjectAllocator& interior::DefaultSmallObjectAllocator()
+{
+	static SmallObjectAllocator sAllocator;
+	return sAllocator;
+}
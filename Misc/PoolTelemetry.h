@@ -0,0 +1,214 @@
+// Defines optional usage counters for the pool-based allocators
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Builds with POOL_ALLOC_TELEMETRY defined give PoolAllocator a PoolTelemetry member that counts every Allocate and Free.
+// Without it the hooks compile away entirely, so there is no cost unless it's turned on.
+//
+// Counters are relaxed atomics: the pool's own thread pays for an uncontended add per call, and an exporter thread
+// can take a Snapshot at any time without locking the pool. A snapshot is consistent per counter but not across counters.
+//
+// Rates aren't tracked directly; every snapshot is timestamped, so the allocate and free rates over an interval
+// are the difference of two snapshots' counts divided by the difference of their timestamps.
+// The peak is the high-water mark since construction (or the last ResetPeak), which is what a pool should be sized to.
+//
+// Call sites are attributed by passing a string literal to Allocate, most easily with POOL_ALLOC_SITE:
+//  void* ptr = gComponentPool.Allocate(sizeof(Foo), POOL_ALLOC_SITE);
+// Sites are matched by pointer, so the same literal in two translation units may show up as two entries.
+// Up to kMaxCallSites distinct sites are tracked; allocations from any more are counted as unattributed.
+
+// "file:line" of the call, for Allocate's callSite argument (normally defined by PoolAlloc.h)
+#ifndef POOL_ALLOC_SITE
+#define POOL_ALLOC_STRINGIZE_INNER(x) #x
+#define POOL_ALLOC_STRINGIZE(x) POOL_ALLOC_STRINGIZE_INNER(x)
+#define POOL_ALLOC_SITE (__FILE__ ":" POOL_ALLOC_STRINGIZE(__LINE__))
+#endif
+
+// Point in time copy of a pool's counters
+struct PoolTelemetrySnapshot
+{
+	struct CallSite
+	{
+		// The callSite string passed to Allocate
+		const char* mSite;
+		// Allocations made from this site
+		std::uint64_t mAllocations;
+	};
+
+	// steady_clock time the snapshot was taken, in nanoseconds
+	std::int64_t mTimestampNs;
+	size_t mBlockSize;
+	unsigned int mNumBlocks;
+	// Blocks currently allocated
+	unsigned int mBlocksInUse;
+	// Most blocks allocated at once
+	unsigned int mPeakBlocksInUse;
+	// Successful Allocate calls
+	std::uint64_t mAllocations;
+	// Free calls
+	std::uint64_t mFrees;
+	// Allocate calls that returned nullptr (pool exhausted or size too big)
+	std::uint64_t mFailedAllocations;
+	// Allocations made without a call site, or from sites beyond kMaxCallSites
+	std::uint64_t mUnattributedAllocations;
+	std::vector<CallSite> mCallSites;
+
+	// Return the snapshot as a single line JSON object
+	std::string ToJson() const;
+};
+
+class PoolTelemetry
+{
+public:
+	// Number of distinct call sites tracked
+	static const unsigned int kMaxCallSites = 64;
+
+	PoolTelemetry();
+
+	// Hooks called by the pool, for count blocks at a time
+	void OnAllocate(const char* callSite, unsigned int count = 1);
+	void OnFree(unsigned int count = 1);
+	void OnFailedAllocate();
+
+	// Start tracking the peak again from the current usage
+	void ResetPeak();
+
+	// Copy the counters; blockSize and numBlocks describe the pool they belong to
+	PoolTelemetrySnapshot Snapshot(size_t blockSize, unsigned int numBlocks) const;
+
+protected:
+	struct CallSiteCounter
+	{
+		std::atomic<const char*> mSite;
+		std::atomic<std::uint64_t> mAllocations;
+	};
+
+	std::atomic<unsigned int> mBlocksInUse;
+	std::atomic<unsigned int> mPeakBlocksInUse;
+	std::atomic<std::uint64_t> mAllocations;
+	std::atomic<std::uint64_t> mFrees;
+	std::atomic<std::uint64_t> mFailedAllocations;
+	std::atomic<std::uint64_t> mUnattributedAllocations;
+
+	// Open addressed by the site pointer's hash; a slot's mSite is claimed once with compare-and-swap and never changes
+	CallSiteCounter mCallSites[kMaxCallSites];
+};
+
+// IMPLEMENTATIONS for PoolTelemetry
+
+inline PoolTelemetry::PoolTelemetry()
+	: mBlocksInUse(0)
+	, mPeakBlocksInUse(0)
+	, mAllocations(0)
+	, mFrees(0)
+	, mFailedAllocations(0)
+	, mUnattributedAllocations(0)
+{
+	for (CallSiteCounter& counter : mCallSites)
+	{
+		counter.mSite.store(nullptr, std::memory_order_relaxed);
+		counter.mAllocations.store(0, std::memory_order_relaxed);
+	}
+}
+
+inline void PoolTelemetry::OnAllocate(const char* callSite, unsigned int count)
+{
+	mAllocations.fetch_add(count, std::memory_order_relaxed);
+	unsigned int inUse = mBlocksInUse.fetch_add(count, std::memory_order_relaxed) + count;
+	unsigned int peak = mPeakBlocksInUse.load(std::memory_order_relaxed);
+	while (inUse > peak && !mPeakBlocksInUse.compare_exchange_weak(peak, inUse, std::memory_order_relaxed))
+	{}
+
+	if (callSite == nullptr)
+	{
+		mUnattributedAllocations.fetch_add(count, std::memory_order_relaxed);
+		return;
+	}
+	// Literals are often 8 byte aligned, so the low bits rarely differ between sites
+	unsigned int start = static_cast<unsigned int>((reinterpret_cast<std::uintptr_t>(callSite) >> 3) % kMaxCallSites);
+	for (unsigned int probe = 0; probe < kMaxCallSites; ++probe)
+	{
+		CallSiteCounter& counter = mCallSites[(start + probe) % kMaxCallSites];
+		const char* site = counter.mSite.load(std::memory_order_relaxed);
+		if (site == nullptr && counter.mSite.compare_exchange_strong(site, callSite, std::memory_order_relaxed))
+			site = callSite;
+		if (site == callSite)
+		{
+			counter.mAllocations.fetch_add(count, std::memory_order_relaxed);
+			return;
+		}
+	}
+	mUnattributedAllocations.fetch_add(count, std::memory_order_relaxed);
+}
+
+inline void PoolTelemetry::OnFree(unsigned int count)
+{
+	mFrees.fetch_add(count, std::memory_order_relaxed);
+	mBlocksInUse.fetch_sub(count, std::memory_order_relaxed);
+}
+
+inline void PoolTelemetry::OnFailedAllocate()
+{
+	mFailedAllocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void PoolTelemetry::ResetPeak()
+{
+	mPeakBlocksInUse.store(mBlocksInUse.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+inline PoolTelemetrySnapshot PoolTelemetry::Snapshot(size_t blockSize, unsigned int numBlocks) const
+{
+	PoolTelemetrySnapshot snapshot;
+	snapshot.mTimestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	snapshot.mBlockSize = blockSize;
+	snapshot.mNumBlocks = numBlocks;
+	snapshot.mBlocksInUse = mBlocksInUse.load(std::memory_order_relaxed);
+	snapshot.mPeakBlocksInUse = mPeakBlocksInUse.load(std::memory_order_relaxed);
+	snapshot.mAllocations = mAllocations.load(std::memory_order_relaxed);
+	snapshot.mFrees = mFrees.load(std::memory_order_relaxed);
+	snapshot.mFailedAllocations = mFailedAllocations.load(std::memory_order_relaxed);
+	snapshot.mUnattributedAllocations = mUnattributedAllocations.load(std::memory_order_relaxed);
+	for (const CallSiteCounter& counter : mCallSites)
+	{
+		const char* site = counter.mSite.load(std::memory_order_relaxed);
+		if (site != nullptr)
+			snapshot.mCallSites.push_back({ site, counter.mAllocations.load(std::memory_order_relaxed) });
+	}
+	return snapshot;
+}
+
+// IMPLEMENTATIONS for PoolTelemetrySnapshot
+
+inline std::string PoolTelemetrySnapshot::ToJson() const
+{
+	char buffer[512];
+	snprintf(buffer, sizeof(buffer),
+		"{\"timestampNs\":%lld,\"blockSize\":%llu,\"numBlocks\":%u,\"blocksInUse\":%u,\"peakBlocksInUse\":%u,"
+		"\"allocations\":%llu,\"frees\":%llu,\"failedAllocations\":%llu,\"unattributedAllocations\":%llu,\"callSites\":[",
+		static_cast<long long>(mTimestampNs), static_cast<unsigned long long>(mBlockSize), mNumBlocks, mBlocksInUse, mPeakBlocksInUse,
+		static_cast<unsigned long long>(mAllocations), static_cast<unsigned long long>(mFrees),
+		static_cast<unsigned long long>(mFailedAllocations), static_cast<unsigned long long>(mUnattributedAllocations));
+	std::string json = buffer;
+
+	for (size_t i = 0; i < mCallSites.size(); ++i)
+	{
+		json += i == 0 ? "{\"site\":\"" : ",{\"site\":\"";
+		// File paths may hold backslashes (or, rarely, quotes) that have to be escaped
+		for (const char* c = mCallSites[i].mSite; *c != '\0'; ++c)
+		{
+			if (*c == '\\' || *c == '"')
+				json += '\\';
+			json += *c;
+		}
+		snprintf(buffer, sizeof(buffer), "\",\"allocations\":%llu}", static_cast<unsigned long long>(mCallSites[i].mAllocations));
+		json += buffer;
+	}
+	json += "]}";
+	return json;
+}
@@ -1,11 +1,15 @@
 #pragma once
 #include <type_traits>
 #include "Vector.h"
+#include "SimdKernels.h"
 
 // This library follows the convention where possible that functions are defined twice:
 //  once as a member function that acts in-place, and once as a free function that returns a new, altered copy
-// The structs in this library only accept arithmetic template arguments
+// The structs in this library only accept arithmetic or SIMD packet template arguments (see ScalarTraits.h)
+// Interpolation chooses its path with Select rather than branching so packet scalars can take different paths per lane
 // There are static constants for identity and zero quaternions
+// Length and Normalize take an optional Precision template argument (see ScalarTraits.h) that defaults to Precision::Exact
+// Quaternion<float> multiplication runs on the SSE kernel in SimdKernels.h when SSE4.1 is enabled, unless MATH_NO_SIMD is defined
 
 // There are 2 methods provided that perform spherical linear interpolation between quaternions: SlerpOrthonormalBasis and SlerpAngleWeights
 // SlerpOrthonormalBasis is based on Jonathan Blow's coordinate-free derivation of slerp using an orthonormal basis and polar coordinates:
@@ -16,7 +20,7 @@
 template<typename T>
 struct Quaternion
 {
-	static_assert(std::is_arithmetic<T>::value, "Quaternion only accepts arithmetic template arguments");
+	static_assert(IsMathScalar<T>::value, "Quaternion only accepts arithmetic or SIMD packet template arguments");
 
 	T x, y, z, w;
 
@@ -51,9 +55,11 @@ struct Quaternion
 	// Length squared of quaternion
 	T LengthSq() const;
 	// Length of quaternion
+	template<Precision precision = Precision::Exact>
 	T Length() const;
 
 	// Normalize this quaternion in place
+	template<Precision precision = Precision::Exact>
 	Quaternion<T>& Normalize();
 	// Change this quaternion into a zero quaternion
 	Quaternion<T>& Zero();
@@ -93,11 +99,11 @@ Quaternion<T> operator*(T scalar, const Quaternion<T>& quat);
 template<typename T>
 T LengthSq(const Quaternion<T>& quat);
 // Length of quat
-template<typename T>
+template<Precision precision = Precision::Exact, typename T>
 T Length(const Quaternion<T>& quat);
 
 // Return normalized copy of quat
-template<typename T>
+template<Precision precision = Precision::Exact, typename T>
 Quaternion<T> Normalize(const Quaternion<T>& quat);
 // Return zero quaternion; Caller may have to assist compiler with type deduction by specifying type in angle brackets(i.e.Zero<int>())
 template<typename T>
@@ -132,6 +138,13 @@ Quaternion<T> SlerpOrthonormalBasis(const Quaternion<T>& start, const Quaternion
 template<typename T>
 Quaternion<T> SlerpAngleWeights(const Quaternion<T>& start, const Quaternion<T>& end, float t);
 
+namespace interior
+{
+	// Component-wise Select (see ScalarTraits.h) between quaternions a and b
+	template<typename T, typename Mask>
+	Quaternion<T> SelectComponents(const Mask& mask, const Quaternion<T>& a, const Quaternion<T>& b);
+}
+
 // Implementations
 // Quaternion member implementations
 template<typename T>
@@ -164,11 +177,11 @@ template<typename T>
 Quaternion<T>& Quaternion<T>::Set(const Vector<T, 3>& axis, float angle)
 {
 	Vector<T, 3> normalizedAxis = ::Normalize(axis);
-	T halfSin = sin(angle / 2.0f);
+	T halfSin = std::sin(angle / 2.0f);
 	x = normalizedAxis.data[0] * halfSin;
 	y = normalizedAxis.data[1] * halfSin;
 	z = normalizedAxis.data[2] * halfSin;
-	w = cos(angle / 2.0f);
+	w = std::cos(angle / 2.0f);
 	return *this;
 }
 
@@ -201,7 +214,7 @@ Quaternion<T>& Quaternion<T>::operator-=(const Quaternion<T>& rhs)
 	y -= rhs.y;
 	z -= rhs.z;
 	w -= rhs.w;
-	return *thsi;
+	return *this;
 }
 
 template<typename T>
@@ -232,10 +245,8 @@ Quaternion<T> Quaternion<T>::operator*(const Quaternion<T>& rhs) const
 template<typename T>
 Quaternion<T>& Quaternion<T>::operator*=(const Quaternion<T>& rhs)
 {
-	x = w * rhs.x + rhs.w * x + y * rhs.z - z * rhs.y;
-	y = w * rhs.y + rhs.w * y + z * rhs.x - x * rhs.z;
-	z = w * rhs.z + rhs.w * z + x * rhs.y - y * rhs.x;
-	w = w * rhs.w - x * rhs.x - y * rhs.y - z * rhs.z;
+	// Every component of the product reads every component of this, so compute it whole before assigning
+	*this = *this * rhs;
 	return *this;
 }
 
@@ -246,19 +257,33 @@ T Quaternion<T>::LengthSq() const
 }
 
 template<typename T>
+template<Precision precision>
 T Quaternion<T>::Length() const
 {
-	return sqrt(x * x + y * y + z * z + w * w);
+	return Sqrt<precision>(x * x + y * y + z * z + w * w);
 }
 
 template<typename T>
+template<Precision precision>
 Quaternion<T>& Quaternion<T>::Normalize()
 {
-	T length = Length();
-	x /= length;
-	y /= length;
-	z /= length;
-	w /= length;
+	if (precision == Precision::Exact)
+	{
+		T length = Length();
+		x /= length;
+		y /= length;
+		z /= length;
+		w /= length;
+	}
+	else
+	{
+		// Approximate modes scale by an estimated reciprocal length rather than dividing
+		T lengthRecip = ReciprocalSqrt<precision>(x * x + y * y + z * z + w * w);
+		x *= lengthRecip;
+		y *= lengthRecip;
+		z *= lengthRecip;
+		w *= lengthRecip;
+	}
 	return *this;
 }
 
@@ -321,20 +346,11 @@ Quaternion<T> Quaternion<T>::Lerp(const Quaternion<T>& end, float t) const
 	T dot = x * end.x + y * end.y + z * end.z + w * end.w;
 	// If dot product (cosine between the quaternions) is negative, angle between them is greater than 90 degrees, so lerp will take longer arc along the sphere
 	// Avoid by negating one of the quaternions
-	if (Math::IsZero(dot + abs(dot)))
-	{
-		retQuat.x = -x + t * (end.x + x);
-		retQuat.y = -y + t * (end.y + y);
-		retQuat.z = -z + t * (end.z + z);
-		retQuat.w = -w + t * (end.w + w);
-	}
-	else
-	{
-		retQuat.x = x + t * (end.x - x);
-		retQuat.y = y + t * (end.y - y);
-		retQuat.z = z + t * (end.z - z);
-		retQuat.w = w + t * (end.w - w);
-	}
+	T startSign = Select(dot < T(0), T(-1), T(1));
+	retQuat.x = startSign * x + t * (end.x - startSign * x);
+	retQuat.y = startSign * y + t * (end.y - startSign * y);
+	retQuat.z = startSign * z + t * (end.z - startSign * z);
+	retQuat.w = startSign * w + t * (end.w - startSign * w);
 	retQuat.Normalize();
 	return retQuat;
 }
@@ -342,62 +358,73 @@ Quaternion<T> Quaternion<T>::Lerp(const Quaternion<T>& end, float t) const
 template<typename T>
 Quaternion<T> Quaternion<T>::SlerpOrthonormalBasis(const Quaternion<T>& end, float t) const
 {
-	Quaternion<T> maybeNegStart(*this);
+	using std::acos;
+	using std::cos;
+	using std::sin;
 
 	T dot = x * end.x + y * end.y + z * end.z + w * end.w;
 	// If dot product (cosine between the quaternions) is negative, angle between them is greater than 90 degrees, so lerp will take longer arc along the sphere
 	// Avoid by negating one of the quaternions
-	if (Math::IsZero(dot + abs(dot)))
-	{
-		maybeNegStart *= -1;
-		dot = -dot;
-	}
+	T startSign = Select(dot < T(0), T(-1), T(1));
+	Quaternion<T> maybeNegStart = startSign * *this;
+	dot = startSign * dot;
 
 	// If quaternions are close to 'collinear', use lerp
-	if (dot > 0.9995f)
+	auto nearlyCollinear = dot > T(0.9995f);
+	if (AllOf(nearlyCollinear))
 	{
 		return Lerp(end, t);
 	}
-	else
+
+	// Clamp the dot product of collinear lanes away from 1 so their unused slerp results stay finite
+	dot = Select(nearlyCollinear, T(0), dot);
+	T thetaWhole = acos(dot);
+	T thetaDesired = t * thetaWhole;
+	// Use Gram-Schmidt Orthogonalization to create a quaternion orthogonal to start
+	Quaternion<T> basisQuat = end - dot * maybeNegStart;
+	// Normalize to get an orthonormal basis on the unit hypersphere
+	basisQuat.Normalize();
+	// Use polar coordinates to find the quaternion with angle thetaDesired
+	Quaternion<T> slerped = cos(thetaDesired) * maybeNegStart + sin(thetaDesired) * basisQuat;
+	if (NoneOf(nearlyCollinear))
 	{
-		T thetaWhole = acos(dot);
-		T thetaDesired = t * thetaWhole;
-		// Use Gram-Schmidt Orthogonalization to create a quaternion orthogonal to start
-		Quaternion<T> basisQuat = end - maybeNegStart * dot;
-		// Normalize to get an orthonormal basis on the unit hypersphere
-		basisQuat.Normalize();
-		// Use polar coordinates to find the quaternion with angle thetaDesired
-		return maybeNegStart * cos(thetaDesired) + basisQuat * sin(thetaDesired);
-	}	
+		return slerped;
+	}
+	return interior::SelectComponents(nearlyCollinear, Lerp(end, t), slerped);
 }
 
 template<typename T>
 Quaternion<T> Quaternion<T>::SlerpAngleWeights(const Quaternion<T>& end, float t) const
 {
-	Quaternion<T> maybeNegStart(*this);
+	using std::acos;
+	using std::sin;
 
 	T dot = x * end.x + y * end.y + z * end.z + w * end.w;
 	// If dot product (cosine between the quaternions) is negative, angle between them is greater than 90 degrees, so lerp will take longer arc along the sphere
 	// Avoid by negating one of the quaternions
-	if (Math::IsZero(dot + abs(dot)))
-	{
-		maybeNegStart *= -1;
-		dot = -dot;
-	}
+	T startSign = Select(dot < T(0), T(-1), T(1));
+	Quaternion<T> maybeNegStart = startSign * *this;
+	dot = startSign * dot;
 
 	// If quaternions are close to 'collinear', use lerp
-	if (dot > 0.9995f)
+	auto nearlyCollinear = dot > T(0.9995f);
+	if (AllOf(nearlyCollinear))
 	{
 		return Lerp(end, t);
 	}
-	else
+
+	// Clamp the dot product of collinear lanes away from 1 so their unused slerp results stay finite
+	dot = Select(nearlyCollinear, T(0), dot);
+	T theta = acos(dot);
+	T sinThetaRecip = 1 / sin(theta);
+	T startRatio = sin((1 - t) * theta) * sinThetaRecip;
+	T endRatio = sin(t * theta) * sinThetaRecip;
+	Quaternion<T> slerped = startRatio * maybeNegStart + endRatio * end;
+	if (NoneOf(nearlyCollinear))
 	{
-		T theta = acos(dot);
-		T sinThetaRecip = 1 / sin(theta);
-		T startRatio = sin((1 - t) * theta) * sinThetaRecip;
-		T endRatio = sin(t * theta) * sinThetaRecip;
-		return *this * startRatio + end * endRatio;
+		return slerped;
 	}
+	return interior::SelectComponents(nearlyCollinear, Lerp(end, t), slerped);
 }
 
 template<typename T>
@@ -418,17 +445,17 @@ T LengthSq(const Quaternion<T>& quat)
 	return quat.x * quat.x + quat.y * quat.y + quat.z * quat.z + quat.w * quat.w;
 }
 
-template<typename T>
+template<Precision precision, typename T>
 T Length(const Quaternion<T>& quat)
 {
-	return sqrt(quat.x * quat.x + quat.y * quat.y + quat.z * quat.z + quat.w * quat.w);
+	return quat.template Length<precision>();
 }
 
-template<typename T>
+template<Precision precision, typename T>
 Quaternion<T> Normalize(const Quaternion<T>& quat)
 {
 	Quaternion<T> retQuat(quat);
-	retQuat.Normalize();
+	retQuat.template Normalize<precision>();
 	return retQuat;
 }
 
@@ -447,7 +474,7 @@ Quaternion<T> Identity()
 template<typename T>
 Quaternion<T> Conjugate(const Quaternion<T>& quat)
 {
-	return Quaternion<T> retQuat(-quat.x, -quat.y, -quat.z, quat.w);
+	return Quaternion<T>(-quat.x, -quat.y, -quat.z, quat.w);
 }
 
 template<typename T>
@@ -486,4 +513,29 @@ template<typename T>
 Quaternion<T> SlerpAngleWeights(const Quaternion<T>& start, const Quaternion<T>& end, float t)
 {
 	return start.SlerpAngleWeights(end, t);
-}
\ No newline at end of file
+}
+
+template<typename T, typename Mask>
+Quaternion<T> interior::SelectComponents(const Mask& mask, const Quaternion<T>& a, const Quaternion<T>& b)
+{
+	return Quaternion<T>(Select(mask, a.x, b.x), Select(mask, a.y, b.y), Select(mask, a.z, b.z), Select(mask, a.w, b.w));
+}
+
+#if defined(MATH_HAS_SSE4_1) && !defined(MATH_NO_SIMD)
+// float specializations using the SSE kernels (see SimdKernels.h)
+// x, y, z, and w are laid out contiguously, so a quaternion loads as one register
+template<>
+inline Quaternion<float> Quaternion<float>::operator*(const Quaternion<float>& rhs) const
+{
+	Quaternion<float> result;
+	_mm_storeu_ps(&result.x, interior::SimdQuaternionMultiply(_mm_loadu_ps(&x), _mm_loadu_ps(&rhs.x)));
+	return result;
+}
+
+template<>
+inline Quaternion<float>& Quaternion<float>::operator*=(const Quaternion<float>& rhs)
+{
+	_mm_storeu_ps(&x, interior::SimdQuaternionMultiply(_mm_loadu_ps(&x), _mm_loadu_ps(&rhs.x)));
+	return *this;
+}
+#endif // MATH_HAS_SSE4_1 && !MATH_NO_SIMD
@@ -0,0 +1,423 @@
+#pragma once
+#include <cstddef>
+#include "Quaternion.h"
+#include "SimdKernels.h"
+
+#ifndef MATH_HAS_SSE4_1
+#error "QuaternionBatch.h needs SSE4.1; compile with -msse4.1 (or -march=native), or /arch:AVX on MSVC"
+#endif
+
+// Batched SSE4.1 kernels over arrays of Quaternion<float>, processing 4 quaternions per iteration
+// Matrices are read and written as raw row-major floats laid out exactly like SquareMatrix<float, 3>/<float, 4>::data,
+//  so results can be written straight into GPU upload buffers without constructing SquareMatrix objects
+// 3x4 matrices are the top three rows of an affine 4x4 matrix (12 floats, translation column set to 0)
+// Quaternion to matrix conversion matches SquareMatrix::Rotation(const Quaternion<T>&), including its handling of non-unit quaternions
+// Matrix to quaternion conversion matches SquareMatrix::ToQuaternion, but selects the largest component with masks instead of branches
+// Angular velocity integration works on structure-of-arrays data so each register load fills 4 bodies without any transposing
+
+// Structure-of-arrays view of quaternions whose components are stored in separate arrays
+struct QuaternionSoA
+{
+	float* x;
+	float* y;
+	float* z;
+	float* w;
+};
+
+// Structure-of-arrays view of 3D vectors whose components are stored in separate arrays
+struct Vector3SoA
+{
+	const float* x;
+	const float* y;
+	const float* z;
+};
+
+// How IntegrateAngularVelocityBatch advances each orientation over a timestep
+enum class AngularIntegration
+{
+	// q += 0.5 * dt * (w, 0) * q, then renormalize; cheapest, but the rotation angle shrinks as |w| * dt grows
+	FirstOrder,
+	// q = exp(0.5 * dt * (w, 0)) * q, then renormalize; exact rotation for half-angles |w| * dt / 2 up to about 1 radian,
+	//  using polynomial sin/cos so no scalar trig calls are needed
+	ExponentialMap
+};
+
+// Batched quaternion free functions
+// Write count 3x3 rotation matrices (9 floats each) from quats into outMats
+void RotationBatch3x3(const Quaternion<float>* quats, float* outMats, std::size_t count);
+// Write count 3x4 affine rotation matrices (12 floats each) from quats into outMats
+void RotationBatch3x4(const Quaternion<float>* quats, float* outMats, std::size_t count);
+// Write count 4x4 affine rotation matrices (16 floats each) from quats into outMats
+void RotationBatch4x4(const Quaternion<float>* quats, float* outMats, std::size_t count);
+
+// Write the quaternions that count 3x3 rotation matrices (9 floats each) represent into outQuats
+void ToQuaternionBatch3x3(const float* mats, Quaternion<float>* outQuats, std::size_t count);
+// Write the quaternions that count 3x4 affine rotation matrices (12 floats each) represent into outQuats
+void ToQuaternionBatch3x4(const float* mats, Quaternion<float>* outQuats, std::size_t count);
+// Write the quaternions that count 4x4 affine rotation matrices (16 floats each) represent into outQuats
+void ToQuaternionBatch4x4(const float* mats, Quaternion<float>* outQuats, std::size_t count);
+
+// Rotate count unit orientations in place by world space angular velocities (radians per second) over dt seconds, renormalizing the results
+void IntegrateAngularVelocityBatch(QuaternionSoA orientations, Vector3SoA angularVelocities, float dt, std::size_t count,
+								   AngularIntegration method = AngularIntegration::ExponentialMap);
+
+namespace interior
+{
+	// Kernels for exactly 4 matrices templated on the matrix layout
+	template<std::size_t rowStride, std::size_t matStride>
+	void RotationFour(const Quaternion<float>* quats, float* outMats);
+	template<std::size_t rowStride, std::size_t matStride>
+	void ToQuaternionFour(const float* mats, Quaternion<float>* outQuats);
+
+	// Run a 4-wide kernel over count elements, padding any remainder out to 4 with identities
+	template<std::size_t rowStride, std::size_t matStride>
+	void RotationBatch(const Quaternion<float>* quats, float* outMats, std::size_t count);
+	template<std::size_t rowStride, std::size_t matStride>
+	void ToQuaternionBatch(const float* mats, Quaternion<float>* outQuats, std::size_t count);
+
+	// Integrate 4 orientations starting at the given offset into the arrays
+	template<AngularIntegration method>
+	void IntegrateAngularVelocityFour(QuaternionSoA orientations, Vector3SoA angularVelocities, __m128 halfDt, std::size_t offset);
+	template<AngularIntegration method>
+	void IntegrateAngularVelocityBatch(QuaternionSoA orientations, Vector3SoA angularVelocities, float dt, std::size_t count);
+
+	// Store the first 3 floats of vec without touching the 4th float in memory
+	void StoreFloat3(float* dest, __m128 vec);
+}
+
+// Implementations
+// Batched quaternion free function implementations
+inline void RotationBatch3x3(const Quaternion<float>* quats, float* outMats, std::size_t count)
+{
+	interior::RotationBatch<3, 9>(quats, outMats, count);
+}
+
+inline void RotationBatch3x4(const Quaternion<float>* quats, float* outMats, std::size_t count)
+{
+	interior::RotationBatch<4, 12>(quats, outMats, count);
+}
+
+inline void RotationBatch4x4(const Quaternion<float>* quats, float* outMats, std::size_t count)
+{
+	interior::RotationBatch<4, 16>(quats, outMats, count);
+}
+
+inline void ToQuaternionBatch3x3(const float* mats, Quaternion<float>* outQuats, std::size_t count)
+{
+	interior::ToQuaternionBatch<3, 9>(mats, outQuats, count);
+}
+
+inline void ToQuaternionBatch3x4(const float* mats, Quaternion<float>* outQuats, std::size_t count)
+{
+	interior::ToQuaternionBatch<4, 12>(mats, outQuats, count);
+}
+
+inline void ToQuaternionBatch4x4(const float* mats, Quaternion<float>* outQuats, std::size_t count)
+{
+	interior::ToQuaternionBatch<4, 16>(mats, outQuats, count);
+}
+
+inline void IntegrateAngularVelocityBatch(QuaternionSoA orientations, Vector3SoA angularVelocities, float dt, std::size_t count,
+										  AngularIntegration method)
+{
+	// Choose the kernel once here rather than branching for every 4 bodies
+	if (method == AngularIntegration::FirstOrder)
+	{
+		interior::IntegrateAngularVelocityBatch<AngularIntegration::FirstOrder>(orientations, angularVelocities, dt, count);
+	}
+	else
+	{
+		interior::IntegrateAngularVelocityBatch<AngularIntegration::ExponentialMap>(orientations, angularVelocities, dt, count);
+	}
+}
+
+// Interior implementations
+template<std::size_t rowStride, std::size_t matStride>
+void interior::RotationFour(const Quaternion<float>* quats, float* outMats)
+{
+	static_assert(sizeof(Quaternion<float>) == 4 * sizeof(float), "Quaternion<float> must be 4 tightly packed floats");
+
+	// Load one quaternion per row and transpose so each register holds one component of all 4 quaternions
+	__m128 x = _mm_loadu_ps(&quats[0].x);
+	__m128 y = _mm_loadu_ps(&quats[1].x);
+	__m128 z = _mm_loadu_ps(&quats[2].x);
+	__m128 w = _mm_loadu_ps(&quats[3].x);
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+
+	// S = 2.0f if quat is normalized
+	__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)));
+	__m128 s = _mm_div_ps(_mm_set_ps1(2.0f), lengthSq);
+
+	__m128 sx = _mm_mul_ps(s, x);
+	__m128 sy = _mm_mul_ps(s, y);
+	__m128 sz = _mm_mul_ps(s, z);
+	__m128 sxx = _mm_mul_ps(sx, x);
+	__m128 syy = _mm_mul_ps(sy, y);
+	__m128 szz = _mm_mul_ps(sz, z);
+	__m128 sxy = _mm_mul_ps(sx, y);
+	__m128 sxz = _mm_mul_ps(sx, z);
+	__m128 syz = _mm_mul_ps(sy, z);
+	__m128 swx = _mm_mul_ps(sx, w);
+	__m128 swy = _mm_mul_ps(sy, w);
+	__m128 swz = _mm_mul_ps(sz, w);
+
+	const __m128 one = _mm_set_ps1(1.0f);
+	const __m128 zero = _mm_setzero_ps();
+	// Each row register holds that element of all 4 matrices; the 4th register is the zero translation column
+	__m128 rows[3][4] = {
+		{ _mm_sub_ps(_mm_sub_ps(one, syy), szz), _mm_sub_ps(sxy, swz), _mm_add_ps(sxz, swy), zero },
+		{ _mm_add_ps(sxy, swz), _mm_sub_ps(_mm_sub_ps(one, sxx), szz), _mm_sub_ps(syz, swx), zero },
+		{ _mm_sub_ps(sxz, swy), _mm_add_ps(syz, swx), _mm_sub_ps(_mm_sub_ps(one, sxx), syy), zero } };
+
+	for (std::size_t row = 0; row < 3; ++row)
+	{
+		// Transpose so register i holds this row of matrix i
+		_MM_TRANSPOSE4_PS(rows[row][0], rows[row][1], rows[row][2], rows[row][3]);
+		for (std::size_t mat = 0; mat < 4; ++mat)
+		{
+			float* dest = outMats + mat * matStride + row * rowStride;
+			if (rowStride == 4)
+			{
+				_mm_storeu_ps(dest, rows[row][mat]);
+			}
+			else
+			{
+				StoreFloat3(dest, rows[row][mat]);
+			}
+		}
+	}
+
+	// 0 0 0 1
+	if (matStride == 16)
+	{
+		const __m128 bottomRow = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+		for (std::size_t mat = 0; mat < 4; ++mat)
+		{
+			_mm_storeu_ps(outMats + mat * matStride + 12, bottomRow);
+		}
+	}
+}
+
+template<std::size_t rowStride, std::size_t matStride>
+void interior::ToQuaternionFour(const float* mats, Quaternion<float>* outQuats)
+{
+	// Gather the upper 3x3 so that m[row][col] holds that element of all 4 matrices
+	__m128 m[3][4];
+	for (std::size_t row = 0; row < 3; ++row)
+	{
+		if (rowStride == 4)
+		{
+			// Rows are 4 floats wide, so load them whole and transpose; the 4th column is ignored
+			for (std::size_t mat = 0; mat < 4; ++mat)
+			{
+				m[row][mat] = _mm_loadu_ps(mats + mat * matStride + row * 4);
+			}
+			_MM_TRANSPOSE4_PS(m[row][0], m[row][1], m[row][2], m[row][3]);
+		}
+		else
+		{
+			// Tightly packed 3x3 rows can't be loaded 4 at a time without reading past the last matrix
+			for (std::size_t col = 0; col < 3; ++col)
+			{
+				const float* elem = mats + row * rowStride + col;
+				m[row][col] = _mm_setr_ps(elem[0], elem[matStride], elem[2 * matStride], elem[3 * matStride]);
+			}
+		}
+	}
+
+	// For a unit quaternion these are 4w^2, 4x^2, 4y^2, and 4z^2
+	const __m128 one = _mm_set_ps1(1.0f);
+	__m128 tW = _mm_add_ps(_mm_add_ps(one, m[0][0]), _mm_add_ps(m[1][1], m[2][2]));
+	__m128 tX = _mm_sub_ps(_mm_add_ps(one, m[0][0]), _mm_add_ps(m[1][1], m[2][2]));
+	__m128 tY = _mm_sub_ps(_mm_add_ps(one, m[1][1]), _mm_add_ps(m[0][0], m[2][2]));
+	__m128 tZ = _mm_sub_ps(_mm_add_ps(one, m[2][2]), _mm_add_ps(m[0][0], m[1][1]));
+
+	// Pick the largest per lane, preferring w, then x, then y on ties like the scalar ToQuaternion
+	__m128 t = tW;
+	__m128 isX = _mm_cmpgt_ps(tX, t);
+	t = _mm_max_ps(t, tX);
+	__m128 isY = _mm_cmpgt_ps(tY, t);
+	t = _mm_max_ps(t, tY);
+	__m128 isZ = _mm_cmpgt_ps(tZ, t);
+	t = _mm_max_ps(t, tZ);
+
+	__m128 sumXY = _mm_add_ps(m[0][1], m[1][0]);
+	__m128 sumXZ = _mm_add_ps(m[0][2], m[2][0]);
+	__m128 sumYZ = _mm_add_ps(m[1][2], m[2][1]);
+	__m128 diffX = _mm_sub_ps(m[2][1], m[1][2]);
+	__m128 diffY = _mm_sub_ps(m[0][2], m[2][0]);
+	__m128 diffZ = _mm_sub_ps(m[1][0], m[0][1]);
+
+	// Select each component's numerator for the winning case, defaulting to the w case
+	// Later blends take precedence, so a lane where x won and then y beat it ends up with the y case
+	__m128 x = _mm_blendv_ps(_mm_blendv_ps(_mm_blendv_ps(diffX, t, isX), sumXY, isY), sumXZ, isZ);
+	__m128 y = _mm_blendv_ps(_mm_blendv_ps(_mm_blendv_ps(diffY, sumXY, isX), t, isY), sumYZ, isZ);
+	__m128 z = _mm_blendv_ps(_mm_blendv_ps(_mm_blendv_ps(diffZ, sumXZ, isX), sumYZ, isY), t, isZ);
+	__m128 w = _mm_blendv_ps(_mm_blendv_ps(_mm_blendv_ps(t, diffX, isX), diffY, isY), diffZ, isZ);
+
+	// Every component is divided by 4 times the largest component, which is 2 * sqrt(t)
+	__m128 k = _mm_div_ps(_mm_set_ps1(0.5f), _mm_sqrt_ps(t));
+	x = _mm_mul_ps(x, k);
+	y = _mm_mul_ps(y, k);
+	z = _mm_mul_ps(z, k);
+	w = _mm_mul_ps(w, k);
+
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	_mm_storeu_ps(&outQuats[0].x, x);
+	_mm_storeu_ps(&outQuats[1].x, y);
+	_mm_storeu_ps(&outQuats[2].x, z);
+	_mm_storeu_ps(&outQuats[3].x, w);
+}
+
+template<std::size_t rowStride, std::size_t matStride>
+void interior::RotationBatch(const Quaternion<float>* quats, float* outMats, std::size_t count)
+{
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		RotationFour<rowStride, matStride>(quats + i, outMats + i * matStride);
+	}
+
+	if (i < count)
+	{
+		Quaternion<float> tailQuats[4];
+		float tailMats[4 * matStride];
+		for (std::size_t j = 0; i + j < count; ++j)
+		{
+			tailQuats[j] = quats[i + j];
+		}
+		RotationFour<rowStride, matStride>(tailQuats, tailMats);
+		for (std::size_t j = 0; j < (count - i) * matStride; ++j)
+		{
+			outMats[i * matStride + j] = tailMats[j];
+		}
+	}
+}
+
+template<std::size_t rowStride, std::size_t matStride>
+void interior::ToQuaternionBatch(const float* mats, Quaternion<float>* outQuats, std::size_t count)
+{
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		ToQuaternionFour<rowStride, matStride>(mats + i * matStride, outQuats + i);
+	}
+
+	if (i < count)
+	{
+		// Zeroed padding still converts cleanly because its w case has t = 1
+		float tailMats[4 * matStride] = {};
+		Quaternion<float> tailQuats[4];
+		for (std::size_t j = 0; j < (count - i) * matStride; ++j)
+		{
+			tailMats[j] = mats[i * matStride + j];
+		}
+		ToQuaternionFour<rowStride, matStride>(tailMats, tailQuats);
+		for (std::size_t j = 0; i + j < count; ++j)
+		{
+			outQuats[i + j] = tailQuats[j];
+		}
+	}
+}
+
+template<AngularIntegration method>
+void interior::IntegrateAngularVelocityFour(QuaternionSoA orientations, Vector3SoA angularVelocities, __m128 halfDt, std::size_t offset)
+{
+	__m128 qx = _mm_loadu_ps(orientations.x + offset);
+	__m128 qy = _mm_loadu_ps(orientations.y + offset);
+	__m128 qz = _mm_loadu_ps(orientations.z + offset);
+	__m128 qw = _mm_loadu_ps(orientations.w + offset);
+
+	// Half of the rotation vector for this step, since quaternions rotate by twice their angle
+	__m128 hx = _mm_mul_ps(_mm_loadu_ps(angularVelocities.x + offset), halfDt);
+	__m128 hy = _mm_mul_ps(_mm_loadu_ps(angularVelocities.y + offset), halfDt);
+	__m128 hz = _mm_mul_ps(_mm_loadu_ps(angularVelocities.z + offset), halfDt);
+
+	// Build the delta rotation dq = (h * sin(|h|) / |h|, cos(|h|)); first order is the same with sin(|h|) / |h| and cos(|h|) taken as 1
+	__m128 dx, dy, dz, dw;
+	const __m128 one = _mm_set_ps1(1.0f);
+	if (method == AngularIntegration::ExponentialMap)
+	{
+		// Taylor series in theta^2 evaluated with Horner's method; the first omitted term is below float precision for theta <= 1
+		__m128 thetaSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(hx, hx), _mm_mul_ps(hy, hy)), _mm_mul_ps(hz, hz));
+		__m128 cosTheta = _mm_add_ps(_mm_mul_ps(thetaSq, _mm_set_ps1(1.0f / 40320.0f)), _mm_set_ps1(-1.0f / 720.0f));
+		cosTheta = _mm_add_ps(_mm_mul_ps(thetaSq, cosTheta), _mm_set_ps1(1.0f / 24.0f));
+		cosTheta = _mm_add_ps(_mm_mul_ps(thetaSq, cosTheta), _mm_set_ps1(-0.5f));
+		cosTheta = _mm_add_ps(_mm_mul_ps(thetaSq, cosTheta), one);
+		__m128 sinc = _mm_add_ps(_mm_mul_ps(thetaSq, _mm_set_ps1(1.0f / 362880.0f)), _mm_set_ps1(-1.0f / 5040.0f));
+		sinc = _mm_add_ps(_mm_mul_ps(thetaSq, sinc), _mm_set_ps1(1.0f / 120.0f));
+		sinc = _mm_add_ps(_mm_mul_ps(thetaSq, sinc), _mm_set_ps1(-1.0f / 6.0f));
+		sinc = _mm_add_ps(_mm_mul_ps(thetaSq, sinc), one);
+
+		dx = _mm_mul_ps(hx, sinc);
+		dy = _mm_mul_ps(hy, sinc);
+		dz = _mm_mul_ps(hz, sinc);
+		dw = cosTheta;
+	}
+	else
+	{
+		dx = hx;
+		dy = hy;
+		dz = hz;
+		dw = one;
+	}
+
+	// q = dq * q, expanded from Quaternion::operator*
+	__m128 rx = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dw, qx), _mm_mul_ps(qw, dx)), _mm_mul_ps(dy, qz)), _mm_mul_ps(dz, qy));
+	__m128 ry = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dw, qy), _mm_mul_ps(qw, dy)), _mm_mul_ps(dz, qx)), _mm_mul_ps(dx, qz));
+	__m128 rz = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dw, qz), _mm_mul_ps(qw, dz)), _mm_mul_ps(dx, qy)), _mm_mul_ps(dy, qx));
+	__m128 rw = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_mul_ps(dw, qw), _mm_mul_ps(dx, qx)), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz));
+
+	// Renormalize to remove the drift first order integration and rounding introduce
+	__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)), _mm_add_ps(_mm_mul_ps(rz, rz), _mm_mul_ps(rw, rw)));
+	__m128 lengthRecip = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+
+	_mm_storeu_ps(orientations.x + offset, _mm_mul_ps(rx, lengthRecip));
+	_mm_storeu_ps(orientations.y + offset, _mm_mul_ps(ry, lengthRecip));
+	_mm_storeu_ps(orientations.z + offset, _mm_mul_ps(rz, lengthRecip));
+	_mm_storeu_ps(orientations.w + offset, _mm_mul_ps(rw, lengthRecip));
+}
+
+template<AngularIntegration method>
+void interior::IntegrateAngularVelocityBatch(QuaternionSoA orientations, Vector3SoA angularVelocities, float dt, std::size_t count)
+{
+	const __m128 halfDt = _mm_set_ps1(0.5f * dt);
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		IntegrateAngularVelocityFour<method>(orientations, angularVelocities, halfDt, i);
+	}
+
+	// Pad the remainder out to 4 with identities that have no angular velocity
+	if (i < count)
+	{
+		float tailX[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, tailY[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float tailZ[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, tailW[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		float tailVelX[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, tailVelY[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, tailVelZ[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (std::size_t j = 0; i + j < count; ++j)
+		{
+			tailX[j] = orientations.x[i + j];
+			tailY[j] = orientations.y[i + j];
+			tailZ[j] = orientations.z[i + j];
+			tailW[j] = orientations.w[i + j];
+			tailVelX[j] = angularVelocities.x[i + j];
+			tailVelY[j] = angularVelocities.y[i + j];
+			tailVelZ[j] = angularVelocities.z[i + j];
+		}
+		IntegrateAngularVelocityFour<method>(QuaternionSoA{ tailX, tailY, tailZ, tailW }, Vector3SoA{ tailVelX, tailVelY, tailVelZ }, halfDt, 0);
+		for (std::size_t j = 0; i + j < count; ++j)
+		{
+			orientations.x[i + j] = tailX[j];
+			orientations.y[i + j] = tailY[j];
+			orientations.z[i + j] = tailZ[j];
+			orientations.w[i + j] = tailW[j];
+		}
+	}
+}
+
+inline void interior::StoreFloat3(float* dest, __m128 vec)
+{
+	// Store x and y, then move z down to store it alone
+	_mm_storel_pi(reinterpret_cast<__m64*>(dest), vec);
+	_mm_store_ss(dest + 2, _mm_movehl_ps(vec, vec));
+}
@@ -0,0 +1,405 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include "Quaternion.h"
+#include "SimdKernels.h"
+
+#ifndef MATH_HAS_SSE4_1
+#error "QuaternionCompression.h needs SSE4.1; compile with -msse4.1 (or -march=native), or /arch:AVX on MSVC"
+#endif
+
+// Defines smallest-three compressed storage for unit Quaternion<float>s
+// A unit quaternion's largest-magnitude component can be rebuilt from the other three as sqrt(1 - a^2 - b^2 - c^2),
+//  so only the index of the largest component (2 bits) and the three smallest components are stored
+// q and -q represent the same rotation, so the quaternion is negated when needed to make the dropped component positive
+// The three smallest components always lie within [-1/sqrt(2), 1/sqrt(2)], which is the range quantized to bitsPerComponent bits
+// Worst-case error per stored component is (1/sqrt(2)) / (2^bitsPerComponent - 1), i.e. ~6.9e-4 with 10 bits and ~2.2e-5 with 15 bits
+// There are using aliases for the common 32 bit and 48 bit formats at the end of the declarations
+// The batch functions encode and decode 4 quaternions per iteration with SSE4.1 using the same quantization as the scalar Encode/Decode
+
+template<unsigned int bitsPerComponent>
+struct SmallestThreeQuaternion
+{
+	static_assert(bitsPerComponent >= 2 && bitsPerComponent <= 15, "SmallestThreeQuaternion supports 2 to 15 bits per component");
+
+	// Index of the dropped component in the top 2 bits, followed by the three kept components in x, y, z, w order
+	static constexpr unsigned int totalBits = 2 + 3 * bitsPerComponent;
+	static constexpr std::uint32_t componentMask = (1u << bitsPerComponent) - 1;
+
+	// Packed bits stored as 16 bit words (least significant first) so the 48 bit format is 6 bytes rather than 8
+	std::uint16_t words[(totalBits + 15) / 16];
+
+	// Default to the identity quaternion
+	SmallestThreeQuaternion();
+	// Compress quat assuming it is a unit quaternion
+	explicit SmallestThreeQuaternion(const Quaternion<float>& quat);
+
+	// Compress quat into this assuming it is a unit quaternion
+	SmallestThreeQuaternion<bitsPerComponent>& Encode(const Quaternion<float>& quat);
+	// Rebuild the unit quaternion this represents
+	Quaternion<float> Decode() const;
+
+	// Raw access to the packed bits
+	std::uint64_t GetPacked() const;
+	void SetPacked(std::uint64_t packed);
+};
+
+// Compressed quaternion free functions
+// Compress count unit quaternions from quats into outPacked
+template<unsigned int bitsPerComponent>
+void EncodeBatch(const Quaternion<float>* quats, SmallestThreeQuaternion<bitsPerComponent>* outPacked, std::size_t count);
+// Decompress count quaternions from packed into outQuats
+template<unsigned int bitsPerComponent>
+void DecodeBatch(const SmallestThreeQuaternion<bitsPerComponent>* packed, Quaternion<float>* outQuats, std::size_t count);
+
+// Common aliases
+using CompressedQuat32 = SmallestThreeQuaternion<10>;
+using CompressedQuat48 = SmallestThreeQuaternion<15>;
+
+// Quantization helpers shared by the scalar and SIMD paths so both produce the same bits
+namespace interior
+{
+	// 1/sqrt(2), the largest magnitude any of the three smallest components of a unit quaternion can have
+	constexpr float kSmallestThreeRange = 0.707106781186547524f;
+
+	template<unsigned int bitsPerComponent>
+	std::uint32_t QuantizeSmallestThree(float val);
+	template<unsigned int bitsPerComponent>
+	float DequantizeSmallestThree(std::uint32_t quantized);
+
+	// Encode/decode exactly 4 quaternions with SSE4.1
+	template<unsigned int bitsPerComponent>
+	void EncodeFour(const Quaternion<float>* quats, SmallestThreeQuaternion<bitsPerComponent>* outPacked);
+	template<unsigned int bitsPerComponent>
+	void DecodeFour(const SmallestThreeQuaternion<bitsPerComponent>* packed, Quaternion<float>* outQuats);
+}
+
+// Implementations
+// SmallestThreeQuaternion member implementations
+template<unsigned int bitsPerComponent>
+SmallestThreeQuaternion<bitsPerComponent>::SmallestThreeQuaternion()
+{
+	Encode(Quaternion<float>::identity);
+}
+
+template<unsigned int bitsPerComponent>
+SmallestThreeQuaternion<bitsPerComponent>::SmallestThreeQuaternion(const Quaternion<float>& quat)
+{
+	Encode(quat);
+}
+
+template<unsigned int bitsPerComponent>
+SmallestThreeQuaternion<bitsPerComponent>& SmallestThreeQuaternion<bitsPerComponent>::Encode(const Quaternion<float>& quat)
+{
+	const float components[4] = { quat.x, quat.y, quat.z, quat.w };
+
+	// Find the largest-magnitude component, preferring the lowest index on ties to match the SIMD path
+	std::uint32_t largest = 0;
+	for (std::uint32_t i = 1; i < 4; ++i)
+	{
+		if (std::fabs(components[i]) > std::fabs(components[largest]))
+		{
+			largest = i;
+		}
+	}
+
+	// Negate the whole quaternion if needed so the dropped component is positive
+	float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+	std::uint64_t packed = largest;
+	for (std::uint32_t i = 0; i < 4; ++i)
+	{
+		if (i != largest)
+		{
+			packed = (packed << bitsPerComponent) | interior::QuantizeSmallestThree<bitsPerComponent>(components[i] * sign);
+		}
+	}
+	SetPacked(packed);
+	return *this;
+}
+
+template<unsigned int bitsPerComponent>
+Quaternion<float> SmallestThreeQuaternion<bitsPerComponent>::Decode() const
+{
+	std::uint64_t packed = GetPacked();
+	float c = interior::DequantizeSmallestThree<bitsPerComponent>(static_cast<std::uint32_t>(packed & componentMask));
+	float b = interior::DequantizeSmallestThree<bitsPerComponent>(static_cast<std::uint32_t>((packed >> bitsPerComponent) & componentMask));
+	float a = interior::DequantizeSmallestThree<bitsPerComponent>(static_cast<std::uint32_t>((packed >> (2 * bitsPerComponent)) & componentMask));
+	std::uint32_t largestIndex = static_cast<std::uint32_t>(packed >> (3 * bitsPerComponent)) & 3;
+
+	// Quantization error can push the sum slightly past 1, so clamp before the sqrt
+	float largest = std::sqrt(std::fmax(0.0f, 1.0f - a * a - b * b - c * c));
+
+	switch (largestIndex)
+	{
+	case 0:
+		return Quaternion<float>(largest, a, b, c);
+	case 1:
+		return Quaternion<float>(a, largest, b, c);
+	case 2:
+		return Quaternion<float>(a, b, largest, c);
+	default:
+		return Quaternion<float>(a, b, c, largest);
+	}
+}
+
+template<unsigned int bitsPerComponent>
+std::uint64_t SmallestThreeQuaternion<bitsPerComponent>::GetPacked() const
+{
+	std::uint64_t packed = 0;
+	for (std::size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i)
+	{
+		packed |= static_cast<std::uint64_t>(words[i]) << (16 * i);
+	}
+	return packed;
+}
+
+template<unsigned int bitsPerComponent>
+void SmallestThreeQuaternion<bitsPerComponent>::SetPacked(std::uint64_t packed)
+{
+	for (std::size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i)
+	{
+		words[i] = static_cast<std::uint16_t>(packed >> (16 * i));
+	}
+}
+
+// Compressed quaternion free function implementations
+template<unsigned int bitsPerComponent>
+void EncodeBatch(const Quaternion<float>* quats, SmallestThreeQuaternion<bitsPerComponent>* outPacked, std::size_t count)
+{
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		interior::EncodeFour(quats + i, outPacked + i);
+	}
+
+	// Pad the remainder out to 4 with identities so it can go through the same kernel
+	if (i < count)
+	{
+		Quaternion<float> tailQuats[4];
+		SmallestThreeQuaternion<bitsPerComponent> tailPacked[4];
+		for (std::size_t j = 0; i + j < count; ++j)
+		{
+			tailQuats[j] = quats[i + j];
+		}
+		interior::EncodeFour(tailQuats, tailPacked);
+		for (std::size_t j = 0; i + j < count; ++j)
+		{
+			outPacked[i + j] = tailPacked[j];
+		}
+	}
+}
+
+template<unsigned int bitsPerComponent>
+void DecodeBatch(const SmallestThreeQuaternion<bitsPerComponent>* packed, Quaternion<float>* outQuats, std::size_t count)
+{
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		interior::DecodeFour(packed + i, outQuats + i);
+	}
+
+	if (i < count)
+	{
+		SmallestThreeQuaternion<bitsPerComponent> tailPacked[4];
+		Quaternion<float> tailQuats[4];
+		for (std::size_t j = 0; i + j < count; ++j)
+		{
+			tailPacked[j] = packed[i + j];
+		}
+		interior::DecodeFour(tailPacked, tailQuats);
+		for (std::size_t j = 0; i + j < count; ++j)
+		{
+			outQuats[i + j] = tailQuats[j];
+		}
+	}
+}
+
+// Interior helper implementations
+template<unsigned int bitsPerComponent>
+std::uint32_t interior::QuantizeSmallestThree(float val)
+{
+	constexpr float maxQuantized = static_cast<float>((1u << bitsPerComponent) - 1);
+	val = std::fmin(std::fmax(val, -kSmallestThreeRange), kSmallestThreeRange);
+	// Map [-range, range] to [0, maxQuantized] and round to nearest by truncating after adding 0.5
+	return static_cast<std::uint32_t>((val * (0.5f / kSmallestThreeRange) + 0.5f) * maxQuantized + 0.5f);
+}
+
+template<unsigned int bitsPerComponent>
+float interior::DequantizeSmallestThree(std::uint32_t quantized)
+{
+	constexpr float maxQuantized = static_cast<float>((1u << bitsPerComponent) - 1);
+	return static_cast<float>(quantized) * (2.0f * kSmallestThreeRange / maxQuantized) - kSmallestThreeRange;
+}
+
+template<unsigned int bitsPerComponent>
+void interior::EncodeFour(const Quaternion<float>* quats, SmallestThreeQuaternion<bitsPerComponent>* outPacked)
+{
+	static_assert(sizeof(Quaternion<float>) == 4 * sizeof(float), "Quaternion<float> must be 4 tightly packed floats");
+	static_assert(SmallestThreeQuaternion<bitsPerComponent>::totalBits > 32 ||
+		sizeof(SmallestThreeQuaternion<bitsPerComponent>) == (SmallestThreeQuaternion<bitsPerComponent>::totalBits <= 16 ? 2 : 4),
+		"16 and 32 bit SmallestThreeQuaternions must be tightly packed");
+	constexpr float maxQuantized = static_cast<float>((1u << bitsPerComponent) - 1);
+
+	// Load one quaternion per row and transpose so each register holds one component of all 4 quaternions
+	__m128 x = _mm_loadu_ps(&quats[0].x);
+	__m128 y = _mm_loadu_ps(&quats[1].x);
+	__m128 z = _mm_loadu_ps(&quats[2].x);
+	__m128 w = _mm_loadu_ps(&quats[3].x);
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+
+	// Absolute values by clearing the sign bits
+	const __m128 signBits = _mm_set_ps1(-0.0f);
+	__m128 absX = _mm_andnot_ps(signBits, x);
+	__m128 absY = _mm_andnot_ps(signBits, y);
+	__m128 absZ = _mm_andnot_ps(signBits, z);
+	__m128 absW = _mm_andnot_ps(signBits, w);
+
+	// Track the largest magnitude, its index, and its signed value per lane; strict > keeps the lowest index on ties
+	__m128 maxAbs = absX;
+	__m128 largestVal = x;
+	__m128i largestIndex = _mm_setzero_si128();
+	__m128 greater = _mm_cmpgt_ps(absY, maxAbs);
+	maxAbs = _mm_blendv_ps(maxAbs, absY, greater);
+	largestVal = _mm_blendv_ps(largestVal, y, greater);
+	largestIndex = _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(largestIndex), _mm_castsi128_ps(_mm_set1_epi32(1)), greater));
+	greater = _mm_cmpgt_ps(absZ, maxAbs);
+	maxAbs = _mm_blendv_ps(maxAbs, absZ, greater);
+	largestVal = _mm_blendv_ps(largestVal, z, greater);
+	largestIndex = _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(largestIndex), _mm_castsi128_ps(_mm_set1_epi32(2)), greater));
+	greater = _mm_cmpgt_ps(absW, maxAbs);
+	largestVal = _mm_blendv_ps(largestVal, w, greater);
+	largestIndex = _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(largestIndex), _mm_castsi128_ps(_mm_set1_epi32(3)), greater));
+
+	// Negate quaternions whose largest component is negative by flipping every sign bit
+	__m128 flip = _mm_and_ps(_mm_cmplt_ps(largestVal, _mm_setzero_ps()), signBits);
+	x = _mm_xor_ps(x, flip);
+	y = _mm_xor_ps(y, flip);
+	z = _mm_xor_ps(z, flip);
+	w = _mm_xor_ps(w, flip);
+
+	// Gather the three kept components in x, y, z, w order skipping the largest
+	//  a = index == 0 ? y : x, b = index <= 1 ? z : y, c = index <= 2 ? w : z
+	__m128 isIndex0 = _mm_castsi128_ps(_mm_cmpeq_epi32(largestIndex, _mm_setzero_si128()));
+	__m128 isIndexLe1 = _mm_castsi128_ps(_mm_cmplt_epi32(largestIndex, _mm_set1_epi32(2)));
+	__m128 isIndexLe2 = _mm_castsi128_ps(_mm_cmplt_epi32(largestIndex, _mm_set1_epi32(3)));
+	__m128 kept[3] = { _mm_blendv_ps(x, y, isIndex0), _mm_blendv_ps(y, z, isIndexLe1), _mm_blendv_ps(z, w, isIndexLe2) };
+
+	// Quantize exactly like QuantizeSmallestThree
+	const __m128 range = _mm_set_ps1(kSmallestThreeRange);
+	const __m128 negRange = _mm_set_ps1(-kSmallestThreeRange);
+	const __m128 half = _mm_set_ps1(0.5f);
+	const __m128 halfInvRange = _mm_set_ps1(0.5f / kSmallestThreeRange);
+	const __m128 maxQuantizedVec = _mm_set_ps1(maxQuantized);
+	__m128i quantized[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		__m128 clamped = _mm_min_ps(_mm_max_ps(kept[i], negRange), range);
+		__m128 scaled = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(clamped, halfInvRange), half), maxQuantizedVec), half);
+		quantized[i] = _mm_cvttps_epi32(scaled);
+	}
+
+	if (SmallestThreeQuaternion<bitsPerComponent>::totalBits <= 32)
+	{
+		// Every packed value fits in a 32 bit lane, so pack and store all 4 at once
+		__m128i packed = _mm_slli_epi32(largestIndex, 3 * bitsPerComponent);
+		packed = _mm_or_si128(packed, _mm_slli_epi32(quantized[0], 2 * bitsPerComponent));
+		packed = _mm_or_si128(packed, _mm_slli_epi32(quantized[1], bitsPerComponent));
+		packed = _mm_or_si128(packed, quantized[2]);
+		if (SmallestThreeQuaternion<bitsPerComponent>::totalBits <= 16)
+		{
+			// Narrow each lane to 16 bits (no lane exceeds 0xFFFF, so the saturation never kicks in) and store the low 8 bytes
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(outPacked), _mm_packus_epi32(packed, packed));
+		}
+		else
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(outPacked), packed);
+		}
+	}
+	else
+	{
+		// Wider formats don't fit in a lane, so finish packing each quaternion in 64 bit scalar registers
+		alignas(16) std::uint32_t indices[4], as[4], bs[4], cs[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(indices), largestIndex);
+		_mm_store_si128(reinterpret_cast<__m128i*>(as), quantized[0]);
+		_mm_store_si128(reinterpret_cast<__m128i*>(bs), quantized[1]);
+		_mm_store_si128(reinterpret_cast<__m128i*>(cs), quantized[2]);
+		for (int i = 0; i < 4; ++i)
+		{
+			std::uint64_t packed = static_cast<std::uint64_t>(indices[i]) << (3 * bitsPerComponent);
+			packed |= static_cast<std::uint64_t>(as[i]) << (2 * bitsPerComponent);
+			packed |= static_cast<std::uint64_t>(bs[i]) << bitsPerComponent;
+			packed |= cs[i];
+			outPacked[i].SetPacked(packed);
+		}
+	}
+}
+
+template<unsigned int bitsPerComponent>
+void interior::DecodeFour(const SmallestThreeQuaternion<bitsPerComponent>* packed, Quaternion<float>* outQuats)
+{
+	constexpr float maxQuantized = static_cast<float>((1u << bitsPerComponent) - 1);
+	const __m128i componentMask = _mm_set1_epi32(SmallestThreeQuaternion<bitsPerComponent>::componentMask);
+
+	// Unpack the index and three quantized components of each quaternion into their own lanes
+	__m128i largestIndex, quantA, quantB, quantC;
+	if (SmallestThreeQuaternion<bitsPerComponent>::totalBits <= 32)
+	{
+		// 16 bit formats are 4 consecutive words, widened to one 32 bit lane each
+		__m128i lanes = SmallestThreeQuaternion<bitsPerComponent>::totalBits <= 16 ?
+			_mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(packed))) :
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(packed));
+		quantC = _mm_and_si128(lanes, componentMask);
+		quantB = _mm_and_si128(_mm_srli_epi32(lanes, bitsPerComponent), componentMask);
+		quantA = _mm_and_si128(_mm_srli_epi32(lanes, 2 * bitsPerComponent), componentMask);
+		largestIndex = _mm_and_si128(_mm_srli_epi32(lanes, 3 * bitsPerComponent), _mm_set1_epi32(3));
+	}
+	else
+	{
+		alignas(16) std::uint32_t indices[4], as[4], bs[4], cs[4];
+		for (int i = 0; i < 4; ++i)
+		{
+			std::uint64_t bits = packed[i].GetPacked();
+			cs[i] = static_cast<std::uint32_t>(bits) & SmallestThreeQuaternion<bitsPerComponent>::componentMask;
+			bs[i] = static_cast<std::uint32_t>(bits >> bitsPerComponent) & SmallestThreeQuaternion<bitsPerComponent>::componentMask;
+			as[i] = static_cast<std::uint32_t>(bits >> (2 * bitsPerComponent)) & SmallestThreeQuaternion<bitsPerComponent>::componentMask;
+			indices[i] = static_cast<std::uint32_t>(bits >> (3 * bitsPerComponent)) & 3;
+		}
+		largestIndex = _mm_load_si128(reinterpret_cast<const __m128i*>(indices));
+		quantA = _mm_load_si128(reinterpret_cast<const __m128i*>(as));
+		quantB = _mm_load_si128(reinterpret_cast<const __m128i*>(bs));
+		quantC = _mm_load_si128(reinterpret_cast<const __m128i*>(cs));
+	}
+
+	// Dequantize exactly like DequantizeSmallestThree
+	const __m128 step = _mm_set_ps1(2.0f * kSmallestThreeRange / maxQuantized);
+	const __m128 range = _mm_set_ps1(kSmallestThreeRange);
+	__m128 a = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(quantA), step), range);
+	__m128 b = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(quantB), step), range);
+	__m128 c = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(quantC), step), range);
+
+	// Rebuild the dropped component, clamping away any quantization overshoot
+	__m128 largest = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_set_ps1(1.0f), _mm_mul_ps(a, a)), _mm_mul_ps(b, b)), _mm_mul_ps(c, c));
+	largest = _mm_sqrt_ps(_mm_max_ps(largest, _mm_setzero_ps()));
+
+	// Scatter back to x, y, z, w
+	//  x = index == 0 ? largest : a
+	//  y = index == 0 ? a : (index == 1 ? largest : b)
+	//  z = index <= 1 ? b : (index == 2 ? largest : c)
+	//  w = index == 3 ? largest : c
+	__m128 isIndex0 = _mm_castsi128_ps(_mm_cmpeq_epi32(largestIndex, _mm_setzero_si128()));
+	__m128 isIndex1 = _mm_castsi128_ps(_mm_cmpeq_epi32(largestIndex, _mm_set1_epi32(1)));
+	__m128 isIndex2 = _mm_castsi128_ps(_mm_cmpeq_epi32(largestIndex, _mm_set1_epi32(2)));
+	__m128 isIndex3 = _mm_castsi128_ps(_mm_cmpeq_epi32(largestIndex, _mm_set1_epi32(3)));
+	__m128 x = _mm_blendv_ps(a, largest, isIndex0);
+	__m128 y = _mm_blendv_ps(_mm_blendv_ps(b, largest, isIndex1), a, isIndex0);
+	__m128 z = _mm_blendv_ps(_mm_blendv_ps(c, largest, isIndex2), b, _mm_or_ps(isIndex0, isIndex1));
+	__m128 w = _mm_blendv_ps(c, largest, isIndex3);
+
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	_mm_storeu_ps(&outQuats[0].x, x);
+	_mm_storeu_ps(&outQuats[1].x, y);
+	_mm_storeu_ps(&outQuats[2].x, z);
+	_mm_storeu_ps(&outQuats[3].x, w);
+}
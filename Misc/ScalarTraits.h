@@ -0,0 +1,149 @@
+#pragma once
+#include <type_traits>
+#include <cmath>
+
+// The hardware reciprocal square root estimate needs SSE, which every x86-64 target has but 32-bit x86 builds may not enable
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MATH_HAS_SSE 1
+#include <xmmintrin.h>
+#endif
+
+// Defines the scalar concept shared by the Vector, Matrix, and Quaternion libraries
+// A scalar is any arithmetic type, or a SIMD packet type that opts in by specializing IsMathScalar (see SimdPacket.h)
+// Packet scalars must provide:
+//  -construction from float and the usual arithmetic operators
+//  -comparisons that return a lane mask instead of bool
+//  -free sqrt, abs, min, max, sin, cos, and acos overloads
+//  -free Select, AllOf, and NoneOf overloads taking their mask type
+// Library code calls these unqualified (after a using declaration for the std version) so argument-dependent lookup finds the packet overloads,
+//  which lets arithmetic and packet scalars share one implementation
+// Code that would branch on a comparison instead computes both sides and uses Select, using AllOf/NoneOf to skip work when every lane agrees
+
+// Precision selects how Length and Normalize compute square roots, trading accuracy for speed:
+//  -Exact: full sqrt and divide, correctly rounded
+//  -Fast: hardware reciprocal square root estimate (rsqrtss/rsqrtps), relative error at most 1.5 * 2^-12 (about 3.7e-4)
+//  -Refined: the Fast estimate plus one Newton-Raphson step, relative error about 2^-22 for a fraction of the cost of Exact
+// Only float (on targets with SSE) and float packets have a hardware estimate; other arithmetic types always compute Exact
+// Fast and Refined are only meaningful for positive, finite inputs; a zero length still yields a zero Length,
+//  but Normalize of a zero vector is undefined in every mode
+enum class Precision
+{
+	Exact,
+	Fast,
+	Refined
+};
+
+// Tag type for overloading on a Precision (packet types add overloads taking these)
+template<Precision precision>
+struct PrecisionTag {};
+
+template<typename T>
+struct IsMathScalar : std::is_arithmetic<T> {};
+
+// Scalar free functions for arithmetic types, where a mask is just a bool
+// Return a where mask is set and b elsewhere
+template<typename T>
+T Select(bool mask, const T& a, const T& b);
+// Whether every lane of mask is set
+bool AllOf(bool mask);
+// Whether no lane of mask is set
+bool NoneOf(bool mask);
+// Lane-wise |val| <= epsilon, returning bool for arithmetic scalars and a mask for packets
+template<typename T>
+auto IsNearZero(const T& val, const T& epsilon = T(0.001f)) -> decltype(val <= epsilon);
+// 1 / sqrt(val) computed at the given precision
+template<Precision precision, typename T>
+T ReciprocalSqrt(const T& val);
+// sqrt(val) computed at the given precision
+template<Precision precision, typename T>
+T Sqrt(const T& val);
+
+// Per-precision overloads ReciprocalSqrt forwards to; packet types add their own alongside their other free functions
+template<typename T>
+T ReciprocalSqrt(const T& val, PrecisionTag<Precision::Exact>);
+template<typename T>
+T ReciprocalSqrt(const T& val, PrecisionTag<Precision::Fast>);
+template<typename T>
+T ReciprocalSqrt(const T& val, PrecisionTag<Precision::Refined>);
+#ifdef MATH_HAS_SSE
+float ReciprocalSqrt(float val, PrecisionTag<Precision::Fast>);
+float ReciprocalSqrt(float val, PrecisionTag<Precision::Refined>);
+#endif
+
+// Implementations
+template<typename T>
+T Select(bool mask, const T& a, const T& b)
+{
+	return mask ? a : b;
+}
+
+inline bool AllOf(bool mask)
+{
+	return mask;
+}
+
+inline bool NoneOf(bool mask)
+{
+	return !mask;
+}
+
+template<typename T>
+auto IsNearZero(const T& val, const T& epsilon) -> decltype(val <= epsilon)
+{
+	using std::abs;
+	return abs(val) <= epsilon;
+}
+
+template<Precision precision, typename T>
+T ReciprocalSqrt(const T& val)
+{
+	// Unqualified so packet overloads are found through argument-dependent lookup
+	return ReciprocalSqrt(val, PrecisionTag<precision>());
+}
+
+template<Precision precision, typename T>
+T Sqrt(const T& val)
+{
+	using std::sqrt;
+	if (precision == Precision::Exact)
+	{
+		return sqrt(val);
+	}
+	// sqrt(x) = x * (1 / sqrt(x)), with zero lanes forced to zero since the estimate of 1 / sqrt(0) is infinite
+	return Select(val > T(0), val * ReciprocalSqrt<precision>(val), T(0));
+}
+
+template<typename T>
+T ReciprocalSqrt(const T& val, PrecisionTag<Precision::Exact>)
+{
+	using std::sqrt;
+	return T(1) / sqrt(val);
+}
+
+template<typename T>
+T ReciprocalSqrt(const T& val, PrecisionTag<Precision::Fast>)
+{
+	// No hardware estimate for this type
+	return ReciprocalSqrt(val, PrecisionTag<Precision::Exact>());
+}
+
+template<typename T>
+T ReciprocalSqrt(const T& val, PrecisionTag<Precision::Refined>)
+{
+	// No hardware estimate for this type
+	return ReciprocalSqrt(val, PrecisionTag<Precision::Exact>());
+}
+
+#ifdef MATH_HAS_SSE
+inline float ReciprocalSqrt(float val, PrecisionTag<Precision::Fast>)
+{
+	return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(val)));
+}
+
+inline float ReciprocalSqrt(float val, PrecisionTag<Precision::Refined>)
+{
+	// One Newton-Raphson step for f(y) = 1/y^2 - val roughly doubles the estimate's correct bits
+	float estimate = ReciprocalSqrt(val, PrecisionTag<Precision::Fast>());
+	return estimate * (1.5f - 0.5f * val * estimate * estimate);
+}
+#endif // MATH_HAS_SSE
@@ -0,0 +1,143 @@
+// Defines scratch memory for library code (i.e. Matrix's temporary rows)
+// This header deliberately includes no allocator headers, so math libraries can use it without pulling them in
+#pragma once
+#include <cstddef>
+#include <memory>
+
+namespace interior
+{
+	// Type erased view of the arena a ScopedScratchArena installed
+	struct ScratchArenaRef
+	{
+		void* mArena;
+		// Allocate from the arena, returning nullptr (without asserting) if it doesn't have room
+		void* (*mTryAllocate)(void* arena, size_t size, size_t alignment);
+		size_t (*mGetMarker)(void* arena);
+		void (*mFreeToMarker)(void* arena, size_t marker);
+	};
+}
+
+// ScopedScratchArena makes an arena the calling thread's scratch arena for its lifetime;
+// while one is installed, library temporaries come from it instead of the global heap:
+//  ScopedScratchArena scratch(frameArena.GetCurrent());
+//  matA *= matB;
+// Scopes nest, restoring the previously installed arena when they end.
+// Any arena with LinearArena's TryAllocate, GetMarker, and FreeToMarker works (see LinearArena.h).
+class ScopedScratchArena
+{
+public:
+	template <typename Arena>
+	explicit ScopedScratchArena(Arena& arena);
+	~ScopedScratchArena();
+
+	ScopedScratchArena(const ScopedScratchArena&) = delete;
+	ScopedScratchArena& operator=(const ScopedScratchArena&) = delete;
+
+	// Return the calling thread's scratch arena, or nullptr if none is installed
+	static const interior::ScratchArenaRef* GetCurrent() { return CurrentArena(); }
+
+private:
+	static const interior::ScratchArenaRef*& CurrentArena();
+
+	interior::ScratchArenaRef mArena;
+	const interior::ScratchArenaRef* mPrevious;
+};
+
+namespace interior
+{
+	// Default-initialized temporary array of Ts (i.e. uninitialized for trivial types, like new T[count]) from the thread's
+	// scratch arena if one is installed and has room, otherwise from the heap.
+	// Arena memory is rolled back when the buffer goes out of scope, so buffers must be destroyed in reverse order
+	// (as locals naturally are).
+	template <typename T>
+	class ScratchBuffer
+	{
+	public:
+		explicit ScratchBuffer(size_t count);
+		~ScratchBuffer();
+
+		ScratchBuffer(const ScratchBuffer&) = delete;
+		ScratchBuffer& operator=(const ScratchBuffer&) = delete;
+
+		T& operator[](size_t index) { return mData[index]; }
+		const T& operator[](size_t index) const { return mData[index]; }
+		T* Data() { return mData; }
+
+	private:
+		T* mData;
+		size_t mCount;
+		const ScratchArenaRef* mArena;
+		size_t mMarker;
+	};
+}
+
+// IMPLEMENTATIONS for ScopedScratchArena
+
+template <typename Arena>
+ScopedScratchArena::ScopedScratchArena(Arena& arena)
+{
+	mArena.mArena = &arena;
+	mArena.mTryAllocate = [](void* arena, size_t size, size_t alignment) -> void* { return static_cast<Arena*>(arena)->TryAllocate(size, alignment); };
+	mArena.mGetMarker = [](void* arena) -> size_t { return static_cast<Arena*>(arena)->GetMarker(); };
+	mArena.mFreeToMarker = [](void* arena, size_t marker) { static_cast<Arena*>(arena)->FreeToMarker(marker); };
+	mPrevious = CurrentArena();
+	CurrentArena() = &mArena;
+}
+
+inline ScopedScratchArena::~ScopedScratchArena()
+{
+	CurrentArena() = mPrevious;
+}
+
+inline const interior::ScratchArenaRef*& ScopedScratchArena::CurrentArena()
+{
+	static thread_local const interior::ScratchArenaRef* sArena = nullptr;
+	return sArena;
+}
+
+// IMPLEMENTATIONS for ScratchBuffer
+
+template <typename T>
+interior::ScratchBuffer<T>::ScratchBuffer(size_t count)
+{
+	mData = nullptr;
+	mCount = count;
+	mArena = ScopedScratchArena::GetCurrent();
+	mMarker = 0;
+	if (mArena != nullptr && count <= static_cast<size_t>(-1) / sizeof(T))
+	{
+		mMarker = mArena->mGetMarker(mArena->mArena);
+		mData = static_cast<T*>(mArena->mTryAllocate(mArena->mArena, count * sizeof(T), alignof(T)));
+	}
+	// Construct arena elements just as the heap's new T[count] does, so both paths hand out the same objects
+	if (mData != nullptr)
+	{
+		try
+		{
+			std::uninitialized_default_construct_n(mData, count);
+		}
+		catch (...)
+		{
+			mArena->mFreeToMarker(mArena->mArena, mMarker);
+			throw;
+		}
+	}
+	// Fall back on the heap if there's no scratch arena or it ran out
+	if (mData == nullptr)
+	{
+		mArena = nullptr;
+		mData = new T[count];
+	}
+}
+
+template <typename T>
+interior::ScratchBuffer<T>::~ScratchBuffer()
+{
+	if (mArena != nullptr)
+	{
+		std::destroy_n(mData, mCount);
+		mArena->mFreeToMarker(mArena->mArena, mMarker);
+	}
+	else
+		delete[] mData;
+}
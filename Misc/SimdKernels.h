@@ -0,0 +1,189 @@
+#pragma once
+
+// Defines the SSE4.1 kernels shared by SimdMath.h and the float specializations of the Vector, Matrix, and Quaternion libraries
+// The __m128 kernels work on registers as SimdVector3 and SimdMatrix4 hold them (one register per matrix row)
+// The float kernels load and store raw floats laid out like the library types' data (row-major matrices, x y z w vectors and quaternions),
+//  need no alignment, and allow their output to alias their inputs
+// Matrix products and row vector products broadcast each element of the left side and accumulate rows of the right side,
+//  which needs no transpose and no dot product instructions; the multiply-adds are fused when compiling with FMA enabled
+// Column vector products still dot each matrix row with the vector; to transform many column vectors by one matrix,
+//  keep its transpose (i.e. convert it to a SimdMatrix4 once, see SimdMath.h) and use the row vector product instead
+// The kernels need SSE4.1, which compilers only enable when asked (i.e. -msse4.1 or -march=native, or /arch:AVX on MSVC);
+//  without it this header defines nothing (MATH_HAS_SSE4_1 included) and the libraries compile their generic code for float
+// With SSE4.1, Vector<float, 3/4>, float4x4, and Quaternion<float> route their hot operations through these kernels automatically;
+//  define MATH_NO_SIMD before including the libraries to compile the generic scalar code for float as well
+
+#if defined(__SSE4_1__) || (defined(_MSC_VER) && defined(__AVX__))
+#define MATH_HAS_SSE4_1 1
+#endif
+
+#ifdef MATH_HAS_SSE4_1
+#include <xmmintrin.h>
+#include <smmintrin.h>
+#ifdef __FMA__
+#include <immintrin.h>
+#endif
+
+// SHUFFLER is like shuffle, but has easier to understand indices
+#ifndef _MM_SHUFFLER
+#define _MM_SHUFFLER( xi, yi, zi, wi ) _MM_SHUFFLE( wi, zi, yi, xi )
+#endif
+
+namespace interior
+{
+	// a * b + c, fused if FMA is enabled
+	__m128 SimdMultiplyAdd(__m128 a, __m128 b, __m128 c);
+	// vec's element broadcast across all 4 components, i.e. <y,y,y,y> for element 1
+	template<int element>
+	__m128 SimdBroadcast(__m128 vec);
+
+	// __m128 kernels
+	// result = lhs * rhs, where each matrix is 4 row registers; result may alias either
+	void SimdMatrixMultiply(const __m128 lhs[4], const __m128 rhs[4], __m128 result[4]);
+	// Row vector times matrix (vec * mat)
+	__m128 SimdRowVecMult(__m128 vec, const __m128 rows[4]);
+	// Matrix times column vector (mat * vec)
+	__m128 SimdColVecMult(const __m128 rows[4], __m128 vec);
+	// Cross product of the xyz components, with w set to 0
+	__m128 SimdCross(__m128 lhs, __m128 rhs);
+	// Quaternion product lhs * rhs of x y z w registers
+	__m128 SimdQuaternionMultiply(__m128 lhs, __m128 rhs);
+
+	// float kernels
+	// result = lhs * rhs for row-major 4x4 matrices
+	void SimdMatrixMultiply4(const float* lhs, const float* rhs, float* result);
+	// Transpose a row-major 4x4 matrix in place
+	void SimdTranspose4(float* mat);
+	// result = mat * vec for a row-major 4x4 matrix and a 4 component column vector
+	void SimdColVecMult4(const float* mat, const float* vec, float* result);
+	// result = vec * mat for a 4 component row vector and a row-major 4x4 matrix
+	void SimdRowVecMult4(const float* vec, const float* mat, float* result);
+	// result = the xyz of mat * (vec, w) for a row-major 4x4 matrix and a 3 component column vector
+	void SimdTransform3(const float* mat, const float* vec, float w, float* result);
+}
+
+// Implementations
+inline __m128 interior::SimdMultiplyAdd(__m128 a, __m128 b, __m128 c)
+{
+#ifdef __FMA__
+	return _mm_fmadd_ps(a, b, c);
+#else
+	return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+template<int element>
+__m128 interior::SimdBroadcast(__m128 vec)
+{
+	return _mm_shuffle_ps(vec, vec, _MM_SHUFFLE(element, element, element, element));
+}
+
+inline void interior::SimdMatrixMultiply(const __m128 lhs[4], const __m128 rhs[4], __m128 result[4])
+{
+	// Copy rhs first in case result aliases it
+	__m128 rhsRows[4] = { rhs[0], rhs[1], rhs[2], rhs[3] };
+	for (int i = 0; i < 4; ++i)
+	{
+		// Row i of the product is lhs[i] times rhs, which is just a row vector product
+		// lhs[i] is not read again, so result may alias lhs
+		result[i] = SimdRowVecMult(lhs[i], rhsRows);
+	}
+}
+
+inline __m128 interior::SimdRowVecMult(__m128 vec, const __m128 rows[4])
+{
+	// vec * mat = x * row0 + y * row1 + z * row2 + w * row3
+	// Two independent sums halve the chain of dependent multiply-adds
+	__m128 xy = _mm_mul_ps(SimdBroadcast<0>(vec), rows[0]);
+	__m128 zw = _mm_mul_ps(SimdBroadcast<2>(vec), rows[2]);
+	xy = SimdMultiplyAdd(SimdBroadcast<1>(vec), rows[1], xy);
+	zw = SimdMultiplyAdd(SimdBroadcast<3>(vec), rows[3], zw);
+	return _mm_add_ps(xy, zw);
+}
+
+inline __m128 interior::SimdColVecMult(const __m128 rows[4], __m128 vec)
+{
+	// Column vectors dot straight with each row, no transpose needed
+	__m128 x = _mm_dp_ps(rows[0], vec, 0xF1);
+	__m128 y = _mm_dp_ps(rows[1], vec, 0xF2);
+	__m128 z = _mm_dp_ps(rows[2], vec, 0xF4);
+	__m128 w = _mm_dp_ps(rows[3], vec, 0xF8);
+	return _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, w));
+}
+
+inline __m128 interior::SimdCross(__m128 lhs, __m128 rhs)
+{
+	// Vectorized formula: (<Ay,Az,Ax>*<Bz,Bx,By>)-(<Az,Ax,Ay>*<By,Bz,Bx>)
+	// Each w is multiplied by the other's w and the products cancel (unless they're infinite or NaN)
+	__m128 result = _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLER(1, 2, 0, 3)), _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLER(2, 0, 1, 3)));
+	__m128 temp = _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLER(2, 0, 1, 3)), _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLER(1, 2, 0, 3)));
+	return _mm_blend_ps(_mm_sub_ps(result, temp), _mm_setzero_ps(), 0x8);
+}
+
+inline __m128 interior::SimdQuaternionMultiply(__m128 lhs, __m128 rhs)
+{
+	// Each component of the product is a sum of four terms; the first is always lhs.w * rhs:
+	//  x = w*Bx + Bw*x + y*Bz - z*By
+	//  y = w*By + Bw*y + z*Bx - x*Bz
+	//  z = w*Bz + Bw*z + x*By - y*Bx
+	//  w = w*Bw - x*Bx - y*By - z*Bz
+	// The second and third columns are added in x, y, and z but subtracted in w, so flip their w sign bit
+	const __m128 wSign = _mm_setr_ps(0.0f, 0.0f, 0.0f, -0.0f);
+	__m128 result = _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLER(3, 3, 3, 3)), rhs);
+	__m128 temp = _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLER(0, 1, 2, 0)), _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLER(3, 3, 3, 0)));
+	result = _mm_add_ps(result, _mm_xor_ps(temp, wSign));
+	temp = _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLER(1, 2, 0, 1)), _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLER(2, 0, 1, 1)));
+	result = _mm_add_ps(result, _mm_xor_ps(temp, wSign));
+	temp = _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLER(2, 0, 1, 2)), _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLER(1, 2, 0, 2)));
+	return _mm_sub_ps(result, temp);
+}
+
+inline void interior::SimdMatrixMultiply4(const float* lhs, const float* rhs, float* result)
+{
+	// Load everything before storing anything so result may alias either input
+	__m128 lhsRows[4] = { _mm_loadu_ps(lhs), _mm_loadu_ps(lhs + 4), _mm_loadu_ps(lhs + 8), _mm_loadu_ps(lhs + 12) };
+	__m128 rhsRows[4] = { _mm_loadu_ps(rhs), _mm_loadu_ps(rhs + 4), _mm_loadu_ps(rhs + 8), _mm_loadu_ps(rhs + 12) };
+	SimdMatrixMultiply(lhsRows, rhsRows, lhsRows);
+	for (int i = 0; i < 4; ++i)
+	{
+		_mm_storeu_ps(result + 4 * i, lhsRows[i]);
+	}
+}
+
+inline void interior::SimdTranspose4(float* mat)
+{
+	__m128 rows[4] = { _mm_loadu_ps(mat), _mm_loadu_ps(mat + 4), _mm_loadu_ps(mat + 8), _mm_loadu_ps(mat + 12) };
+	_MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+	for (int i = 0; i < 4; ++i)
+	{
+		_mm_storeu_ps(mat + 4 * i, rows[i]);
+	}
+}
+
+inline void interior::SimdColVecMult4(const float* mat, const float* vec, float* result)
+{
+	__m128 rows[4] = { _mm_loadu_ps(mat), _mm_loadu_ps(mat + 4), _mm_loadu_ps(mat + 8), _mm_loadu_ps(mat + 12) };
+	_mm_storeu_ps(result, SimdColVecMult(rows, _mm_loadu_ps(vec)));
+}
+
+inline void interior::SimdRowVecMult4(const float* vec, const float* mat, float* result)
+{
+	__m128 rows[4] = { _mm_loadu_ps(mat), _mm_loadu_ps(mat + 4), _mm_loadu_ps(mat + 8), _mm_loadu_ps(mat + 12) };
+	_mm_storeu_ps(result, SimdRowVecMult(_mm_loadu_ps(vec), rows));
+}
+
+inline void interior::SimdTransform3(const float* mat, const float* vec, float w, float* result)
+{
+	// Only the top three rows contribute to the xyz of the result
+	// A 3 component vector can't be loaded whole without reading past its end
+	__m128 vec4 = _mm_setr_ps(vec[0], vec[1], vec[2], w);
+	__m128 x = _mm_dp_ps(_mm_loadu_ps(mat), vec4, 0xF1);
+	__m128 y = _mm_dp_ps(_mm_loadu_ps(mat + 4), vec4, 0xF2);
+	__m128 z = _mm_dp_ps(_mm_loadu_ps(mat + 8), vec4, 0xF4);
+	__m128 xyz = _mm_add_ps(_mm_add_ps(x, y), z);
+	// Store x alone, then y and z together with a 64-bit store
+	_mm_store_ss(result, xyz);
+	_mm_storel_pi(reinterpret_cast<__m64*>(result + 1), _mm_shuffle_ps(xyz, xyz, _MM_SHUFFLER(1, 2, 1, 2)));
+}
+
+#endif // MATH_HAS_SSE4_1
@@ -1,10 +1,27 @@
 #pragma once
 #include "Math.h"
+#include "SimdPacket.h"
+#include "SimdKernels.h"
+#include "Vector.h"
+#include <type_traits>
 #include <xmmintrin.h>
 #include <smmintrin.h>
 
-// SHUFFLER is like shuffle, but has easier to understand indices
-#define _MM_SHUFFLER( xi, yi, zi, wi ) _MM_SHUFFLE( wi, zi, yi, xi )
+#ifndef MATH_HAS_SSE4_1
+#error "SimdMath.h needs SSE4.1; compile with -msse4.1 (or -march=native), or /arch:AVX on MSVC"
+#endif
+
+// SimdVector3 and SimdMatrix4 convert from both the legacy Vector3/Matrix4 and the templated Vector<float, 3>/float4x4,
+//  and share their kernels with the float specializations of the templated libraries (see SimdKernels.h)
+// SimdMatrix4 follows Matrix4's convention of pre-multiplying row vectors, while float4x4 post-multiplies column vectors,
+//  so converting between SimdMatrix4 and float4x4 transposes the matrix to keep the transformation it performs
+// Mul and Transform broadcast each element of the left side and multiply-add rows of the right side, so neither transposes anything per call
+// To transform many column vectors by the same float4x4, convert it to a SimdMatrix4 once and keep it: that is its cached transpose,
+//  after which each vector costs 4 broadcasts and multiply-adds instead of float4x4::TransformPoint's 4 row dot products
+
+// Forward declare SquareMatrix so this header doesn't need Matrix.h (include it to convert to and from float4x4)
+template<typename T, std::size_t size>
+struct SquareMatrix;
 
 class alignas(16) SimdVector3
 {
@@ -26,6 +43,12 @@ public:
 		FromVector3(vec);
 	}
 
+	// Constructor if converting from Vector<float, 3>
+	explicit SimdVector3(const Vector<float, 3>& vec)
+	{
+		FromVector(vec);
+	}
+
 	// Load from a Vector3 into this SimdVector3
 	void FromVector3(const Vector3& vec)
 	{
@@ -33,12 +56,27 @@ public:
 		mVec = _mm_setr_ps(vec.x, vec.y, vec.z, 0.0f);
 	}
 
+	// Load from a Vector<float, 3> into this SimdVector3
+	void FromVector(const Vector<float, 3>& vec)
+	{
+		// A 3 component vector can't be loaded whole without reading past its end
+		mVec = _mm_setr_ps(vec.data[0], vec.data[1], vec.data[2], 0.0f);
+	}
+
 	// Convert this SimdVector3 to a Vector3
 	Vector3 ToVector3() const
 	{
 		return Vector3(mVec);
 	}
 
+	// Convert this SimdVector3 to a Vector<float, 3>
+	Vector<float, 3> ToVector() const
+	{
+		alignas(16) float temp[4];
+		_mm_store_ps(temp, mVec);
+		return Vector<float, 3>(temp[0], temp[1], temp[2]);
+	}
+
 	// this = this + other
 	void Add(const SimdVector3& other)
 	{
@@ -67,13 +105,16 @@ public:
 	}
 
 	// Normalize this vector
+	// Defaults to Precision::Fast (a bare rsqrt estimate); see ScalarTraits.h for each precision's error bound
+	template<Precision precision = Precision::Fast>
 	void Normalize()
 	{
-		// Calculate lenght squared (data dot data)
-		// The mask 0x77 will dot the x, y, and z components and store it in the result's x, y, and z
-		__m128 temp = _mm_dp_ps(mVec, mVec, 0x77);
-		// Store 1/length in x, y, and z
-		temp = _mm_rsqrt_ps(temp);
+		// Calculate length squared (data dot data)
+		// The mask 0x7F will dot the x, y, and z components and store it in every component,
+		//  so w stays finite (0 * 1/length) instead of 0 * 1/sqrt(0)
+		__m128 temp = _mm_dp_ps(mVec, mVec, 0x7F);
+		// Store 1/length in every component
+		temp = ReciprocalSqrt<precision>(floatx4(temp)).vec;
 		// Multiply all components by 1/length
 		mVec = _mm_mul_ps(mVec, temp);
 	}
@@ -96,32 +137,19 @@ public:
 
 	// Length of this, storing the result in
 	// EVERY COMPONENT of returned SimdVector3
+	// Defaults to Precision::Exact; see ScalarTraits.h for each precision's error bound
+	template<Precision precision = Precision::Exact>
 	SimdVector3 Length() const
 	{
 		__m128 temp = _mm_dp_ps(mVec, mVec, 0x7F);
-		temp = _mm_sqrt_ps(temp);
+		temp = Sqrt<precision>(floatx4(temp)).vec;
 		return SimdVector3(temp);
 	}
 
 	// result = this (cross) other
 	SimdVector3 Cross(const SimdVector3& other) const
 	{
-		// Vectorized formula: (<Ay,Az,Ax>*<Bz,Bx,By>)-(<Az,Ax,Ay>*<By,Bz,Bx>)
-		// Shuffle A to <Ay,Az,Ax>
-		__m128 tempA = _mm_shuffle_ps(mVec, mVec, _MM_SHUFFLER(1, 2, 0, 3));
-		// Shuffle B to <Bz,Bx,By>
-		__m128 tempB = _mm_shuffle_ps(other.mVec, other.mVec, _MM_SHUFFLER(2, 0, 1, 3));
-		// result = tempA*tempB
-		__m128 result = _mm_mul_ps(tempA, tempB);
-		// Shuffle A to <Az,Ax,Ay>
-		tempA = _mm_shuffle_ps(mVec, mVec, _MM_SHUFFLER(2, 0, 1, 3));
-		// Shuffle B to <By,Bz,Bx>
-		tempB = _mm_shuffle_ps(other.mVec, other.mVec, _MM_SHUFFLER(1, 2, 0, 3));
-		// tempA = tempA*tempB
-		tempA = _mm_mul_ps(tempA, tempB);
-		// result = result - tempA
-		result = _mm_sub_ps(result, tempA);
-		return SimdVector3(result);
+		return SimdVector3(interior::SimdCross(mVec, other.mVec));
 	}
 
 	// result = this * (1.0f - f) + other * f
@@ -139,6 +167,7 @@ public:
 	}
 
 	friend SimdVector3 Transform(const SimdVector3& vec, const class SimdMatrix4& mat, float w);
+	friend void Transform(const SimdVector3* vecs, SimdVector3* out, size_t count, const class SimdMatrix4& mat, float w);
 };
 
 class alignas(16) SimdMatrix4
@@ -161,6 +190,13 @@ public:
 		FromMatrix4(mat);
 	}
 
+	// Constructor if converting from float4x4 (transposes; see the top of this file)
+	template<typename T>
+	explicit SimdMatrix4(const SquareMatrix<T, 4>& mat)
+	{
+		FromSquareMatrix(mat);
+	}
+
 	// Load from a Matrix4 into this SimdMatrix4
 	void FromMatrix4(const Matrix4& mat)
 	{
@@ -169,40 +205,44 @@ public:
 		memcpy(mRows, mat.mat, sizeof(float) * 16);
 	}
 
+	// Load from a float4x4 into this SimdMatrix4, transposing it so it performs the same transformation on row vectors
+	template<typename T>
+	void FromSquareMatrix(const SquareMatrix<T, 4>& mat)
+	{
+		static_assert(std::is_same<T, float>::value, "SimdMatrix4 only converts from float matrices");
+		for (int i = 0; i < 4; ++i)
+		{
+			mRows[i] = _mm_loadu_ps(mat.data.data() + 4 * i);
+		}
+		_MM_TRANSPOSE4_PS(mRows[0], mRows[1], mRows[2], mRows[3]);
+	}
+
 	// Convert this SimdMatrix4 to a Matrix4
 	Matrix4 ToMatrix4()
 	{
 		return Matrix4(mRows);
 	}
 
-	// this = this * other
-	void Mul(const SimdMatrix4& other)
+	// Convert this SimdMatrix4 to a float4x4, transposing it so it performs the same transformation on column vectors
+	// T only defers instantiation until Matrix.h is included; it must be float
+	template<typename T = float>
+	SquareMatrix<T, 4> ToSquareMatrix() const
 	{
-		// SimdMatrix4 uses one __m128 per row not column, so the matrix must be transposed
-		// _MM_TRANSPOSE4_PS macro is destructive, so copies must be made
-		__m128 rowCopies[4] = {other.mRows[0], other.mRows[1], other.mRows[2], other.mRows[3]};
-		_MM_TRANSPOSE4_PS(rowCopies[0], rowCopies[1], rowCopies[2], rowCopies[3]);
-
-		__m128 tempRows[4];
+		static_assert(std::is_same<T, float>::value, "SimdMatrix4 only converts to float matrices");
+		__m128 cols[4] = { mRows[0], mRows[1], mRows[2], mRows[3] };
+		_MM_TRANSPOSE4_PS(cols[0], cols[1], cols[2], cols[3]);
+		alignas(16) float temp[16];
 		for (int i = 0; i < 4; ++i)
 		{
-			// Multiply a given row with all the original columns of other, using masking to store the result in a single element
-			//  i.e. <C_x#,0,0,0>, <0,C_y#,0,0>, <0,0,C_z#,0>, <0,0,0,C_w#>
-			// C_x# = A.row# (dot) B^T.row0
-			tempRows[0] = _mm_dp_ps(mRows[i], rowCopies[0], 0xF1);
-			// C_y# = A.row# (dot) B^T.row1
-			tempRows[1] = _mm_dp_ps(mRows[i], rowCopies[1], 0xF2);
-			// C_z# = A.row# (dot) B^T.row2
-			tempRows[2] = _mm_dp_ps(mRows[i], rowCopies[2], 0xF4);
-			// C_w# = A.row# (dot) B^T.row3
-			tempRows[3] = _mm_dp_ps(mRows[i], rowCopies[3], 0XF8);
-			// Final vector constructed with a series of additions
-			tempRows[0] = _mm_add_ps(tempRows[0], tempRows[1]);
-			tempRows[0] = _mm_add_ps(tempRows[0], tempRows[2]);
-			tempRows[0] = _mm_add_ps(tempRows[0], tempRows[3]);
-			// Save the calculated row in this
-			mRows[i] = tempRows[0];
+			_mm_store_ps(temp + 4 * i, cols[i]);
 		}
+		return SquareMatrix<T, 4>(temp);
+	}
+
+	// this = this * other
+	void Mul(const SimdMatrix4& other)
+	{
+		interior::SimdMatrixMultiply(mRows, other.mRows, mRows);
 	}
 
 	// Transpose this matrix
@@ -319,6 +359,7 @@ public:
 	void Invert();
 
 	friend SimdVector3 Transform(const SimdVector3& vec, const class SimdMatrix4& mat, float w);
+	friend void Transform(const SimdVector3* vecs, SimdVector3* out, size_t count, const class SimdMatrix4& mat, float w);
 };
 
 inline SimdVector3 Transform(const SimdVector3& vec, const SimdMatrix4& mat, float w = 1.0f)
@@ -326,19 +367,21 @@ inline SimdVector3 Transform(const SimdVector3& vec, const SimdMatrix4& mat, flo
 	// Set the w-component of the SimdVector3 to the passed in value
 	__m128 temp = _mm_set_ps1(w);
 	temp = _mm_insert_ps(vec.mVec, temp, 0xF0);
-	// SimdMatrix4 uses one __m128 per row not column, so the matrix must be transposed
-	// _MM_TRANSPOSE4_PS macro is destructive, so copies must be made
-	__m128 rowCopies[4] = {mat.mRows[0], mat.mRows[1], mat.mRows[2], mat.mRows[3]};
-	_MM_TRANSPOSE4_PS(rowCopies[0], rowCopies[1], rowCopies[2], rowCopies[3]);
-	// Multiply the SimdVector3 with each of the original columns, using masking to store the result in a single element
-	//  i.e. <x',0,0,0>, <0,y',0,0>, <0,0,z',0>, <0,0,0,w'>
-	rowCopies[0] = _mm_dp_ps(temp, rowCopies[0], 0xF1);
-	rowCopies[1] = _mm_dp_ps(temp, rowCopies[1], 0xF2);
-	rowCopies[2] = _mm_dp_ps(temp, rowCopies[2], 0xF4);
-	rowCopies[3] = _mm_dp_ps(temp, rowCopies[3], 0xF8);
-	// Final vector constructed with a series of additions
-	rowCopies[0] = _mm_add_ps(rowCopies[0], rowCopies[1]);
-	rowCopies[0] = _mm_add_ps(rowCopies[0], rowCopies[2]);
-	rowCopies[0] = _mm_add_ps(rowCopies[0], rowCopies[3]);
-	return SimdVector3(rowCopies[0]);
+	// SimdMatrix4 pre-multiplies row vectors
+	return SimdVector3(interior::SimdRowVecMult(temp, mat.mRows));
+}
+
+// Transform count vectors by mat, each with the given w, writing the results to out (which may alias vecs)
+inline void Transform(const SimdVector3* vecs, SimdVector3* out, size_t count, const SimdMatrix4& mat, float w = 1.0f)
+{
+	// w's contribution is the same for every vector, so fold it into the translation row once
+	__m128 rows[4] = { mat.mRows[0], mat.mRows[1], mat.mRows[2], _mm_mul_ps(_mm_set_ps1(w), mat.mRows[3]) };
+	for (size_t i = 0; i < count; ++i)
+	{
+		__m128 vec = vecs[i].mVec;
+		__m128 result = interior::SimdMultiplyAdd(interior::SimdBroadcast<0>(vec), rows[0], rows[3]);
+		__m128 yz = _mm_mul_ps(interior::SimdBroadcast<1>(vec), rows[1]);
+		yz = interior::SimdMultiplyAdd(interior::SimdBroadcast<2>(vec), rows[2], yz);
+		out[i].mVec = _mm_add_ps(result, yz);
+	}
 }
@@ -0,0 +1,311 @@
+#pragma once
+#include <cmath>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+#include "ScalarTraits.h"
+#include "SimdKernels.h"
+
+#ifndef MATH_HAS_SSE4_1
+#error "SimdPacket.h needs SSE4.1; compile with -msse4.1 (or -march=native), or /arch:AVX on MSVC"
+#endif
+
+// Defines SIMD packet scalars usable as T throughout the Vector, Matrix, and Quaternion libraries
+// A Vector<floatx4, 3> holds 4 independent float3s in 3 registers, so every library function runs on 4 instances at once (8 with floatx8)
+// Packets construct implicitly from float by broadcasting, so library code mixing literals and T keeps working
+// Comparisons return a lane mask rather than bool; see ScalarTraits.h for how the libraries branch on masks
+// sqrt, abs, min, and max map to single instructions; sin, cos, and acos call the std versions on each lane
+// ReciprocalSqrt's Fast and Refined precisions use rsqrtps (see ScalarTraits.h for their error bounds)
+// floatx4 requires SSE4.1 (its Select uses blendvps), so this header only compiles with SSE4.1 enabled (see SimdKernels.h)
+// floatx8 requires AVX and is only defined when compiling with AVX enabled
+
+// Lane mask produced by comparing floatx4s (all bits set in a lane means true)
+struct floatx4mask
+{
+	__m128 mask;
+
+	friend floatx4mask operator&(const floatx4mask& lhs, const floatx4mask& rhs) { return floatx4mask{ _mm_and_ps(lhs.mask, rhs.mask) }; }
+	friend floatx4mask operator|(const floatx4mask& lhs, const floatx4mask& rhs) { return floatx4mask{ _mm_or_ps(lhs.mask, rhs.mask) }; }
+	friend floatx4mask operator!(const floatx4mask& val) { return floatx4mask{ _mm_xor_ps(val.mask, _mm_castsi128_ps(_mm_set1_epi32(-1))) }; }
+};
+
+// 4 floats processed as one scalar
+struct alignas(16) floatx4
+{
+	__m128 vec;
+
+	// Default to 0 in every lane so library types that value-initialize their data still start zeroed
+	floatx4() : vec(_mm_setzero_ps()) {}
+	// Broadcast val to every lane
+	floatx4(float val) : vec(_mm_set_ps1(val)) {}
+	floatx4(float lane0, float lane1, float lane2, float lane3) : vec(_mm_setr_ps(lane0, lane1, lane2, lane3)) {}
+	explicit floatx4(__m128 inVec) : vec(inVec) {}
+
+	// Load/store 4 consecutive floats, which need not be aligned
+	static floatx4 Load(const float* mem) { return floatx4(_mm_loadu_ps(mem)); }
+	void Store(float* mem) const { _mm_storeu_ps(mem, vec); }
+	float GetLane(int lane) const;
+
+	floatx4& operator+=(const floatx4& rhs) { vec = _mm_add_ps(vec, rhs.vec); return *this; }
+	floatx4& operator-=(const floatx4& rhs) { vec = _mm_sub_ps(vec, rhs.vec); return *this; }
+	floatx4& operator*=(const floatx4& rhs) { vec = _mm_mul_ps(vec, rhs.vec); return *this; }
+	floatx4& operator/=(const floatx4& rhs) { vec = _mm_div_ps(vec, rhs.vec); return *this; }
+
+	// Defined as friends so a float or int on either side converts to a packet
+	friend floatx4 operator+(const floatx4& lhs, const floatx4& rhs) { return floatx4(_mm_add_ps(lhs.vec, rhs.vec)); }
+	friend floatx4 operator-(const floatx4& lhs, const floatx4& rhs) { return floatx4(_mm_sub_ps(lhs.vec, rhs.vec)); }
+	friend floatx4 operator*(const floatx4& lhs, const floatx4& rhs) { return floatx4(_mm_mul_ps(lhs.vec, rhs.vec)); }
+	friend floatx4 operator/(const floatx4& lhs, const floatx4& rhs) { return floatx4(_mm_div_ps(lhs.vec, rhs.vec)); }
+	friend floatx4 operator-(const floatx4& val) { return floatx4(_mm_xor_ps(val.vec, _mm_set_ps1(-0.0f))); }
+
+	friend floatx4mask operator<(const floatx4& lhs, const floatx4& rhs) { return floatx4mask{ _mm_cmplt_ps(lhs.vec, rhs.vec) }; }
+	friend floatx4mask operator<=(const floatx4& lhs, const floatx4& rhs) { return floatx4mask{ _mm_cmple_ps(lhs.vec, rhs.vec) }; }
+	friend floatx4mask operator>(const floatx4& lhs, const floatx4& rhs) { return floatx4mask{ _mm_cmpgt_ps(lhs.vec, rhs.vec) }; }
+	friend floatx4mask operator>=(const floatx4& lhs, const floatx4& rhs) { return floatx4mask{ _mm_cmpge_ps(lhs.vec, rhs.vec) }; }
+	friend floatx4mask operator==(const floatx4& lhs, const floatx4& rhs) { return floatx4mask{ _mm_cmpeq_ps(lhs.vec, rhs.vec) }; }
+	friend floatx4mask operator!=(const floatx4& lhs, const floatx4& rhs) { return floatx4mask{ _mm_cmpneq_ps(lhs.vec, rhs.vec) }; }
+};
+
+template<>
+struct IsMathScalar<floatx4> : std::true_type {};
+
+// floatx4 free functions
+floatx4 Select(const floatx4mask& mask, const floatx4& a, const floatx4& b);
+bool AllOf(const floatx4mask& mask);
+bool NoneOf(const floatx4mask& mask);
+floatx4 sqrt(const floatx4& val);
+floatx4 abs(const floatx4& val);
+floatx4 min(const floatx4& lhs, const floatx4& rhs);
+floatx4 max(const floatx4& lhs, const floatx4& rhs);
+floatx4 sin(const floatx4& val);
+floatx4 cos(const floatx4& val);
+floatx4 acos(const floatx4& val);
+floatx4 ReciprocalSqrt(const floatx4& val, PrecisionTag<Precision::Fast>);
+floatx4 ReciprocalSqrt(const floatx4& val, PrecisionTag<Precision::Refined>);
+
+#ifdef __AVX__
+// Lane mask produced by comparing floatx8s (all bits set in a lane means true)
+struct floatx8mask
+{
+	__m256 mask;
+
+	friend floatx8mask operator&(const floatx8mask& lhs, const floatx8mask& rhs) { return floatx8mask{ _mm256_and_ps(lhs.mask, rhs.mask) }; }
+	friend floatx8mask operator|(const floatx8mask& lhs, const floatx8mask& rhs) { return floatx8mask{ _mm256_or_ps(lhs.mask, rhs.mask) }; }
+	friend floatx8mask operator!(const floatx8mask& val) { return floatx8mask{ _mm256_xor_ps(val.mask, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) }; }
+};
+
+// 8 floats processed as one scalar
+struct alignas(32) floatx8
+{
+	__m256 vec;
+
+	// Default to 0 in every lane so library types that value-initialize their data still start zeroed
+	floatx8() : vec(_mm256_setzero_ps()) {}
+	// Broadcast val to every lane
+	floatx8(float val) : vec(_mm256_set1_ps(val)) {}
+	explicit floatx8(__m256 inVec) : vec(inVec) {}
+
+	// Load/store 8 consecutive floats, which need not be aligned
+	static floatx8 Load(const float* mem) { return floatx8(_mm256_loadu_ps(mem)); }
+	void Store(float* mem) const { _mm256_storeu_ps(mem, vec); }
+	float GetLane(int lane) const;
+
+	floatx8& operator+=(const floatx8& rhs) { vec = _mm256_add_ps(vec, rhs.vec); return *this; }
+	floatx8& operator-=(const floatx8& rhs) { vec = _mm256_sub_ps(vec, rhs.vec); return *this; }
+	floatx8& operator*=(const floatx8& rhs) { vec = _mm256_mul_ps(vec, rhs.vec); return *this; }
+	floatx8& operator/=(const floatx8& rhs) { vec = _mm256_div_ps(vec, rhs.vec); return *this; }
+
+	// Defined as friends so a float or int on either side converts to a packet
+	friend floatx8 operator+(const floatx8& lhs, const floatx8& rhs) { return floatx8(_mm256_add_ps(lhs.vec, rhs.vec)); }
+	friend floatx8 operator-(const floatx8& lhs, const floatx8& rhs) { return floatx8(_mm256_sub_ps(lhs.vec, rhs.vec)); }
+	friend floatx8 operator*(const floatx8& lhs, const floatx8& rhs) { return floatx8(_mm256_mul_ps(lhs.vec, rhs.vec)); }
+	friend floatx8 operator/(const floatx8& lhs, const floatx8& rhs) { return floatx8(_mm256_div_ps(lhs.vec, rhs.vec)); }
+	friend floatx8 operator-(const floatx8& val) { return floatx8(_mm256_xor_ps(val.vec, _mm256_set1_ps(-0.0f))); }
+
+	friend floatx8mask operator<(const floatx8& lhs, const floatx8& rhs) { return floatx8mask{ _mm256_cmp_ps(lhs.vec, rhs.vec, _CMP_LT_OQ) }; }
+	friend floatx8mask operator<=(const floatx8& lhs, const floatx8& rhs) { return floatx8mask{ _mm256_cmp_ps(lhs.vec, rhs.vec, _CMP_LE_OQ) }; }
+	friend floatx8mask operator>(const floatx8& lhs, const floatx8& rhs) { return floatx8mask{ _mm256_cmp_ps(lhs.vec, rhs.vec, _CMP_GT_OQ) }; }
+	friend floatx8mask operator>=(const floatx8& lhs, const floatx8& rhs) { return floatx8mask{ _mm256_cmp_ps(lhs.vec, rhs.vec, _CMP_GE_OQ) }; }
+	friend floatx8mask operator==(const floatx8& lhs, const floatx8& rhs) { return floatx8mask{ _mm256_cmp_ps(lhs.vec, rhs.vec, _CMP_EQ_OQ) }; }
+	friend floatx8mask operator!=(const floatx8& lhs, const floatx8& rhs) { return floatx8mask{ _mm256_cmp_ps(lhs.vec, rhs.vec, _CMP_NEQ_UQ) }; }
+};
+
+template<>
+struct IsMathScalar<floatx8> : std::true_type {};
+
+// floatx8 free functions
+floatx8 Select(const floatx8mask& mask, const floatx8& a, const floatx8& b);
+bool AllOf(const floatx8mask& mask);
+bool NoneOf(const floatx8mask& mask);
+floatx8 sqrt(const floatx8& val);
+floatx8 abs(const floatx8& val);
+floatx8 min(const floatx8& lhs, const floatx8& rhs);
+floatx8 max(const floatx8& lhs, const floatx8& rhs);
+floatx8 sin(const floatx8& val);
+floatx8 cos(const floatx8& val);
+floatx8 acos(const floatx8& val);
+floatx8 ReciprocalSqrt(const floatx8& val, PrecisionTag<Precision::Fast>);
+floatx8 ReciprocalSqrt(const floatx8& val, PrecisionTag<Precision::Refined>);
+#endif // __AVX__
+
+namespace interior
+{
+	// Apply a scalar function to every lane of a packet for operations without a SIMD instruction
+	template<typename Packet, int lanes, typename Func>
+	Packet ApplyPerLane(const Packet& val, Func func);
+}
+
+// Implementations
+// floatx4 implementations
+inline float floatx4::GetLane(int lane) const
+{
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, vec);
+	return lanes[lane];
+}
+
+inline floatx4 Select(const floatx4mask& mask, const floatx4& a, const floatx4& b)
+{
+	return floatx4(_mm_blendv_ps(b.vec, a.vec, mask.mask));
+}
+
+inline bool AllOf(const floatx4mask& mask)
+{
+	return _mm_movemask_ps(mask.mask) == 0xF;
+}
+
+inline bool NoneOf(const floatx4mask& mask)
+{
+	return _mm_movemask_ps(mask.mask) == 0;
+}
+
+inline floatx4 sqrt(const floatx4& val)
+{
+	return floatx4(_mm_sqrt_ps(val.vec));
+}
+
+inline floatx4 abs(const floatx4& val)
+{
+	// Clear the sign bits
+	return floatx4(_mm_andnot_ps(_mm_set_ps1(-0.0f), val.vec));
+}
+
+inline floatx4 min(const floatx4& lhs, const floatx4& rhs)
+{
+	return floatx4(_mm_min_ps(lhs.vec, rhs.vec));
+}
+
+inline floatx4 max(const floatx4& lhs, const floatx4& rhs)
+{
+	return floatx4(_mm_max_ps(lhs.vec, rhs.vec));
+}
+
+inline floatx4 sin(const floatx4& val)
+{
+	return interior::ApplyPerLane<floatx4, 4>(val, [](float lane) { return std::sin(lane); });
+}
+
+inline floatx4 cos(const floatx4& val)
+{
+	return interior::ApplyPerLane<floatx4, 4>(val, [](float lane) { return std::cos(lane); });
+}
+
+inline floatx4 acos(const floatx4& val)
+{
+	return interior::ApplyPerLane<floatx4, 4>(val, [](float lane) { return std::acos(lane); });
+}
+
+inline floatx4 ReciprocalSqrt(const floatx4& val, PrecisionTag<Precision::Fast>)
+{
+	return floatx4(_mm_rsqrt_ps(val.vec));
+}
+
+inline floatx4 ReciprocalSqrt(const floatx4& val, PrecisionTag<Precision::Refined>)
+{
+	floatx4 estimate = ReciprocalSqrt(val, PrecisionTag<Precision::Fast>());
+	return estimate * (floatx4(1.5f) - floatx4(0.5f) * val * estimate * estimate);
+}
+
+#ifdef __AVX__
+// floatx8 implementations
+inline float floatx8::GetLane(int lane) const
+{
+	alignas(32) float lanes[8];
+	_mm256_store_ps(lanes, vec);
+	return lanes[lane];
+}
+
+inline floatx8 Select(const floatx8mask& mask, const floatx8& a, const floatx8& b)
+{
+	return floatx8(_mm256_blendv_ps(b.vec, a.vec, mask.mask));
+}
+
+inline bool AllOf(const floatx8mask& mask)
+{
+	return _mm256_movemask_ps(mask.mask) == 0xFF;
+}
+
+inline bool NoneOf(const floatx8mask& mask)
+{
+	return _mm256_movemask_ps(mask.mask) == 0;
+}
+
+inline floatx8 sqrt(const floatx8& val)
+{
+	return floatx8(_mm256_sqrt_ps(val.vec));
+}
+
+inline floatx8 abs(const floatx8& val)
+{
+	// Clear the sign bits
+	return floatx8(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), val.vec));
+}
+
+inline floatx8 min(const floatx8& lhs, const floatx8& rhs)
+{
+	return floatx8(_mm256_min_ps(lhs.vec, rhs.vec));
+}
+
+inline floatx8 max(const floatx8& lhs, const floatx8& rhs)
+{
+	return floatx8(_mm256_max_ps(lhs.vec, rhs.vec));
+}
+
+inline floatx8 sin(const floatx8& val)
+{
+	return interior::ApplyPerLane<floatx8, 8>(val, [](float lane) { return std::sin(lane); });
+}
+
+inline floatx8 cos(const floatx8& val)
+{
+	return interior::ApplyPerLane<floatx8, 8>(val, [](float lane) { return std::cos(lane); });
+}
+
+inline floatx8 acos(const floatx8& val)
+{
+	return interior::ApplyPerLane<floatx8, 8>(val, [](float lane) { return std::acos(lane); });
+}
+
+inline floatx8 ReciprocalSqrt(const floatx8& val, PrecisionTag<Precision::Fast>)
+{
+	return floatx8(_mm256_rsqrt_ps(val.vec));
+}
+
+inline floatx8 ReciprocalSqrt(const floatx8& val, PrecisionTag<Precision::Refined>)
+{
+	floatx8 estimate = ReciprocalSqrt(val, PrecisionTag<Precision::Fast>());
+	return estimate * (floatx8(1.5f) - floatx8(0.5f) * val * estimate * estimate);
+}
+#endif // __AVX__
+
+template<typename Packet, int lanes, typename Func>
+Packet interior::ApplyPerLane(const Packet& val, Func func)
+{
+	alignas(Packet) float laneVals[lanes];
+	val.Store(laneVals);
+	for (int i = 0; i < lanes; ++i)
+	{
+		laneVals[i] = func(laneVals[i]);
+	}
+	return Packet::Load(laneVals);
+}
@@ -0,0 +1,308 @@
+// Defines a general purpose small-object allocator that routes requests to size-class pools
+#pragma once
+#include "GrowablePoolAlloc.h"
+#include <cstddef>
+#include <new>
+#include <tuple>
+#include <utility>
+
+// Defines a Small Object Allocator
+//
+// Instead of each subsystem picking a hand-made PoolAllocator typedef, Allocate(size) rounds size up to one of
+// 32 size classes and takes a block from that class's pool:
+//  -16 byte steps from 16 to 256 bytes (16 classes)
+//  -4 geometric steps per doubling from 320 bytes to 4 KB (320, 384, 448, 512, 640, ..., 3584, 4096)
+// Rounding wastes at most 15 bytes below 256 and at most 20% above it.
+// Each class is a GrowablePoolAllocator with slabs of just under 64 KB, so classes only use memory once something is allocated from them.
+// In front of each pool sits a small LIFO cache of freed blocks (up to kCacheBlocks), so steady churn reuses the most recently
+// freed block of a class without touching its slab; FlushCaches hands the cached blocks back to the pools.
+// Requests bigger than 4 KB go straight to the system heap.
+//
+// Free takes the size that was passed to Allocate (like C++14 sized delete) so it can find the class without a per-block header.
+// Blocks are aligned to 16 bytes (kClassAlignment), enough for SSE types; use the system heap for stricter alignments.
+// Like PoolAllocator, this is not thread safe.
+//
+// GetClassStats reports each class's utilization, including how many of the bytes handed out were actually requested.
+namespace interior
+{
+	// Block size of a size class
+	constexpr size_t SizeClassBytes(unsigned int classIndex)
+	{
+		return classIndex < 16 ? 16 * (classIndex + 1)
+			: (size_t(256) << ((classIndex - 16) / 4)) + ((classIndex - 16) % 4 + 1) * (size_t(64) << ((classIndex - 16) / 4));
+	}
+
+	// Bytes a size class's block takes in its slab: the block itself, plus with POOL_ALLOC_DEBUG its boundary rounded up to the 16 byte alignment
+	constexpr size_t SizeClassSlotBytes(size_t classBytes)
+	{
+	#ifdef POOL_ALLOC_DEBUG
+		return classBytes + 16;
+	#else
+		return classBytes;
+	#endif
+	}
+
+	// Blocks per slab for a size class, filling each slab (a header of at most 64 bytes, then the blocks) up to 64 KB
+	constexpr unsigned int SizeClassBlocksPerSlab(size_t classBytes)
+	{
+		return static_cast<unsigned int>((64 * 1024 - 64) / SizeClassSlotBytes(classBytes));
+	}
+}
+
+class SmallObjectAllocator
+{
+public:
+	// Number of size classes
+	static const unsigned int kNumClasses = 32;
+	// Largest request served from a size class
+	static const size_t kMaxClassBytes = 4096;
+	// Alignment of every size class's blocks
+	static const size_t kClassAlignment = 16;
+	// Most freed blocks each class keeps cached for reuse before returning them to its pool
+	static const unsigned int kCacheBlocks = 64;
+
+	// Utilization snapshot of a single size class
+	struct SizeClassStats
+	{
+		// Bytes per block in this class
+		size_t mClassBytes;
+		// Blocks currently allocated
+		unsigned int mBlocksInUse;
+		// Blocks free in this class's slabs and cache
+		unsigned int mBlocksFree;
+		// Slabs currently allocated
+		unsigned int mNumSlabs;
+		// Sum of the sizes requested for the blocks in use; mClassBytes * mBlocksInUse - mRequestedBytes is lost to rounding
+		size_t mRequestedBytes;
+	};
+
+	// maxEmptySlabsPerClass is passed to each class's GrowablePoolAllocator
+	explicit SmallObjectAllocator(unsigned int maxEmptySlabsPerClass = 1);
+
+	// Allocate returns a pointer to at least size bytes.
+	// Sizes up to kMaxClassBytes come from the matching size class, larger ones from the system heap.
+	// A size of 0 is treated as 1.
+	void* Allocate(size_t size);
+
+	// Free returns ptr to its class's cache, or to the pool it came from if the cache is full;
+	// size must be the size that was passed to Allocate.
+	// The POOL_ALLOC_DEBUG fill and boundary checks run when blocks go back to a pool, not for cached blocks.
+	void Free(void* ptr, size_t size);
+
+	// Return every cached block to its class's pool, so slabs that only held cached blocks can empty
+	void FlushCaches();
+
+	// Return the size class index that serves requests of size bytes (size must be <= kMaxClassBytes)
+	static unsigned int GetSizeClass(size_t size);
+	// Return the block size of the given size class
+	static size_t GetClassBytes(unsigned int classIndex);
+
+	// Return the utilization of the given size class
+	SizeClassStats GetClassStats(unsigned int classIndex) const;
+	// Number of live allocations larger than kMaxClassBytes
+	unsigned int GetNumLargeAllocations() const { return mLargeAllocations; }
+	// Bytes held by live allocations larger than kMaxClassBytes
+	size_t GetLargeBytes() const { return mLargeBytes; }
+
+protected:
+	// Pool type serving a class
+	template <unsigned int classIndex>
+	using ClassPool = GrowablePoolAllocator<interior::SizeClassBytes(classIndex), interior::SizeClassBlocksPerSlab(interior::SizeClassBytes(classIndex)), kClassAlignment>;
+
+	// std::tuple of every class's pool
+	template <typename IndexSequence>
+	struct PoolTuple;
+	template <size_t... classIndices>
+	struct PoolTuple<std::index_sequence<classIndices...>>
+	{
+		using Type = std::tuple<ClassPool<classIndices>...>;
+	};
+	using Pools = typename PoolTuple<std::make_index_sequence<kNumClasses>>::Type;
+
+	// Per-class entry points so a runtime class index can reach its pool through a table instead of a switch
+	template <unsigned int classIndex>
+	static void* AllocateFromClass(Pools& pools) { return std::get<classIndex>(pools).Allocate(interior::SizeClassBytes(classIndex)); }
+	template <unsigned int classIndex>
+	static void FreeToClass(Pools& pools, void* ptr) { std::get<classIndex>(pools).Free(ptr); }
+	template <unsigned int classIndex>
+	static void GetPoolStats(const Pools& pools, SizeClassStats& stats)
+	{
+		stats.mBlocksFree = std::get<classIndex>(pools).GetNumBlocksFree();
+		stats.mNumSlabs = std::get<classIndex>(pools).GetNumSlabs();
+	}
+
+	using AllocateFunc = void* (*)(Pools&);
+	using FreeFunc = void (*)(Pools&, void*);
+	using StatsFunc = void (*)(const Pools&, SizeClassStats&);
+
+	// Tables of the per-class entry points, indexed by class
+	template <size_t... classIndices>
+	static const AllocateFunc* AllocateTable(std::index_sequence<classIndices...>);
+	template <size_t... classIndices>
+	static const FreeFunc* FreeTable(std::index_sequence<classIndices...>);
+	template <size_t... classIndices>
+	static const StatsFunc* StatsTable(std::index_sequence<classIndices...>);
+
+	template <size_t... classIndices>
+	SmallObjectAllocator(unsigned int maxEmptySlabsPerClass, std::index_sequence<classIndices...>);
+
+	Pools mPools;
+
+	// A freed block waiting in its class's cache; the link lives in the block's own memory, as in the pools' free lists
+	struct CachedBlock
+	{
+		CachedBlock* mNext;
+	};
+	// Per-class LIFO caches of freed blocks, so churn reuses the most recently freed (and most likely cached) block
+	// without touching its slab
+	CachedBlock* mCacheHeads[kNumClasses];
+	unsigned int mCacheCounts[kNumClasses];
+
+	// Live block count and requested bytes per class
+	unsigned int mBlocksInUse[kNumClasses];
+	size_t mRequestedBytes[kNumClasses];
+
+	unsigned int mLargeAllocations;
+	size_t mLargeBytes;
+};
+
+// IMPLEMENTATIONS for SmallObjectAllocator
+
+inline SmallObjectAllocator::SmallObjectAllocator(unsigned int maxEmptySlabsPerClass)
+	: SmallObjectAllocator(maxEmptySlabsPerClass, std::make_index_sequence<kNumClasses>())
+{}
+
+template <size_t... classIndices>
+SmallObjectAllocator::SmallObjectAllocator(unsigned int maxEmptySlabsPerClass, std::index_sequence<classIndices...>)
+	: mPools(((void)classIndices, maxEmptySlabsPerClass)...)
+{
+	for (unsigned int i = 0; i < kNumClasses; ++i)
+	{
+		mBlocksInUse[i] = 0;
+		mRequestedBytes[i] = 0;
+		mCacheHeads[i] = nullptr;
+		mCacheCounts[i] = 0;
+	}
+	mLargeAllocations = 0;
+	mLargeBytes = 0;
+}
+
+inline unsigned int SmallObjectAllocator::GetSizeClass(size_t size)
+{
+	DbgAssert(size <= kMaxClassBytes, "Size is too big for a size class.");
+	if (size <= 256)
+		return size == 0 ? 0 : static_cast<unsigned int>((size - 1) / 16);
+
+	// Above 256 bytes, (size - 1) >> 8 is in [1, 15]; its highest set bit gives the doubling (256-512, 512-1024, ...)
+	// and the next two bits pick one of the doubling's four classes
+	static const unsigned char kDoubling[16] = { 0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3 };
+	size_t offset = size - 1;
+	unsigned int doubling = kDoubling[offset >> 8];
+	return 16 + doubling * 4 + static_cast<unsigned int>((offset >> (6 + doubling)) & 3);
+}
+
+inline size_t SmallObjectAllocator::GetClassBytes(unsigned int classIndex)
+{
+	return interior::SizeClassBytes(classIndex);
+}
+
+inline void* SmallObjectAllocator::Allocate(size_t size)
+{
+	if (size > kMaxClassBytes)
+	{
+		++mLargeAllocations;
+		mLargeBytes += size;
+		return ::operator new(size);
+	}
+
+	static const AllocateFunc* const kAllocateFuncs = AllocateTable(std::make_index_sequence<kNumClasses>());
+	unsigned int classIndex = GetSizeClass(size);
+	++mBlocksInUse[classIndex];
+	mRequestedBytes[classIndex] += size;
+
+	CachedBlock* block = mCacheHeads[classIndex];
+	if (block != nullptr)
+	{
+		mCacheHeads[classIndex] = block->mNext;
+		--mCacheCounts[classIndex];
+		return block;
+	}
+	return kAllocateFuncs[classIndex](mPools);
+}
+
+inline void SmallObjectAllocator::Free(void* ptr, size_t size)
+{
+	if (size > kMaxClassBytes)
+	{
+		DbgAssert(mLargeAllocations > 0, "Freeing more large allocations than were made.");
+		--mLargeAllocations;
+		mLargeBytes -= size;
+		::operator delete(ptr);
+		return;
+	}
+
+	static const FreeFunc* const kFreeFuncs = FreeTable(std::make_index_sequence<kNumClasses>());
+	unsigned int classIndex = GetSizeClass(size);
+	DbgAssert(mBlocksInUse[classIndex] > 0, "Freeing more blocks than were allocated from this size class.");
+	--mBlocksInUse[classIndex];
+	mRequestedBytes[classIndex] -= size;
+
+	if (mCacheCounts[classIndex] < kCacheBlocks)
+	{
+		CachedBlock* block = static_cast<CachedBlock*>(ptr);
+		block->mNext = mCacheHeads[classIndex];
+		mCacheHeads[classIndex] = block;
+		++mCacheCounts[classIndex];
+		return;
+	}
+	kFreeFuncs[classIndex](mPools, ptr);
+}
+
+inline void SmallObjectAllocator::FlushCaches()
+{
+	static const FreeFunc* const kFreeFuncs = FreeTable(std::make_index_sequence<kNumClasses>());
+	for (unsigned int i = 0; i < kNumClasses; ++i)
+	{
+		while (mCacheHeads[i] != nullptr)
+		{
+			CachedBlock* block = mCacheHeads[i];
+			mCacheHeads[i] = block->mNext;
+			kFreeFuncs[i](mPools, block);
+		}
+		mCacheCounts[i] = 0;
+	}
+}
+
+inline SmallObjectAllocator::SizeClassStats SmallObjectAllocator::GetClassStats(unsigned int classIndex) const
+{
+	DbgAssert(classIndex < kNumClasses, "Size class index out of range.");
+	static const StatsFunc* const kStatsFuncs = StatsTable(std::make_index_sequence<kNumClasses>());
+	SizeClassStats stats;
+	stats.mClassBytes = interior::SizeClassBytes(classIndex);
+	stats.mBlocksInUse = mBlocksInUse[classIndex];
+	stats.mRequestedBytes = mRequestedBytes[classIndex];
+	kStatsFuncs[classIndex](mPools, stats);
+	stats.mBlocksFree += mCacheCounts[classIndex];
+	return stats;
+}
+
+template <size_t... classIndices>
+const SmallObjectAllocator::AllocateFunc* SmallObjectAllocator::AllocateTable(std::index_sequence<classIndices...>)
+{
+	static const AllocateFunc table[] = { &AllocateFromClass<classIndices>... };
+	return table;
+}
+
+template <size_t... classIndices>
+const SmallObjectAllocator::FreeFunc* SmallObjectAllocator::FreeTable(std::index_sequence<classIndices...>)
+{
+	static const FreeFunc table[] = { &FreeToClass<classIndices>... };
+	return table;
+}
+
+template <size_t... classIndices>
+const SmallObjectAllocator::StatsFunc* SmallObjectAllocator::StatsTable(std::index_sequence<classIndices...>)
+{
+	static const StatsFunc table[] = { &GetPoolStats<classIndices>... };
+	return table;
+}
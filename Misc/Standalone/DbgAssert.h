@@ -0,0 +1,7 @@
+// Stand-in for the engine's DbgAssert.h, so the tests and benchmarks build from this repository alone
+// Like the engine's, DbgAssert(expr, message) checks expr in debug builds and compiles to nothing under NDEBUG
+// Put this directory on the include path after the engine's own headers, if any (see Tests/ and Benchmarks/)
+#pragma once
+#include <cassert>
+
+#define DbgAssert(expr, message) assert((expr) && (message))
@@ -0,0 +1,59 @@
+// Stand-in for the engine's legacy Math.h, so the benchmarks build from this repository alone
+// It declares only what SimdMath.h uses: Math::Sin and Math::Cos, and the legacy Vector3, Matrix4, and Quaternion types
+// Put this directory on the include path after the engine's own headers, if any (see Benchmarks/SimdMathBenchmark.cpp)
+#pragma once
+#include <cmath>
+#include <cstring>
+#include <xmmintrin.h>
+
+namespace Math
+{
+	inline float Sin(float angle)
+	{
+		return std::sin(angle);
+	}
+
+	inline float Cos(float angle)
+	{
+		return std::cos(angle);
+	}
+}
+
+class Vector3
+{
+public:
+	float x;
+	float y;
+	float z;
+
+	Vector3(float inX, float inY, float inZ)
+		: x(inX), y(inY), z(inZ)
+	{}
+
+	// Construct from the first three components of vec
+	explicit Vector3(__m128 vec)
+	{
+		float temp[4];
+		_mm_storeu_ps(temp, vec);
+		x = temp[0];
+		y = temp[1];
+		z = temp[2];
+	}
+};
+
+class Matrix4
+{
+public:
+	float mat[4][4];
+
+	Matrix4() {}
+
+	// Construct from four rows
+	explicit Matrix4(const __m128 rows[4])
+	{
+		memcpy(mat, rows, sizeof(mat));
+	}
+};
+
+// Only passed by reference (see SimdMatrix4::LoadFromQuaternion)
+class Quaternion;
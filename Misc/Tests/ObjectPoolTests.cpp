@@ -0,0 +1,103 @@
+// Handle resolution tests for ObjectPool (see ObjectPool.h)
+// PoolAlloc.h includes the engine's DbgAssert.h, which ../Standalone stands in for
+// Build and run from this directory:
+//  g++ -std=c++17 -O2 -I.. -I../Standalone ObjectPoolTests.cpp -o ObjectPoolTests && ./ObjectPoolTests
+// Exits with a non-zero status if any check fails
+#include <cstdio>
+#include "ObjectPool.h"
+
+namespace
+{
+	int gFailures = 0;
+
+	void Check(bool condition, const char* what)
+	{
+		if (!condition)
+		{
+			printf("FAILED: %s\n", what);
+			++gFailures;
+		}
+	}
+
+	struct Tracked
+	{
+		static int sLive;
+		int mValue;
+
+		explicit Tracked(int value) : mValue(value) { ++sLive; }
+		~Tracked() { --sLive; }
+	};
+	int Tracked::sLive = 0;
+
+	typedef ObjectPool<Tracked, 8> TrackedPool;
+
+	void TestNullHandle()
+	{
+		TrackedPool pool;
+		TrackedPool::Handle null;
+		Check(null.IsNull(), "default handle is null");
+		Check(!pool.IsValid(null), "null handle is invalid on a fresh pool");
+		Check(pool.Get(null) == nullptr, "null handle resolves to nullptr on a fresh pool");
+
+		// Block 0 is live now, and its handle has index 0 just like the null handle
+		TrackedPool::Handle first = pool.Create(1);
+		Check((first.mValue & 7) == 0, "first object is in block 0");
+		Check(pool.Get(null) == nullptr, "null handle doesn't resolve to a live block 0");
+
+		pool.Destroy(first);
+		Check(pool.Get(null) == nullptr, "null handle doesn't resolve to a freed block 0");
+		Check(pool.GetCount() == 0 && Tracked::sLive == 0, "destroying leaves the pool empty");
+	}
+
+	void TestStaleHandles()
+	{
+		TrackedPool pool;
+		TrackedPool::Handle handle = pool.Create(7);
+		Check(pool.IsValid(handle) && pool.Get(handle)->mValue == 7, "live handle resolves");
+		Check(pool.GetHandle(pool.Get(handle)) == handle, "GetHandle round-trips");
+
+		pool.Destroy(handle);
+		Check(!pool.IsValid(handle), "handle is stale after Destroy");
+
+		// The next Create reuses the block, which must not revive the old handle
+		TrackedPool::Handle reused = pool.Create(8);
+		Check((reused.mValue & 7) == (handle.mValue & 7), "Create reuses the freed block");
+		Check(reused != handle, "reused block gets a new handle");
+		Check(!pool.IsValid(handle), "old handle stays stale after the block is reused");
+		Check(pool.Get(reused) != nullptr && pool.Get(reused)->mValue == 8, "new handle resolves to the new object");
+
+		// Handles hold the generation above the 3 index bits an 8 object pool needs; bumping it gives an even generation,
+		// which Create never hands out, so it must not resolve either
+		TrackedPool::Handle forged(reused.mValue + (1u << 3));
+		Check(!pool.IsValid(forged), "handle with an even generation is invalid");
+	}
+
+	void TestForEach()
+	{
+		TrackedPool pool;
+		TrackedPool::Handle handles[8];
+		for (int i = 0; i < 8; ++i)
+		{
+			handles[i] = pool.Create(i);
+		}
+		pool.Destroy(handles[2]);
+		pool.Destroy(handles[5]);
+
+		int sum = 0;
+		int visited = 0;
+		pool.ForEach([&](Tracked& object) { sum += object.mValue; ++visited; });
+		Check(visited == 6 && pool.GetCount() == 6, "ForEach visits exactly the live objects");
+		Check(sum == 0 + 1 + 3 + 4 + 6 + 7, "ForEach visits the right objects");
+	}
+}
+
+int main()
+{
+	TestNullHandle();
+	TestStaleHandles();
+	TestForEach();
+	Check(Tracked::sLive == 0, "every object was destroyed");
+
+	printf(gFailures == 0 ? "All object pool tests passed\n" : "%d object pool checks failed\n", gFailures);
+	return gFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+// Round-trip error and throughput tests for SmallestThreeQuaternion (see QuaternionCompression.h)
+// Build and run from this directory:
+//  g++ -std=c++17 -O2 -msse4.1 -I.. QuaternionCompressionTests.cpp -o QuaternionCompressionTests && ./QuaternionCompressionTests
+// Exits with a non-zero status if any check fails; throughput is reported but never fails the run
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "QuaternionCompression.h"
+
+namespace
+{
+	int gFailures = 0;
+
+	void Check(bool condition, const char* what, unsigned int bits, std::size_t index)
+	{
+		if (!condition)
+		{
+			if (gFailures < 20)
+			{
+				printf("FAILED: %s (%u bits, quaternion %zu)\n", what, bits, index);
+			}
+			++gFailures;
+		}
+	}
+
+	// Uniformly distributed unit quaternions, including some with exact ties and components on the quantization range's edges
+	std::vector<Quaternion<float>> MakeQuaternions(std::size_t count)
+	{
+		std::mt19937 rng(1234);
+		std::normal_distribution<float> normal;
+		std::vector<Quaternion<float>> quats;
+		quats.push_back(Quaternion<float>::identity);
+		quats.push_back(Quaternion<float>(0.0f, 0.0f, 0.0f, -1.0f));
+		quats.push_back(Quaternion<float>(0.5f, -0.5f, 0.5f, -0.5f));
+		quats.push_back(Quaternion<float>(interior::kSmallestThreeRange, 0.0f, -interior::kSmallestThreeRange, 0.0f));
+		while (quats.size() < count)
+		{
+			Quaternion<float> quat(normal(rng), normal(rng), normal(rng), normal(rng));
+			if (quat.LengthSq() > 1e-6f)
+			{
+				quats.push_back(quat.Normalize());
+			}
+		}
+		return quats;
+	}
+
+	template<unsigned int bits>
+	void TestRoundTrip(const std::vector<Quaternion<float>>& quats)
+	{
+		typedef SmallestThreeQuaternion<bits> Compressed;
+		// Each kept component is off by at most half a quantization step; the rebuilt component's error is bounded by
+		//  sum(|kept| * error) / |rebuilt|, where the three kept components are at most 1/sqrt(2) and the rebuilt one at least 1/2
+		const float keptBound = interior::kSmallestThreeRange / static_cast<float>((1u << bits) - 1) + 1e-6f;
+		const float rebuiltBound = 3.0f * interior::kSmallestThreeRange * keptBound / 0.5f + 1e-6f;
+
+		std::vector<Compressed> packed(quats.size());
+		std::vector<Quaternion<float>> decoded(quats.size());
+		EncodeBatch(quats.data(), packed.data(), quats.size());
+		DecodeBatch(packed.data(), decoded.data(), quats.size());
+
+		for (std::size_t i = 0; i < quats.size(); ++i)
+		{
+			Compressed scalar(quats[i]);
+			Check(scalar.GetPacked() == packed[i].GetPacked(), "EncodeBatch matches Encode", bits, i);
+			Quaternion<float> scalarDecoded = scalar.Decode();
+			Check(scalarDecoded.x == decoded[i].x && scalarDecoded.y == decoded[i].y &&
+				scalarDecoded.z == decoded[i].z && scalarDecoded.w == decoded[i].w, "DecodeBatch matches Decode", bits, i);
+
+			// Compare against whichever of q and -q was encoded
+			const Quaternion<float>& quat = quats[i];
+			float sign = quat.x * decoded[i].x + quat.y * decoded[i].y + quat.z * decoded[i].z + quat.w * decoded[i].w < 0.0f ? -1.0f : 1.0f;
+			const float original[4] = { quat.x * sign, quat.y * sign, quat.z * sign, quat.w * sign };
+			const float result[4] = { decoded[i].x, decoded[i].y, decoded[i].z, decoded[i].w };
+			std::uint32_t dropped = static_cast<std::uint32_t>(packed[i].GetPacked() >> (3 * bits)) & 3;
+			for (std::uint32_t c = 0; c < 4; ++c)
+			{
+				float error = std::fabs(original[c] - result[c]);
+				Check(error <= (c == dropped ? rebuiltBound : keptBound), "round-trip error within bound", bits, i);
+			}
+		}
+
+		// Every tail length goes through the padded path without touching elements past count
+		for (std::size_t count = 1; count < 8; ++count)
+		{
+			std::vector<Compressed> tailPacked(count + 1);
+			tailPacked[count].SetPacked(0);
+			EncodeBatch(quats.data(), tailPacked.data(), count);
+			Check(tailPacked[count].GetPacked() == 0, "EncodeBatch stays within count", bits, count);
+		}
+	}
+
+	template<unsigned int bits>
+	void ReportThroughput(const std::vector<Quaternion<float>>& quats)
+	{
+		typedef SmallestThreeQuaternion<bits> Compressed;
+		std::vector<Compressed> packed(quats.size());
+		std::vector<Quaternion<float>> decoded(quats.size());
+		const int repeats = 20;
+		double count = static_cast<double>(quats.size()) * repeats;
+
+		auto start = std::chrono::steady_clock::now();
+		for (int r = 0; r < repeats; ++r)
+		{
+			for (std::size_t i = 0; i < quats.size(); ++i)
+			{
+				packed[i].Encode(quats[i]);
+			}
+		}
+		auto scalarEncode = std::chrono::steady_clock::now() - start;
+
+		start = std::chrono::steady_clock::now();
+		for (int r = 0; r < repeats; ++r)
+		{
+			EncodeBatch(quats.data(), packed.data(), quats.size());
+		}
+		auto batchEncode = std::chrono::steady_clock::now() - start;
+
+		start = std::chrono::steady_clock::now();
+		for (int r = 0; r < repeats; ++r)
+		{
+			for (std::size_t i = 0; i < quats.size(); ++i)
+			{
+				decoded[i] = packed[i].Decode();
+			}
+		}
+		auto scalarDecode = std::chrono::steady_clock::now() - start;
+
+		start = std::chrono::steady_clock::now();
+		for (int r = 0; r < repeats; ++r)
+		{
+			DecodeBatch(packed.data(), decoded.data(), quats.size());
+		}
+		auto batchDecode = std::chrono::steady_clock::now() - start;
+
+		auto nsPer = [count](std::chrono::steady_clock::duration time) { return std::chrono::duration<double, std::nano>(time).count() / count; };
+		printf("%2u bits (%zu bytes): encode %.2f ns scalar, %.2f ns batch; decode %.2f ns scalar, %.2f ns batch\n",
+			bits, sizeof(Compressed), nsPer(scalarEncode), nsPer(batchEncode), nsPer(scalarDecode), nsPer(batchDecode));
+	}
+}
+
+int main()
+{
+	std::vector<Quaternion<float>> quats = MakeQuaternions(1 << 16);
+
+	// 2 through 4 bits pack into 16 bit words, 5 through 10 into 32 bits, and 11 through 15 into 48 bits
+	TestRoundTrip<2>(quats);
+	TestRoundTrip<4>(quats);
+	TestRoundTrip<5>(quats);
+	TestRoundTrip<10>(quats);
+	TestRoundTrip<11>(quats);
+	TestRoundTrip<15>(quats);
+
+	std::vector<Quaternion<float>> throughputQuats = MakeQuaternions(1 << 20);
+	ReportThroughput<4>(throughputQuats);
+	ReportThroughput<10>(throughputQuats);
+	ReportThroughput<15>(throughputQuats);
+
+	printf(gFailures == 0 ? "All quaternion compression tests passed\n" : "%d quaternion compression checks failed\n", gFailures);
+	return gFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+// Tests for the SSE kernels in SimdKernels.h and the float Vector and Quaternion specializations built on them
+// Build and run from this directory:
+//  g++ -std=c++17 -O2 -msse4.1 -I.. SimdKernelTests.cpp -o SimdKernelTests && ./SimdKernelTests
+// Also build with -DMATH_NO_SIMD, or without -msse4.1 (which skips the kernel checks), to run the library checks
+//  on the generic code the libraries fall back to
+// Exits with a non-zero status if any check fails
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include "Quaternion.h"
+
+namespace
+{
+	int gFailures = 0;
+
+	// Check actual is within a relative tolerance of expected, which is computed in double
+	void Check(float actual, double expected, const char* what)
+	{
+		if (std::fabs(actual - expected) > 1e-4 * (1.0 + std::fabs(expected)))
+		{
+			if (gFailures < 20)
+			{
+				printf("FAILED: %s (got %g, expected %g)\n", what, actual, expected);
+			}
+			++gFailures;
+		}
+	}
+
+	std::mt19937 gRng(1234);
+
+	float Random()
+	{
+		return std::uniform_real_distribution<float>(-2.0f, 2.0f)(gRng);
+	}
+
+#ifdef MATH_HAS_SSE4_1
+	// Row-major 4x4 matrices and vectors as the float kernels lay them out
+	void TestKernels()
+	{
+		float lhs[16], rhs[16], vec[4];
+		for (int i = 0; i < 16; ++i)
+		{
+			lhs[i] = Random();
+			rhs[i] = Random();
+		}
+		for (float& component : vec)
+		{
+			component = Random();
+		}
+
+		double product[16];
+		for (int row = 0; row < 4; ++row)
+		{
+			for (int col = 0; col < 4; ++col)
+			{
+				product[row * 4 + col] = 0.0;
+				for (int k = 0; k < 4; ++k)
+				{
+					product[row * 4 + col] += double(lhs[row * 4 + k]) * rhs[k * 4 + col];
+				}
+			}
+		}
+
+		float out[16];
+		interior::SimdMatrixMultiply4(lhs, rhs, out);
+		for (int i = 0; i < 16; ++i)
+		{
+			Check(out[i], product[i], "SimdMatrixMultiply4");
+		}
+
+		// The output may alias either input
+		float aliased[16];
+		std::copy(lhs, lhs + 16, aliased);
+		interior::SimdMatrixMultiply4(aliased, rhs, aliased);
+		for (int i = 0; i < 16; ++i)
+		{
+			Check(aliased[i], product[i], "SimdMatrixMultiply4 with out == lhs");
+		}
+		std::copy(rhs, rhs + 16, aliased);
+		interior::SimdMatrixMultiply4(lhs, aliased, aliased);
+		for (int i = 0; i < 16; ++i)
+		{
+			Check(aliased[i], product[i], "SimdMatrixMultiply4 with out == rhs");
+		}
+
+		float transposed[16];
+		std::copy(lhs, lhs + 16, transposed);
+		interior::SimdTranspose4(transposed);
+		for (int row = 0; row < 4; ++row)
+		{
+			for (int col = 0; col < 4; ++col)
+			{
+				Check(transposed[row * 4 + col], lhs[col * 4 + row], "SimdTranspose4");
+			}
+		}
+
+		float result[4];
+		interior::SimdColVecMult4(lhs, vec, result);
+		for (int row = 0; row < 4; ++row)
+		{
+			double expected = 0.0;
+			for (int k = 0; k < 4; ++k)
+			{
+				expected += double(lhs[row * 4 + k]) * vec[k];
+			}
+			Check(result[row], expected, "SimdColVecMult4");
+		}
+
+		interior::SimdRowVecMult4(vec, lhs, result);
+		for (int col = 0; col < 4; ++col)
+		{
+			double expected = 0.0;
+			for (int k = 0; k < 4; ++k)
+			{
+				expected += double(vec[k]) * lhs[k * 4 + col];
+			}
+			Check(result[col], expected, "SimdRowVecMult4");
+		}
+
+		// SimdTransform3 writes exactly three floats, with w = 1 for points and 0 for directions
+		for (float w : { 1.0f, 0.0f })
+		{
+			float transformed[4] = { 0.0f, 0.0f, 0.0f, 99.0f };
+			interior::SimdTransform3(lhs, vec, w, transformed);
+			for (int row = 0; row < 3; ++row)
+			{
+				double expected = double(lhs[row * 4]) * vec[0] + double(lhs[row * 4 + 1]) * vec[1] + double(lhs[row * 4 + 2]) * vec[2] + double(lhs[row * 4 + 3]) * w;
+				Check(transformed[row], expected, "SimdTransform3");
+			}
+			Check(transformed[3], 99.0, "SimdTransform3 leaves the fourth float alone");
+		}
+	}
+#endif // MATH_HAS_SSE4_1
+
+	// The float specializations (or the generic code, without SSE4.1) against the generic double code
+	void TestLibraries()
+	{
+		Vector<float, 3> a3(Random(), Random(), Random());
+		Vector<float, 3> b3(Random(), Random(), Random());
+		Vector<double, 3> a3d(a3[0], a3[1], a3[2]);
+		Vector<double, 3> b3d(b3[0], b3[1], b3[2]);
+		Vector<float, 3> cross = Cross(a3, b3);
+		Vector<float, 3> crossMember = a3.Cross(b3);
+		Vector<double, 3> crossd = Cross(a3d, b3d);
+		for (int i = 0; i < 3; ++i)
+		{
+			Check(cross[i], crossd[i], "Cross");
+			Check(crossMember[i], crossd[i], "Vector<float, 3>::Cross");
+		}
+
+		// Keep the divisors away from zero
+		Vector<float, 4> a4(Random(), Random(), Random(), Random());
+		Vector<float, 4> b4(3.0f + Random(), 3.0f + Random(), -3.0f + Random(), 3.0f + Random());
+		Vector<double, 4> a4d(a4[0], a4[1], a4[2], a4[3]);
+		Vector<double, 4> b4d(b4[0], b4[1], b4[2], b4[3]);
+		Check(Dot(a4, b4), Dot(a4d, b4d), "Dot");
+
+		Vector<float, 4> sum = a4 + b4;
+		Vector<float, 4> difference = a4 - b4;
+		Vector<float, 4> product = a4 * b4;
+		Vector<float, 4> quotient = a4 / b4;
+		Vector<float, 4> compound(a4);
+		compound /= b4;
+		compound *= b4;
+		compound += b4;
+		compound -= b4;
+		for (int i = 0; i < 4; ++i)
+		{
+			Check(sum[i], a4d[i] + b4d[i], "Vector<float, 4> +");
+			Check(difference[i], a4d[i] - b4d[i], "Vector<float, 4> -");
+			Check(product[i], a4d[i] * b4d[i], "Vector<float, 4> *");
+			Check(quotient[i], a4d[i] / b4d[i], "Vector<float, 4> /");
+			Check(compound[i], a4d[i], "Vector<float, 4> compound operators");
+		}
+
+		Quaternion<float> qa(Random(), Random(), Random(), Random());
+		Quaternion<float> qb(Random(), Random(), Random(), Random());
+		Quaternion<double> qad(qa.x, qa.y, qa.z, qa.w);
+		Quaternion<double> qbd(qb.x, qb.y, qb.z, qb.w);
+		Quaternion<float> qc = qa * qb;
+		Quaternion<double> qcd = qad * qbd;
+		qa *= qb;
+		Check(qc.x, qcd.x, "Quaternion<float> * x");
+		Check(qc.y, qcd.y, "Quaternion<float> * y");
+		Check(qc.z, qcd.z, "Quaternion<float> * z");
+		Check(qc.w, qcd.w, "Quaternion<float> * w");
+		Check(qa.x, qcd.x, "Quaternion<float> *= x");
+		Check(qa.y, qcd.y, "Quaternion<float> *= y");
+		Check(qa.z, qcd.z, "Quaternion<float> *= z");
+		Check(qa.w, qcd.w, "Quaternion<float> *= w");
+	}
+}
+
+int main()
+{
+	for (int i = 0; i < 1000; ++i)
+	{
+#ifdef MATH_HAS_SSE4_1
+		TestKernels();
+#endif
+		TestLibraries();
+	}
+
+	// The kernels are tested whenever they exist; the libraries only use them without MATH_NO_SIMD
+#if defined(MATH_HAS_SSE4_1) && !defined(MATH_NO_SIMD)
+	const char* libraryPath = "SSE4.1";
+#else
+	const char* libraryPath = "generic";
+#endif
+	if (gFailures == 0)
+	{
+		printf("All SIMD kernel tests passed (libraries on the %s path)\n", libraryPath);
+	}
+	else
+	{
+		printf("%d SIMD kernel checks failed (libraries on the %s path)\n", gFailures, libraryPath);
+	}
+	return gFailures == 0 ? 0 : 1;
+}
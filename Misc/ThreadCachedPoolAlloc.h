@@ -0,0 +1,344 @@
+// Defines a thread-caching front end for the pool-based memory allocator
+#pragma once
+#include "PoolAlloc.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Defines a Thread Cached Pool Allocator
+// Templated based on size of block, the number of blocks in the pool, and the number of blocks per magazine.
+//
+// This follows the magazine design from Bonwick and Adams' "Magazines and Vmem" (USENIX 2001):
+// each thread owns two magazines (small stacks of free block pointers), a loaded one and a previous one.
+// Allocate pops from the loaded magazine and Free pushes onto it, touching only thread-local memory.
+// When the loaded magazine runs empty (or full) it is swapped with the previous one, and only when both are
+// exhausted does the thread lock the central depot to trade a whole magazine. Keeping two magazines means a thread
+// alternating Allocate and Free at a magazine boundary doesn't go to the depot on every call.
+// The depot holds full and empty magazines and falls back to an ordinary PoolAllocator when it has no full ones.
+//
+// Each thread's magazines are returned to the depot automatically when the thread exits, or on demand with FlushThreadCache.
+// The depot is reference counted by the allocator and every thread cache using it, so a thread may exit after
+// the allocator is destroyed; the pool memory is then released by the last thread to flush or exit.
+// A thread also drops its caches for destroyed allocators the next time it creates a cache for another allocator of the same type.
+// Blocks may be freed on a different thread than the one that allocated them.
+//
+// Larger magazines mean fewer depot trips but more free blocks stranded in idle threads' caches,
+// so numBlocks should comfortably exceed 2 * magazineSize * (number of threads).
+//
+// To define your own pool to be used, it's recommended to typedef as such:
+// typedef ThreadCachedPoolAllocator<256, 1024, 32> ComponentPool;
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize = 32>
+class ThreadCachedPoolAllocator
+{
+public:
+	static_assert(magazineSize > 0, "Magazines must hold at least one block.");
+
+	// Size of each block, so adapters like PoolStlAllocator can tell which requests fit
+	static const size_t kBlockSize = blockSize;
+	// Alignment of each block
+	static const size_t kBlockAlignment = PoolAllocator<blockSize, numBlocks>::kBlockAlignment;
+
+	// The constructor creates the depot and its central pool.
+	ThreadCachedPoolAllocator();
+
+	// The destructor releases the allocator's reference to the depot.
+	// Threads that still hold cached magazines keep the depot alive until they flush or exit.
+	~ThreadCachedPoolAllocator();
+
+	// Allocate returns a pointer to usable memory within the pool.
+	//
+	// It will DbgAssert size <= blockSize.
+	// Pops from this thread's loaded magazine, going to the depot only when both of this thread's magazines are empty.
+	//
+	// If there are no blocks available anywhere but other threads' caches, it should trigger a DbgAssert and return nullptr.
+	void* Allocate(size_t size);
+
+	// Free pushes ptr onto this thread's loaded magazine, going to the depot only when both of this thread's magazines are full.
+	//
+	// The POOL_ALLOC_DEBUG fill and boundary checks run when blocks are returned to the central pool, not on every Free.
+	//
+	// As with PoolAllocator, don't call this on pointers that did not come from this pool!
+	void Free(void* ptr);
+
+	// Return every block cached by the calling thread to the central pool and drop the thread's cache,
+	// releasing its reference to the depot
+	// This happens automatically when a thread exits
+	void FlushThreadCache();
+
+	// Returns the number of blocks free in the central pool and the depot's full magazines
+	// Blocks cached in threads' own magazines are not counted
+	unsigned int GetNumBlocksFree();
+
+protected:
+	// A stack of up to magazineSize free blocks
+	struct Magazine
+	{
+		unsigned int mCount;
+		void* mBlocks[magazineSize];
+
+		Magazine()
+		{
+			mCount = 0;
+		}
+
+		bool IsEmpty() const { return mCount == 0; }
+		bool IsFull() const { return mCount == magazineSize; }
+	};
+
+	// Shared state every thread exchanges magazines with, guarded by mMutex
+	struct Depot
+	{
+		std::mutex mMutex;
+		PoolAllocator<blockSize, numBlocks> mPool;
+		std::vector<Magazine*> mFullMagazines;
+		std::vector<Magazine*> mEmptyMagazines;
+		// Set when the allocator is destroyed, so threads know to drop their caches for it
+		std::atomic<bool> mOrphaned;
+
+		Depot();
+		~Depot();
+
+		// Get an empty magazine, reusing a spare one if possible
+		Magazine* TakeEmptyMagazine();
+		// Return every block in mag to the central pool
+		void ReturnBlocks(Magazine* mag);
+		// Return every block in mag to the central pool and keep mag as a spare
+		void ReleaseMagazine(Magazine* mag);
+	};
+
+	// A thread's pair of magazines for one allocator
+	// The destructor runs on thread exit and hands both magazines back to the depot
+	struct ThreadCache
+	{
+		std::shared_ptr<Depot> mDepot;
+		Magazine* mLoaded;
+		Magazine* mPrevious;
+
+		explicit ThreadCache(const std::shared_ptr<Depot>& depot);
+		~ThreadCache();
+	};
+
+	typedef std::vector<std::unique_ptr<ThreadCache>> ThreadCacheList;
+
+	// The calling thread's caches for every allocator of this type
+	static ThreadCacheList& GetThreadCaches();
+	// Find or create the calling thread's cache for this allocator
+	ThreadCache& GetThreadCache();
+
+	// Refill the cache's loaded magazine from the depot; returns false if there is nothing left to allocate
+	bool Refill(ThreadCache& cache);
+	// Make room in the cache's loaded magazine by handing a full magazine to the depot
+	void Spill(ThreadCache& cache);
+
+	std::shared_ptr<Depot> mDepot;
+};
+
+// IMPLEMENTATIONS for ThreadCachedPoolAllocator
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::ThreadCachedPoolAllocator()
+	: mDepot(std::make_shared<Depot>())
+{}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::~ThreadCachedPoolAllocator()
+{
+	mDepot->mOrphaned.store(true, std::memory_order_relaxed);
+}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+void* ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::Allocate(size_t size)
+{
+	DbgAssert(size <= blockSize, "Allocation request is bigger than block.");
+	if (size > blockSize)
+		return nullptr;
+
+	ThreadCache& cache = GetThreadCache();
+	if (cache.mLoaded->IsEmpty())
+	{
+		if (!cache.mPrevious->IsEmpty())
+		{
+			std::swap(cache.mLoaded, cache.mPrevious);
+		}
+		else if (!Refill(cache))
+		{
+			DbgAssert(false, "No memory blocks available.");
+			return nullptr;
+		}
+	}
+
+	return cache.mLoaded->mBlocks[--cache.mLoaded->mCount];
+}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+void ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::Free(void* ptr)
+{
+	ThreadCache& cache = GetThreadCache();
+	if (cache.mLoaded->IsFull())
+	{
+		if (!cache.mPrevious->IsFull())
+		{
+			std::swap(cache.mLoaded, cache.mPrevious);
+		}
+		else
+		{
+			Spill(cache);
+		}
+	}
+
+	cache.mLoaded->mBlocks[cache.mLoaded->mCount++] = ptr;
+}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+void ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::FlushThreadCache()
+{
+	ThreadCacheList& caches = GetThreadCaches();
+	for (auto it = caches.begin(); it != caches.end(); ++it)
+	{
+		if ((*it)->mDepot == mDepot)
+		{
+			// The cache's destructor hands its magazines back to the depot
+			caches.erase(it);
+			return;
+		}
+	}
+}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+unsigned int ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::GetNumBlocksFree()
+{
+	std::lock_guard<std::mutex> lock(mDepot->mMutex);
+	unsigned int blocksFree = mDepot->mPool.GetNumBlocksFree();
+	for (Magazine* mag : mDepot->mFullMagazines)
+		blocksFree += mag->mCount;
+	return blocksFree;
+}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+typename ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::ThreadCacheList&
+ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::GetThreadCaches()
+{
+	// One list per template instantiation per thread, usually holding a single allocator's cache
+	// Destroying the list on thread exit flushes every cache in it
+	static thread_local ThreadCacheList tCaches;
+	return tCaches;
+}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+typename ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::ThreadCache&
+ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::GetThreadCache()
+{
+	ThreadCacheList& caches = GetThreadCaches();
+
+	// Most recently created caches are the most likely to be used, so search backwards
+	for (auto it = caches.rbegin(); it != caches.rend(); ++it)
+	{
+		if ((*it)->mDepot == mDepot)
+			return **it;
+	}
+
+	// Before adding a cache, drop the ones whose allocator is gone, so a long-lived thread doesn't keep their depots alive
+	for (size_t i = 0; i < caches.size();)
+	{
+		if (caches[i]->mDepot->mOrphaned.load(std::memory_order_relaxed))
+		{
+			caches[i] = std::move(caches.back());
+			caches.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	caches.emplace_back(new ThreadCache(mDepot));
+	return *caches.back();
+}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+bool ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::Refill(ThreadCache& cache)
+{
+	// Both magazines are empty here
+	std::lock_guard<std::mutex> lock(mDepot->mMutex);
+	if (!mDepot->mFullMagazines.empty())
+	{
+		// Trade the empty loaded magazine for a full one
+		mDepot->mEmptyMagazines.push_back(cache.mLoaded);
+		cache.mLoaded = mDepot->mFullMagazines.back();
+		mDepot->mFullMagazines.pop_back();
+		return true;
+	}
+
+	// No full magazines, so fill the loaded one straight from the central pool
+	while (!cache.mLoaded->IsFull() && mDepot->mPool.GetNumBlocksFree() > 0)
+		cache.mLoaded->mBlocks[cache.mLoaded->mCount++] = mDepot->mPool.Allocate(blockSize);
+	return !cache.mLoaded->IsEmpty();
+}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+void ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::Spill(ThreadCache& cache)
+{
+	// Both magazines are full here
+	std::lock_guard<std::mutex> lock(mDepot->mMutex);
+	mDepot->mFullMagazines.push_back(cache.mLoaded);
+	cache.mLoaded = mDepot->TakeEmptyMagazine();
+}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::Depot::Depot()
+	: mOrphaned(false)
+{}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::Depot::~Depot()
+{
+	for (Magazine* mag : mFullMagazines)
+		delete mag;
+	for (Magazine* mag : mEmptyMagazines)
+		delete mag;
+}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+typename ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::Magazine*
+ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::Depot::TakeEmptyMagazine()
+{
+	if (mEmptyMagazines.empty())
+		return new Magazine();
+
+	Magazine* mag = mEmptyMagazines.back();
+	mEmptyMagazines.pop_back();
+	return mag;
+}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+void ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::Depot::ReturnBlocks(Magazine* mag)
+{
+	while (!mag->IsEmpty())
+		mPool.Free(mag->mBlocks[--mag->mCount]);
+}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+void ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::Depot::ReleaseMagazine(Magazine* mag)
+{
+	ReturnBlocks(mag);
+	mEmptyMagazines.push_back(mag);
+}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::ThreadCache::ThreadCache(const std::shared_ptr<Depot>& depot)
+	: mDepot(depot)
+{
+	std::lock_guard<std::mutex> lock(mDepot->mMutex);
+	mLoaded = mDepot->TakeEmptyMagazine();
+	mPrevious = mDepot->TakeEmptyMagazine();
+}
+
+template <size_t blockSize, unsigned int numBlocks, unsigned int magazineSize>
+ThreadCachedPoolAllocator<blockSize, numBlocks, magazineSize>::ThreadCache::~ThreadCache()
+{
+	std::lock_guard<std::mutex> lock(mDepot->mMutex);
+	// The depot now owns both magazines; it is destroyed after this if the allocator is already gone
+	mDepot->ReleaseMagazine(mLoaded);
+	mDepot->ReleaseMagazine(mPrevious);
+}
@@ -2,13 +2,20 @@
 #include <array>
 #include <stdexcept>
 #include <cmath>
+#include <algorithm>
+#include "ScalarTraits.h"
+#include "SimdKernels.h"
 
 // This library follows the convention where possible that functions are defined twice:
 //  once as a member function that acts in-place, and once as a free function that returns a new, altered copy
-// The structs in this library only accept arithmetic template arguments
+// The structs in this library only accept arithmetic or SIMD packet template arguments (see ScalarTraits.h)
 // Vectors' internal data is accessible as a public std::array called data
 // There are using aliases for common vector types and sizes at the end of the declarations
 // Vectors sized 2, 3, and 4 have static constants of commonly useful defaults
+// Length, Dist, and Normalize take an optional Precision template argument (see ScalarTraits.h) that defaults to Precision::Exact
+//  -i.e. vec.Normalize<Precision::Refined>() or Normalize<Precision::Fast>(vec)
+// For float, Vector4 component-wise arithmetic and Dot, and Vector3 Cross, run on the SSE kernels in SimdKernels.h when SSE4.1 is enabled,
+//  unless MATH_NO_SIMD is defined
 
 // Turn on this #define to use anonymous structs/unions to get access to components with subscript notation (i.e. Vector2.x, Vector3.r)
 // Note that it is undefined behavior, but "many compilers implement, as a non-standard language extension, the ability to read inactive members of a union"
@@ -23,11 +30,11 @@
 //  SizedVectorBase<T>& operator/=(const S& scalar);
 //  SizedVectorBase<T>& Zero();
 //  T LengthSq() const;
-//  T Length() const;
-//  void Normalize();
+//  template<Precision precision = Precision::Exact> T Length() const;
+//  template<Precision precision = Precision::Exact> void Normalize();
 //  T Dot(const SizedVectorBase<T>& other) const;
 //  void Saturate();
-//  void Clamp(const T& min, const T& max);
+//  void Clamp(const T& minVal, const T& maxVal);
 //  void Abs();
 namespace interior
 {
@@ -226,16 +233,16 @@ Vector<T, n> Zero();
 template<typename T, std::size_t n>
 T LengthSq(const Vector<T, n>& vec);
 // Length of vec
-template<typename T, std::size_t n>
+template<Precision precision = Precision::Exact, typename T, std::size_t n>
 T Length(const Vector<T, n>& vec);
 // Distance squared between vecs lhs and rhs
 template<typename T, std::size_t n>
 T DistSq(const Vector<T, n>& lhs, const Vector<T, n>& rhs);
 // Distance between vecs lhs and rhs
-template<typename T, std::size_t n>
+template<Precision precision = Precision::Exact, typename T, std::size_t n>
 T Dist(const Vector<T, n>& lhs, const Vector<T, n>& rhs);
 // Normalize a copy of vec
-template<typename T, std::size_t n>
+template<Precision precision = Precision::Exact, typename T, std::size_t n>
 Vector<T, n> Normalize(const Vector<T, n>& vec);
 // Dot product
 template<typename T, std::size_t n>
@@ -249,9 +256,9 @@ Vector<T, n> Lerp(const Vector<T, n>& a, const Vector<T, n>& b, float f);
 // Component-wise clamp values between 0 and 1 a copy of vec
 template<typename T, std::size_t n>
 Vector<T, n> Saturate(const Vector<T, n>& vec);
-// Component-wise clamp values between min and max a copy of vec
+// Component-wise clamp values between minVal and maxVal a copy of vec
 template<typename T, std::size_t n>
-Vector<T, n> Clamp(const Vector<T, n>& vec, const T& min, const T& max);
+Vector<T, n> Clamp(const Vector<T, n>& vec, const T& minVal, const T& maxVal);
 // Component-wise absolute value a copy of vec
 template<typename T, std::size_t n>
 Vector<T, n> Abs(const Vector<T, n>& vec);
@@ -275,7 +282,7 @@ namespace interior
 	struct SizedVectorBase
 	{
 	public:
-		static_assert(std::is_arithmetic<T>::value, "Vectors only accept arithmetic template arguments");
+		static_assert(IsMathScalar<T>::value, "Vectors only accept arithmetic or SIMD packet template arguments");
 
 		T& operator[](std::size_t index);
 		const T& operator[](std::size_t index) const;
@@ -293,15 +300,17 @@ namespace interior
 		// Length squared of vec
 		T LengthSq() const;
 		// Length of vec
+		template<Precision precision = Precision::Exact>
 		T Length() const;
 		// Normalize this vector in place
+		template<Precision precision = Precision::Exact>
 		void Normalize();
 		// Dot product
 		T Dot(const SizedVectorBase<T>& other) const;
 		// Component-wise clamp values between 0 and 1 this vector in place
 		void Saturate();
-		// Component-wise clamp values between min and max this vector in place
-		void Clamp(const T& min, const T& max);
+		// Component-wise clamp values between minVal and maxVal this vector in place
+		void Clamp(const T& minVal, const T& maxVal);
 		// Component-wise absolute value this vector in place
 		void Abs();
 
@@ -313,46 +322,18 @@ namespace interior
 		void LoopedCopyOtherRaw(const T* const other);
 		void FillFromInitializerList(std::initializer_list<T> args);
 
+		// Every Vector's component-wise operators forward to these
+		template<typename U, std::size_t m>
+		friend struct ::Vector;
+
 		// Component-wise vector +=
 		SizedVectorBase<T>& operator+=(const SizedVectorBase<T>& rhs);
-		template<typename T, std::size_t n>
-		friend Vector<T, n>& Vector<T, n>::operator+=(const Vector<T, n>& rhs);
-		template<typename T>
-		friend Vector<T, 2>& Vector<T, 2>::operator+=(const Vector<T, 2>& rhs);
-		template<typename T>
-		friend Vector<T, 3>& Vector<T, 3>::operator+=(const Vector<T, 3>& rhs);
-		template<typename T>
-		friend Vector<T, 4>& Vector<T, 4>::operator+=(const Vector<T, 4>& rhs);
 		// Component-wise vector -=
 		SizedVectorBase<T>& operator-=(const SizedVectorBase<T>& rhs);
-		template<typename T, std::size_t n>
-		friend Vector<T, n>& Vector<T, n>::operator-=(const Vector<T, n>& rhs);
-		template<typename T>
-		friend Vector<T, 2>& Vector<T, 2>::operator-=(const Vector<T, 2>& rhs);
-		template<typename T>
-		friend Vector<T, 3>& Vector<T, 3>::operator-=(const Vector<T, 3>& rhs);
-		template<typename T>
-		friend Vector<T, 4>& Vector<T, 4>::operator-=(const Vector<T, 4>& rhs);
 		// Component-wise vector *=
 		SizedVectorBase<T>& operator*=(const SizedVectorBase<T>& rhs);
-		template<typename T, std::size_t n>
-		friend Vector<T, n>& Vector<T, n>::operator*=(const Vector<T, n>& rhs);
-		template<typename T>
-		friend Vector<T, 2>& Vector<T, 2>::operator*=(const Vector<T, 2>& rhs);
-		template<typename T>
-		friend Vector<T, 3>& Vector<T, 3>::operator*=(const Vector<T, 3>& rhs);
-		template<typename T>
-		friend Vector<T, 4>& Vector<T, 4>::operator*=(const Vector<T, 4>& rhs);
 		// Component-wise vector /=
 		SizedVectorBase<T>& operator/=(const SizedVectorBase<T>& rhs);
-		template<typename T, std::size_t n>
-		friend Vector<T, n>& Vector<T, n>::operator/=(const Vector<T, n>& rhs);
-		template<typename T>
-		friend Vector<T, 2>& Vector<T, 2>::operator/=(const Vector<T, 2>& rhs);
-		template<typename T>
-		friend Vector<T, 3>& Vector<T, 3>::operator/=(const Vector<T, 3>& rhs);
-		template<typename T>
-		friend Vector<T, 4>& Vector<T, 4>::operator/=(const Vector<T, 4>& rhs);
 
 	private:
 		std::size_t size;
@@ -398,7 +379,7 @@ constexpr Vector<T, n>::Vector(const Vector<T, n>& other)
 template<typename T, std::size_t n>
 constexpr Vector<T, n>& Vector<T, n>::operator=(const Vector<T, n>& other)
 {
-	SetDataPtr(data.data());
+	this->SetDataPtr(data.data());
 	data = other.data;
 	return *this;
 }
@@ -460,7 +441,7 @@ constexpr Vector<T, 2>::Vector(const Vector<T, 2>& other)
 template<typename T>
 constexpr Vector<T, 2>& Vector<T, 2>::operator=(const Vector<T, 2>& other)
 {
-	SetDataPtr(data.data());
+	this->SetDataPtr(data.data());
 	data = other.data;
 	return *this;
 }
@@ -533,7 +514,7 @@ constexpr Vector<T, 3>::Vector(const Vector<T, 3>& other)
 template<typename T>
 constexpr Vector<T, 3>& Vector<T, 3>::operator=(const Vector<T, 3>& other)
 {
-	SetDataPtr(data.data());
+	this->SetDataPtr(data.data());
 	data = other.data;
 	return *this;
 }
@@ -623,7 +604,7 @@ constexpr Vector<T, 4>::Vector(const Vector<T, 4>& other)
 template<typename T>
 constexpr Vector<T, 4>& Vector<T, 4>::operator=(const Vector<T, 4>& other)
 {
-	SetDataPtr(data.data());
+	this->SetDataPtr(data.data());
 	data = other.data;
 	return *this;
 }
@@ -680,7 +661,7 @@ template<typename T, std::size_t n>
 Vector<T, n> operator+(const Vector<T, n>& lhs, const Vector<T, n>& rhs)
 {
 	Vector<T, n> temp(lhs);
-	static_cast<interior::SizedVectorBase<T>&>(temp) += rhs;
+	temp += rhs;
 	return temp;
 }
 
@@ -688,7 +669,7 @@ template<typename T, std::size_t n>
 Vector<T, n> operator-(const Vector<T, n>& lhs, const Vector<T, n>& rhs)
 {
 	Vector<T, n> temp(lhs);
-	static_cast<interior::SizedVectorBase<T>&>(temp) -= rhs;
+	temp -= rhs;
 	return temp;
 }
 
@@ -696,7 +677,7 @@ template<typename T, std::size_t n>
 Vector<T, n> operator*(const Vector<T, n>& lhs, const Vector<T, n>& rhs)
 {
 	Vector<T, n> temp(lhs);
-	static_cast<interior::SizedVectorBase<T>&>(temp) *= rhs;
+	temp *= rhs;
 	return temp;
 }
 
@@ -704,7 +685,7 @@ template<typename T, std::size_t n>
 Vector<T, n> operator/(const Vector<T, n>& lhs, const Vector<T, n>& rhs)
 {
 	Vector<T, n> temp(lhs);
-	static_cast<interior::SizedVectorBase<T>&>(temp) /= rhs;
+	temp /= rhs;
 	return temp;
 }
 
@@ -753,10 +734,10 @@ T LengthSq(const Vector<T, n>& vec)
 	return vec.LengthSq();
 }
 
-template<typename T, std::size_t n>
+template<Precision precision, typename T, std::size_t n>
 T Length(const Vector<T, n>& vec)
 {
-	return vec.Length();
+	return vec.template Length<precision>();
 }
 
 template<typename T, std::size_t n>
@@ -766,18 +747,18 @@ T DistSq(const Vector<T, n>& lhs, const Vector<T, n>& rhs)
 	return diff.LengthSq();
 }
 
-template<typename T, std::size_t n>
+template<Precision precision, typename T, std::size_t n>
 T Dist(const Vector<T, n>& lhs, const Vector<T, n>& rhs)
 {
 	Vector<T, n> diff(lhs - rhs);
-	return diff.Length();
+	return diff.template Length<precision>();
 }
 
-template<typename T, std::size_t n>
+template<Precision precision, typename T, std::size_t n>
 Vector<T, n> Normalize(const Vector<T, n>& vec)
 {
 	Vector<T, n> temp(vec);
-	temp.Normalize();
+	temp.template Normalize<precision>();
 	return temp;
 }
 
@@ -808,10 +789,10 @@ Vector<T, n> Saturate(const Vector<T, n>& vec)
 }
 
 template<typename T, std::size_t n>
-Vector<T, n> Clamp(const Vector<T, n>& vec, const T& min, const T& max)
+Vector<T, n> Clamp(const Vector<T, n>& vec, const T& minVal, const T& maxVal)
 {
 	Vector<T, n> temp(vec);
-	temp.Clamp(min, max);
+	temp.Clamp(minVal, maxVal);
 	return temp;
 }
 
@@ -888,15 +869,25 @@ T interior::SizedVectorBase<T>::LengthSq() const
 }
 
 template<typename T>
+template<Precision precision>
 T interior::SizedVectorBase<T>::Length() const
 {
-	return sqrt(LengthSq());
+	return Sqrt<precision>(LengthSq());
 }
 
 template<typename T>
+template<Precision precision>
 void interior::SizedVectorBase<T>::Normalize()
 {
-	*this /= Length();
+	if (precision == Precision::Exact)
+	{
+		*this /= Length();
+	}
+	else
+	{
+		// Approximate modes scale by an estimated reciprocal length rather than dividing
+		*this *= ReciprocalSqrt<precision>(LengthSq());
+	}
 }
 
 template<typename T>
@@ -917,17 +908,21 @@ void interior::SizedVectorBase<T>::Saturate()
 }
 
 template<typename T>
-void interior::SizedVectorBase<T>::Clamp(const T& min, const T& max)
+void interior::SizedVectorBase<T>::Clamp(const T& minVal, const T& maxVal)
 {
+	// Unqualified so packet scalars find their own min/max
+	using std::min;
+	using std::max;
 	for (std::size_t i = 0; i < size; ++i)
 	{
-		pData[i] = std::max(min, std::min(pData[i], max));
+		pData[i] = max(minVal, min(pData[i], maxVal));
 	}
 }
 
 template<typename T>
 void interior::SizedVectorBase<T>::Abs()
 {
+	using std::abs;
 	for (std::size_t i = 0; i < size; ++i)
 	{
 		pData[i] = abs(pData[i]);
@@ -1015,4 +1010,78 @@ interior::SizedVectorBase<T>& interior::SizedVectorBase<T>::operator/=(const int
 		pData[i] /= rhs.pData[i];
 	}
 	return *this;
-}
\ No newline at end of file
+}
+
+#if defined(MATH_HAS_SSE4_1) && !defined(MATH_NO_SIMD)
+// float specializations using the SSE kernels (see SimdKernels.h)
+template<>
+inline Vector<float, 3> Vector<float, 3>::Cross(const Vector<float, 3>& other) const
+{
+	__m128 result = interior::SimdCross(_mm_setr_ps(data[0], data[1], data[2], 0.0f), _mm_setr_ps(other.data[0], other.data[1], other.data[2], 0.0f));
+	return Vector<float, 3>(_mm_cvtss_f32(result), _mm_cvtss_f32(_mm_shuffle_ps(result, result, _MM_SHUFFLER(1, 1, 1, 1))),
+		_mm_cvtss_f32(_mm_shuffle_ps(result, result, _MM_SHUFFLER(2, 2, 2, 2))));
+}
+
+template<>
+inline Vector<float, 4>& Vector<float, 4>::operator+=(const Vector<float, 4>& rhs)
+{
+	_mm_storeu_ps(data.data(), _mm_add_ps(_mm_loadu_ps(data.data()), _mm_loadu_ps(rhs.data.data())));
+	return *this;
+}
+
+template<>
+inline Vector<float, 4>& Vector<float, 4>::operator-=(const Vector<float, 4>& rhs)
+{
+	_mm_storeu_ps(data.data(), _mm_sub_ps(_mm_loadu_ps(data.data()), _mm_loadu_ps(rhs.data.data())));
+	return *this;
+}
+
+template<>
+inline Vector<float, 4>& Vector<float, 4>::operator*=(const Vector<float, 4>& rhs)
+{
+	_mm_storeu_ps(data.data(), _mm_mul_ps(_mm_loadu_ps(data.data()), _mm_loadu_ps(rhs.data.data())));
+	return *this;
+}
+
+template<>
+inline Vector<float, 4>& Vector<float, 4>::operator/=(const Vector<float, 4>& rhs)
+{
+	_mm_storeu_ps(data.data(), _mm_div_ps(_mm_loadu_ps(data.data()), _mm_loadu_ps(rhs.data.data())));
+	return *this;
+}
+
+// Component-wise arithmetic, preferred over the operator templates for float Vector4s
+inline Vector<float, 4> operator+(const Vector<float, 4>& lhs, const Vector<float, 4>& rhs)
+{
+	Vector<float, 4> temp(lhs);
+	temp += rhs;
+	return temp;
+}
+
+inline Vector<float, 4> operator-(const Vector<float, 4>& lhs, const Vector<float, 4>& rhs)
+{
+	Vector<float, 4> temp(lhs);
+	temp -= rhs;
+	return temp;
+}
+
+inline Vector<float, 4> operator*(const Vector<float, 4>& lhs, const Vector<float, 4>& rhs)
+{
+	Vector<float, 4> temp(lhs);
+	temp *= rhs;
+	return temp;
+}
+
+inline Vector<float, 4> operator/(const Vector<float, 4>& lhs, const Vector<float, 4>& rhs)
+{
+	Vector<float, 4> temp(lhs);
+	temp /= rhs;
+	return temp;
+}
+
+// Dot product, preferred over the Dot template for float Vector4s
+inline float Dot(const Vector<float, 4>& lhs, const Vector<float, 4>& rhs)
+{
+	return _mm_cvtss_f32(_mm_dp_ps(_mm_loadu_ps(lhs.data.data()), _mm_loadu_ps(rhs.data.data()), 0xF1));
+}
+#endif // MATH_HAS_SSE4_1 && !MATH_NO_SIMD